@@ -0,0 +1,261 @@
+#include "bitboard.h"
+
+#include <algorithm>
+#include <cstring>
+
+struct PieceMaskTable
+{
+  PieceMaskTable()
+  {
+    for (GLint type = kTetroI; type <= kTetroZ; ++type)
+      {
+	Tetromino tetro(static_cast<TetroType>(type));
+	for (GLint rotation = kRsZero; rotation <= kRsLeft; ++rotation)
+	  {
+	    PieceMask& mask = masks[type][rotation];
+	    const TileColor* shape = tetro.Shape();
+	    mask.side = tetro.TemplateSideLength();
+	    mask.min_col = mask.min_row = mask.side;
+	    mask.max_col = mask.max_row = -1;
+	    for (GLint row = 0; row < 4; ++row)
+	      {
+		mask.rows[row] = 0;
+		for (GLint col = 0; row < mask.side && col < mask.side; ++col)
+		  {
+		    if (shape[row * mask.side + col] == kEmpty)
+		      continue;
+		    mask.rows[row] |= 1 << col;
+		    mask.min_col = std::min(mask.min_col, col);
+		    mask.max_col = std::max(mask.max_col, col);
+		    mask.min_row = std::min(mask.min_row, row);
+		    mask.max_row = std::max(mask.max_row, row);
+		  }
+	      }
+	    tetro.Rotate(kRight);
+	  }
+      }
+  }
+  
+  PieceMask masks[7][4];
+};
+
+const PieceMask& GetPieceMask(TetroType type, RotationState rotation)
+{
+  static const PieceMaskTable table;
+  return table.masks[type][rotation];
+}
+
+BitBoard::BitBoard(GLint nrows, GLint ncols) : nrows_(nrows),
+					       ncols_(ncols),
+					       full_row_((1 << ncols) - 1)
+{
+  Clear();
+}
+
+BitBoard BitBoard::FromPlayField(const PlayField& playfield)
+{
+  BitBoard board(playfield.NumRows(), playfield.NumCols());
+  for (GLint row = 0; row < board.nrows_; ++row)
+    {
+      for (GLint col = 0; col < board.ncols_; ++col)
+	{
+	  if (playfield.GetTileColor(row, col) != kEmpty)
+	    board.rows_[row] |= 1 << col;
+	}
+    }
+  return board;
+}
+
+bool BitBoard::IsTileOpen(GLint row, GLint col) const
+{
+  return row >= 0 && row < nrows_ && col >= 0 && col < ncols_ && !(rows_[row] & (1 << col));
+}
+
+void BitBoard::Clear()
+{
+  std::fill(rows_, rows_ + kMaxRows, 0);
+}
+
+bool BitBoard::Fits(const PieceMask& piece, GLint row, GLint col) const
+{
+  if (col + piece.min_col < 0 || col + piece.max_col >= ncols_ ||
+      row - piece.max_row < 0 || row - piece.min_row >= nrows_)
+    return false;
+
+  for (GLint template_row = piece.min_row; template_row <= piece.max_row; ++template_row)
+    {
+      if (rows_[row - template_row] & Shift(piece.rows[template_row], col))
+	return false;
+    }
+  return true;
+}
+
+GLint BitBoard::DropRow(const PieceMask& piece, GLint row, GLint col) const
+{
+  while (Fits(piece, row - 1, col))
+    --row;
+  return row;
+}
+
+GLint BitBoard::Place(const PieceMask& piece, GLint row, GLint col)
+{
+  for (GLint template_row = piece.min_row; template_row <= piece.max_row; ++template_row)
+    rows_[row - template_row] |= Shift(piece.rows[template_row], col);
+
+  // only rows the piece touched can have been completed
+  GLint lowest = row - piece.max_row;
+  GLint highest = row - piece.min_row;
+  GLint write = lowest;
+  for (GLint read = lowest; read < nrows_; ++read)
+    {
+      if (read <= highest && rows_[read] == full_row_)
+	continue;
+      rows_[write++] = rows_[read];
+    }
+  GLint lines_cleared = nrows_ - write;
+  std::fill(rows_ + write, rows_ + nrows_, 0);
+  return lines_cleared;
+}
+
+bool BitBoard::AddGarbage(GLint lines, GLint hole)
+{
+  lines = std::min(lines, nrows_);
+  bool fits = true;
+  for (GLint row = nrows_ - lines; row < nrows_; ++row)
+    fits = fits && rows_[row] == 0;
+  std::copy_backward(rows_, rows_ + nrows_ - lines, rows_ + nrows_);
+  std::fill(rows_, rows_ + lines, full_row_ & ~(1 << hole));
+  return fits;
+}
+
+GLint BitBoard::Height() const
+{
+  GLint row = nrows_;
+  while (row > 0 && rows_[row - 1] == 0)
+    --row;
+  return row;
+}
+
+uint64_t BitBoard::Hash() const
+{
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ ncols_;
+  GLint height = Height();
+  for (GLint row = 0; row < height; ++row)
+    {
+      hash ^= rows_[row];
+      hash *= 0x100000001b3ULL;
+      hash ^= hash >> 29;
+    }
+  hash ^= hash >> 32;
+  hash *= 0xd6e8feb86659fd93ULL;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+bool BitBoard::operator==(const BitBoard& other) const
+{
+  return nrows_ == other.nrows_ && ncols_ == other.ncols_ &&
+    std::memcmp(rows_, other.rows_, nrows_ * sizeof(rows_[0])) == 0;
+}
+
+struct Footprint
+{
+  GLint bottom;
+  uint64_t cells;
+};
+
+// Returns false if an earlier placement already covers the same cells
+static bool AddFootprint(const PieceMask& piece, GLint row, GLint col, Footprint* seen, GLint* nseen)
+{
+  Footprint footprint = { row - piece.max_row, 0 };
+  for (GLint template_row = piece.max_row; template_row >= piece.min_row; --template_row)
+    footprint.cells = (footprint.cells << 16) | (col >= 0 ? piece.rows[template_row] << col : piece.rows[template_row] >> -col);
+  for (GLint i = 0; i < *nseen; ++i)
+    {
+      if (seen[i].bottom == footprint.bottom && seen[i].cells == footprint.cells)
+	return false;
+    }
+  seen[(*nseen)++] = footprint;
+  return true;
+}
+
+void GeneratePlacements(const BitBoard& board, TetroType type, std::vector<Placement>* placements)
+{
+  placements->clear();
+  if (type == kNone)
+    return;
+
+  // Mirrors PlayField::SpawnTetro
+  RotationState spawn_rotation = GetPieceMask(type, kRsZero).side > board.NumCols() ? kRsRight : kRsZero;
+  const PieceMask& spawn = GetPieceMask(type, spawn_rotation);
+  GLint spawn_row = board.NumRows() - 1;
+  GLint spawn_col = std::max(0, (board.NumCols() - spawn.side) / 2);
+  if (!board.Fits(spawn, spawn_row, spawn_col))
+    return;
+  if (type != kTetroI)
+    {
+      for (GLint i = 0; i < 2 && board.Fits(spawn, spawn_row - 1, spawn_col); ++i)
+	--spawn_row;
+    }
+
+  // nothing above the stack can stop a falling piece
+  GLint height = board.Height();
+  Footprint seen[4 * BitBoard::kMaxCols];
+  GLint nseen = 0;
+  
+  for (GLint rotation = kRsZero; rotation <= kRsLeft; ++rotation)
+    {
+      const PieceMask& piece = GetPieceMask(type, static_cast<RotationState>(rotation));
+      // the opposite rotation is two right turns away, the others one turn either way
+      RotationState halfway = static_cast<RotationState>((spawn_rotation + 1) % 4);
+      if (!board.Fits(piece, spawn_row, spawn_col) ||
+	  ((rotation + 4 - spawn_rotation) % 4 == 2 && !board.Fits(GetPieceMask(type, halfway), spawn_row, spawn_col)))
+	continue;
+
+      for (GLint direction = -1; direction <= 1; direction += 2)
+	{
+	  GLint col = direction < 0 ? spawn_col : spawn_col + 1;
+	  for ( ; board.Fits(piece, spawn_row, col); col += direction)
+	    {
+	      GLint row = board.DropRow(piece, std::min(spawn_row, height + piece.max_row), col);
+
+	      // rotations of symmetric pieces can land on the same cells
+	      if (!AddFootprint(piece, row, col, seen, &nseen))
+		continue;
+	      
+	      Placement placement = { type, static_cast<RotationState>(rotation), row, col, false };
+	      placements->push_back(placement);
+	    }
+	}
+    }
+}
+
+void GenerateDropPlacements(const BitBoard& board, TetroType type, std::vector<Placement>* placements)
+{
+  placements->clear();
+  if (type == kNone)
+    return;
+
+  GLint height = board.Height();
+  Footprint seen[4 * BitBoard::kMaxCols];
+  GLint nseen = 0;
+
+  for (GLint rotation = kRsZero; rotation <= kRsLeft; ++rotation)
+    {
+      const PieceMask& piece = GetPieceMask(type, static_cast<RotationState>(rotation));
+      // top of the piece on the top row
+      GLint top_row = board.NumRows() - 1 + piece.min_row;
+      for (GLint col = -piece.min_col; col + piece.max_col < board.NumCols(); ++col)
+	{
+	  if (!board.Fits(piece, top_row, col))
+	    continue;
+	  GLint row = board.DropRow(piece, std::min(top_row, height + piece.max_row), col);
+
+	  if (!AddFootprint(piece, row, col, seen, &nseen))
+	    continue;
+
+	  Placement placement = { type, static_cast<RotationState>(rotation), row, col, false };
+	  placements->push_back(placement);
+	}
+    }
+}
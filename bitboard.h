@@ -0,0 +1,89 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "tetromino.h"
+#include "playfield.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+/*
+  Compact copy of a playfield stack for search.
+  Each row is a bitmask with bit c set when column c is filled.
+  Rows and piece templates use the same orientation as PlayField:
+  row 0 is the bottom row and a piece at (row, col) has the top left
+  corner of its template on that tile.
+*/
+
+// Occupied cells of one tetromino rotation, one mask per template row from the top
+struct PieceMask
+{
+  GLint side;
+  uint16_t rows[4];
+  GLint min_col, max_col;
+  GLint min_row, max_row;
+};
+
+const PieceMask& GetPieceMask(TetroType type, RotationState rotation);
+
+struct Placement
+{
+  TetroType type;
+  RotationState rotation;
+  GLint row;
+  GLint col;
+  bool hold;
+};
+
+class BitBoard
+{
+public:
+  BitBoard(GLint nrows = 22, GLint ncols = 10);
+  static BitBoard FromPlayField(const PlayField& playfield);
+
+  GLint NumRows() const { return nrows_; }
+  GLint NumCols() const { return ncols_; }
+  uint16_t FullRow() const { return full_row_; }
+  
+  uint16_t Row(GLint row) const { return rows_[row]; }
+  const uint16_t* Rows() const { return rows_; }
+  void SetRow(GLint row, uint16_t mask) { rows_[row] = mask & full_row_; }
+  bool IsTileOpen(GLint row, GLint col) const;
+  void Clear();
+  
+  bool Fits(const PieceMask& piece, GLint row, GLint col) const;
+  GLint DropRow(const PieceMask& piece, GLint row, GLint col) const;
+  // Locks the piece into the stack and returns the number of lines cleared
+  GLint Place(const PieceMask& piece, GLint row, GLint col);
+  // Pushes the stack up and fills the bottom with full rows open at one column.
+  // Returns false if filled cells were pushed off the top.
+  bool AddGarbage(GLint lines, GLint hole);
+
+  GLint Height() const;
+  bool IsEmpty() const { return Height() == 0; }
+  uint64_t Hash() const;
+
+  bool operator==(const BitBoard& other) const;
+  bool operator!=(const BitBoard& other) const { return !(*this == other); }
+
+  static const GLint kMaxRows = 32;
+  static const GLint kMaxCols = 16;
+private:
+  static uint16_t Shift(uint16_t mask, GLint col) { return col >= 0 ? mask << col : mask >> -col; }
+  
+  GLint nrows_, ncols_;
+  uint16_t full_row_;
+  uint16_t rows_[kMaxRows];
+};
+
+// All distinct resting places the piece can reach from spawn by rotating,
+// shifting along the top of the field and hard dropping
+void GeneratePlacements(const BitBoard& board, TetroType type, std::vector<Placement>* placements);
+
+// Every rotation and column the piece can be dropped into straight from above,
+// for narrow research wells where there is no spawn position to start from
+void GenerateDropPlacements(const BitBoard& board, TetroType type, std::vector<Placement>* placements);
+
+
+#endif // BITBOARD_H
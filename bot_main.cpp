@@ -0,0 +1,227 @@
+#include "bot_protocol.h"
+#include "evaluator.h"
+#include "expectimax.h"
+#include "game.h"
+#include "mcts.h"
+#include "nn_evaluator.h"
+#include "playfield.h"
+#include "plugin_host.h"
+#include "randomizer.h"
+#include "thread_pool.h"
+#include "tournament.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Either end of the bot protocol. "engine" answers on stdin/stdout
+  with the expectimax search, or with Monte Carlo tree search on every
+  core, scoring boards with the linear weights or a network loaded
+  from a file, and "host" plays headless games through any engine command,
+  checking every move it gets back. "plugin" plays the same games
+  through a bot loaded into the process, and "mcts" plays them with
+  the tree search directly and reports how fast its rollouts ran.
+*/
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+
+void Usage()
+{
+  std::cerr << "usage: bot engine [milliseconds per move] [--mcts] [--network <file>]" << std::endl;
+  std::cerr << "       bot host <pieces> <seed> <engine command...>" << std::endl;
+  std::cerr << "       bot plugin <pieces> <seed> <library> [cpu milliseconds per move]" << std::endl;
+  std::cerr << "       bot mcts <pieces> <seed> [milliseconds per move]" << std::endl;
+}
+
+int RunEngine(double seconds, bool bmcts, const std::string& network)
+{
+  Randomizer randomizer;
+  // without a network file this is the linear evaluator
+  NetworkEvaluator evaluator(EvalWeights::Default());
+  if (!network.empty() && !evaluator.Load(network))
+    {
+      std::cerr << "Failed to load network " << network << std::endl;
+      return EXIT_FAILURE;
+    }
+  ExpectimaxSearch search(evaluator, randomizer);
+  search.SetTimeBudget(seconds);
+  // a pool of one runs inline, so expectimax doesn't start idle threads
+  ThreadPool pool(bmcts ? 0 : 1);
+  MonteCarloSearch mcts(evaluator, randomizer, &pool);
+  mcts.SetTimeBudget(seconds);
+  
+  BotEngine engine(stdin, stdout);
+  bool bsuggest;
+  while (engine.Read(&bsuggest))
+    {
+      if (!bsuggest)
+	continue;
+      const BotPosition& position = engine.Position();
+      Placement best;
+      TetroType next = position.queue.size() > 1 ? position.queue[1] : kNone;
+      if (position.queue.empty() ||
+	  !(bmcts ? mcts.Search(position.board, position.queue[0], next, position.held, position.can_hold, &best) :
+	    search.Search(position.board, position.queue[0], next, position.held, position.can_hold, &best)))
+	engine.Answer(nullptr);
+      else
+	engine.Answer(&best);
+    }
+  return EXIT_SUCCESS;
+}
+
+int RunHost(GLint max_pieces, unsigned int seed, const std::vector<std::string>& command)
+{
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+  Game game(&playfield);
+  game.Seed(seed);
+  game.Restart();
+  game.BeginPlay();
+
+  BotHost host;
+  if (!host.Launch(command))
+    {
+      std::cerr << "Failed to start " << command[0] << std::endl;
+      return EXIT_FAILURE;
+    }
+  std::vector<TetroType> queue = { playfield.FallingTetroType(), game.Next() };
+  host.Start(BitBoard::FromPlayField(playfield), queue, game.Held());
+
+  GLint pieces = 0;
+  auto start = std::chrono::steady_clock::now();
+  while (pieces < max_pieces && !game.IsGameOver())
+    {
+      Placement placement;
+      if (!host.Suggest(&placement))
+	break;
+      if (!game.Place(placement))
+	{
+	  std::cerr << "Engine suggested an illegal move: " << PieceLetter(placement.type) << ' ' << placement.rotation << ' '
+		    << placement.row << ' ' << placement.col << std::endl;
+	  return EXIT_FAILURE;
+	}
+      host.Play(placement);
+      // holding into an empty slot used up the next piece as well
+      if (host.Position().queue.empty())
+	host.AddPiece(playfield.FallingTetroType());
+      host.AddPiece(game.Next());
+      host.Sync(BitBoard::FromPlayField(playfield));
+      ++pieces;
+    }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  host.Quit();
+  
+  std::cout << pieces << " pieces, " << game.Lines() << " lines, score " << game.Score() << (game.IsGameOver() ? ", topped out" : "")
+	    << ", " << static_cast<GLint>(pieces / seconds) << " pieces/s" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+int RunPlugin(GLint max_pieces, unsigned int seed, const std::string& library, double cpu_budget)
+{
+  BotPlugin plugin;
+  if (!plugin.Load(library))
+    {
+      std::cerr << "Failed to load " << library << ": " << plugin.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  auto start = std::chrono::steady_clock::now();
+  PluginGameResult result = PlayPluginGame(&plugin, seed, max_pieces, cpu_budget);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (result.billegal)
+    {
+      std::cerr << plugin.Name() << " suggested an illegal move" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  std::cout << plugin.Name() << ": " << result.pieces << " pieces, " << result.lines << " lines, score " << result.score
+	    << (result.bgame_over ? ", topped out" : "") << (result.bover_budget ? ", over budget" : "") << ", "
+	    << static_cast<GLint>(result.pieces / seconds) << " pieces/s, " << result.cpu_time * 1000 / std::max(1, result.pieces) << " cpu ms/piece" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+int RunMcts(GLint max_pieces, unsigned int seed, double seconds)
+{
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+  Game game(&playfield);
+  game.Seed(seed);
+  game.Restart();
+  game.BeginPlay();
+
+  ThreadPool pool;
+  Evaluator evaluator(EvalWeights::Default());
+  MonteCarloSearch search(evaluator, game.GetRandomizer(), &pool);
+  search.SetTimeBudget(seconds);
+
+  GLint pieces = 0;
+  uint64_t rollout_pieces = 0;
+  double search_seconds = 0;
+  while (pieces < max_pieces && !game.IsGameOver())
+    {
+      Placement placement;
+      auto start = std::chrono::steady_clock::now();
+      bool bfound = search.Search(BitBoard::FromPlayField(playfield), playfield.FallingTetroType(), game.Next(), game.Held(), game.CanHold(), &placement);
+      search_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      rollout_pieces += search.RolloutPieces();
+      if (!bfound || !game.Place(placement))
+	break;
+      ++pieces;
+    }
+
+  std::cout << pieces << " pieces, " << game.Lines() << " lines, score " << game.Score() << (game.IsGameOver() ? ", topped out" : "")
+	    << ", " << static_cast<uint64_t>(rollout_pieces / search_seconds) << " rollout pieces/s on " << pool.NumThreads() << " threads" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc >= 2 && std::string(argv[1]) == "engine")
+    {
+      double seconds = 0.05;
+      bool bmcts = false;
+      std::string network;
+      for (GLint arg = 2; arg < argc; ++arg)
+	{
+	  std::string flag = argv[arg];
+	  if (flag == "--mcts")
+	    {
+	      bmcts = true;
+	    }
+	  else if (flag == "--network" && arg + 1 < argc)
+	    {
+	      network = argv[++arg];
+	    }
+	  else if (flag.compare(0, 2, "--") != 0)
+	    {
+	      seconds = atof(argv[arg]) / 1000;
+	    }
+	  else
+	    {
+	      Usage();
+	      return EXIT_FAILURE;
+	    }
+	}
+      return RunEngine(seconds, bmcts, network);
+    }
+
+  if (argc >= 5 && std::string(argv[1]) == "host")
+    {
+      // an engine that dies should show up as a failed read, not kill the host
+      signal(SIGPIPE, SIG_IGN);
+      return RunHost(atoi(argv[2]), strtoul(argv[3], nullptr, 10), std::vector<std::string>(argv + 4, argv + argc));
+    }
+
+  if (argc >= 5 && std::string(argv[1]) == "plugin")
+    return RunPlugin(atoi(argv[2]), strtoul(argv[3], nullptr, 10), argv[4], argc >= 6 ? atof(argv[5]) / 1000 : 0.05);
+
+  if (argc >= 4 && std::string(argv[1]) == "mcts")
+    return RunMcts(atoi(argv[2]), strtoul(argv[3], nullptr, 10), argc >= 5 ? atof(argv[4]) / 1000 : 0.05);
+
+  Usage();
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+#ifndef BOT_PLUGIN_H
+#define BOT_PLUGIN_H
+
+#include <stdint.h>
+
+/*
+  C interface for bots loaded into the game's process.
+  A plugin is a shared object exporting tetris_bot_plugin(), which
+  returns a description of the bot. For every move the host calls
+  suggest() with read-only views of its own board rows and queue;
+  they are only valid until suggest() returns. The bot hands back
+  placements through host->answer() as often as it likes and the
+  last one given within budget is played, so an anytime search can
+  answer after every iteration.
+
+  Moves are budgeted in CPU time of the thread suggest() is called
+  on. host->should_stop() turns true once the budget is spent, and
+  answers given after that are ignored. Work a bot does on threads of
+  its own is not counted, so bots in a tournament should search on
+  the calling thread.
+
+  Pieces are 0 to 6 in the order IJLOSTZ and -1 for none. Board rows
+  are bitmasks with bit c for column c, bottom row first. A placement
+  gives the piece's rotation (0 to 3 clockwise from spawn) and the row
+  and column of the top left of its template, as PlayField does.
+  Holding into an empty slot plays queue[1], as in the guideline.
+*/
+
+#define TETRIS_BOT_ABI_VERSION 2
+#define TETRIS_BOT_ENTRY_POINT "tetris_bot_plugin"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TetrisBotState
+{
+  int32_t rows;
+  int32_t columns;
+  const uint16_t* board;
+  /* queue[0] is the piece to place */
+  const int8_t* queue;
+  int32_t queue_length;
+  int8_t held;
+  uint8_t can_hold;
+  double cpu_budget;
+} TetrisBotState;
+
+typedef struct TetrisBotPlacement
+{
+  int8_t piece;
+  int8_t rotation;
+  int8_t hold;
+  int32_t row;
+  int32_t column;
+} TetrisBotPlacement;
+
+typedef struct TetrisBotHost
+{
+  void* context;
+  void (*answer)(void* context, const TetrisBotPlacement* placement);
+  int32_t (*should_stop)(void* context);
+} TetrisBotHost;
+
+typedef struct TetrisBotPlugin
+{
+  uint32_t abi_version;
+  const char* name;
+  /* returns NULL if the bot can't start */
+  void* (*create)(void);
+  void (*destroy)(void* bot);
+  void (*suggest)(void* bot, const TetrisBotState* state, const TetrisBotHost* host);
+} TetrisBotPlugin;
+
+typedef const TetrisBotPlugin* (*TetrisBotEntryPoint)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* BOT_PLUGIN_H */
@@ -0,0 +1,304 @@
+#include "bot_protocol.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+  const char kPieceLetters[] = "IJLOSTZ";
+  const size_t kMaxLine = 4096;
+
+  void WritePlacement(FILE* file, const char* command, const Placement& placement)
+  {
+    std::fprintf(file, "%s %c %d %d %d %d\n", command, PieceLetter(placement.type), placement.rotation, placement.row, placement.col, placement.hold ? 1 : 0);
+  }
+
+  // Reads "<piece> <rotation> <row> <column> <hold>" from text
+  bool ParsePlacement(const char* text, Placement* placement)
+  {
+    while (*text == ' ')
+      ++text;
+    placement->type = PieceFromLetter(*text);
+    if (placement->type == kNone)
+      return false;
+    char* end = const_cast<char*>(text + 1);
+    long values[4];
+    for (GLint i = 0; i < 4; ++i)
+      {
+	const char* start = end;
+	values[i] = std::strtol(start, &end, 10);
+	if (end == start)
+	  return false;
+      }
+    if (values[0] < 0 || values[0] > 3)
+      return false;
+    placement->rotation = static_cast<RotationState>(values[0]);
+    placement->row = values[1];
+    placement->col = values[2];
+    placement->hold = values[3] != 0;
+    return true;
+  }
+  
+  // Strips the command word off a line and returns the rest
+  const char* SplitCommand(char* line, const char** command)
+  {
+    line[std::strcspn(line, "\r\n")] = '\0';
+    *command = line;
+    char* space = std::strchr(line, ' ');
+    if (!space)
+      return line + std::strlen(line);
+    *space = '\0';
+    return space + 1;
+  }
+}
+
+char PieceLetter(TetroType type)
+{
+  return type >= kTetroI && type <= kTetroZ ? kPieceLetters[type] : '-';
+}
+
+TetroType PieceFromLetter(char letter)
+{
+  const char* found = letter ? std::strchr(kPieceLetters, letter) : nullptr;
+  return found ? static_cast<TetroType>(found - kPieceLetters) : kNone;
+}
+
+BotPosition::BotPosition() : held(kNone),
+			     can_hold(true)
+{ }
+
+void BotPosition::Play(const Placement& placement)
+{
+  if (queue.empty())
+    return;
+  if (placement.hold && held == kNone)
+    {
+      held = queue.front();
+      queue.pop_front();
+      if (queue.empty())
+	return;
+    }
+  else if (placement.hold)
+    {
+      std::swap(queue.front(), held);
+    }
+  board.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+  queue.pop_front();
+  can_hold = true;
+}
+
+BotHost::BotHost() : to_engine_(nullptr),
+		     from_engine_(nullptr),
+		     pid_(-1)
+{ }
+
+bool BotHost::Launch(const std::vector<std::string>& command)
+{
+  if (command.empty())
+    return false;
+  int to_child[2], from_child[2];
+  if (pipe(to_child) != 0)
+    return false;
+  if (pipe(from_child) != 0)
+    {
+      close(to_child[0]);
+      close(to_child[1]);
+      return false;
+    }
+
+  pid_ = fork();
+  if (pid_ == 0)
+    {
+      dup2(to_child[0], STDIN_FILENO);
+      dup2(from_child[1], STDOUT_FILENO);
+      close(to_child[0]);
+      close(to_child[1]);
+      close(from_child[0]);
+      close(from_child[1]);
+      std::vector<char*> argv;
+      for (const std::string& arg : command)
+	argv.push_back(const_cast<char*>(arg.c_str()));
+      argv.push_back(nullptr);
+      execvp(argv[0], argv.data());
+      _exit(127);
+    }
+  close(to_child[0]);
+  close(from_child[1]);
+  if (pid_ < 0)
+    {
+      close(to_child[1]);
+      close(from_child[0]);
+      return false;
+    }
+
+  to_engine_ = fdopen(to_child[1], "w");
+  from_engine_ = fdopen(from_child[0], "r");
+  // messages pile up until the host needs an answer
+  std::setvbuf(to_engine_, nullptr, _IOFBF, 1 << 16);
+  return true;
+}
+
+void BotHost::Start(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held)
+{
+  position_.board = board;
+  position_.queue.assign(queue.begin(), queue.end());
+  position_.held = held;
+  position_.can_hold = true;
+
+  std::fprintf(to_engine_, "start %d %d %c ", board.NumCols(), board.NumRows(), PieceLetter(held));
+  for (TetroType piece : queue)
+    std::fputc(PieceLetter(piece), to_engine_);
+  for (GLint row = 0; row < board.NumRows(); ++row)
+    std::fprintf(to_engine_, " %x", board.Row(row));
+  std::fputc('\n', to_engine_);
+}
+
+bool BotHost::Suggest(Placement* placement)
+{
+  std::fputs("suggest\n", to_engine_);
+  std::fflush(to_engine_);
+
+  line_.resize(kMaxLine);
+  if (!std::fgets(&line_[0], line_.size(), from_engine_))
+    return false;
+  const char* command;
+  const char* rest = SplitCommand(&line_[0], &command);
+  return std::strcmp(command, "move") == 0 && ParsePlacement(rest, placement);
+}
+
+void BotHost::Play(const Placement& placement)
+{
+  position_.Play(placement);
+  WritePlacement(to_engine_, "play", placement);
+}
+
+void BotHost::AddPiece(TetroType piece)
+{
+  position_.queue.push_back(piece);
+  std::fprintf(to_engine_, "piece %c\n", PieceLetter(piece));
+}
+
+void BotHost::Garbage(GLint lines, GLint hole)
+{
+  position_.board.AddGarbage(lines, hole);
+  std::fprintf(to_engine_, "garbage %d %d\n", lines, hole);
+}
+
+void BotHost::Sync(const BitBoard& board)
+{
+  bool bchanged = false;
+  for (GLint row = 0; row < board.NumRows(); ++row)
+    {
+      if (board.Row(row) == position_.board.Row(row))
+	continue;
+      std::fprintf(to_engine_, bchanged ? " %d:%x" : "rows %d:%x", row, board.Row(row));
+      bchanged = true;
+    }
+  if (bchanged)
+    std::fputc('\n', to_engine_);
+  position_.board = board;
+}
+
+void BotHost::Quit()
+{
+  if (!to_engine_)
+    return;
+  std::fputs("quit\n", to_engine_);
+  std::fclose(to_engine_);
+  std::fclose(from_engine_);
+  to_engine_ = nullptr;
+  from_engine_ = nullptr;
+  waitpid(pid_, nullptr, 0);
+}
+
+BotHost::~BotHost()
+{
+  Quit();
+}
+
+BotEngine::BotEngine(FILE* input, FILE* output) : input_(input),
+						  output_(output),
+						  line_(kMaxLine)
+{ }
+
+bool BotEngine::Read(bool* bsuggest)
+{
+  *bsuggest = false;
+  if (!std::fgets(line_.data(), line_.size(), input_))
+    return false;
+  const char* command;
+  const char* rest = SplitCommand(line_.data(), &command);
+  char* end;
+  
+  if (std::strcmp(command, "suggest") == 0)
+    {
+      *bsuggest = true;
+    }
+  else if (std::strcmp(command, "play") == 0)
+    {
+      Placement placement;
+      if (ParsePlacement(rest, &placement))
+	position_.Play(placement);
+    }
+  else if (std::strcmp(command, "piece") == 0)
+    {
+      position_.queue.push_back(PieceFromLetter(rest[0]));
+    }
+  else if (std::strcmp(command, "rows") == 0)
+    {
+      while (*rest)
+	{
+	  long row = std::strtol(rest, &end, 10);
+	  if (*end != ':' || row < 0 || row >= position_.board.NumRows())
+	    break;
+	  position_.board.SetRow(row, std::strtol(end + 1, &end, 16));
+	  rest = end;
+	}
+    }
+  else if (std::strcmp(command, "garbage") == 0)
+    {
+      long lines = std::strtol(rest, &end, 10);
+      long hole = std::strtol(end, &end, 10);
+      position_.board.AddGarbage(lines, hole);
+    }
+  else if (std::strcmp(command, "start") == 0)
+    {
+      long ncols = std::strtol(rest, &end, 10);
+      long nrows = std::strtol(end, &end, 10);
+      if (ncols < 1 || ncols > BitBoard::kMaxCols || nrows < 1 || nrows > BitBoard::kMaxRows)
+	return false;
+      while (*end == ' ')
+	++end;
+      position_.held = PieceFromLetter(*end++);
+      while (*end == ' ')
+	++end;
+      position_.queue.clear();
+      for ( ; *end && *end != ' '; ++end)
+	position_.queue.push_back(PieceFromLetter(*end));
+      position_.board = BitBoard(nrows, ncols);
+      for (GLint row = 0; row < nrows; ++row)
+	position_.board.SetRow(row, std::strtol(end, &end, 16));
+      position_.can_hold = true;
+    }
+  else if (std::strcmp(command, "quit") == 0)
+    {
+      return false;
+    }
+  return true;
+}
+
+void BotEngine::Answer(const Placement* placement)
+{
+  if (placement)
+    WritePlacement(output_, "move", *placement);
+  else
+    std::fputs("none\n", output_);
+  std::fflush(output_);
+}
+
+BotEngine::~BotEngine()
+{
+  
+}
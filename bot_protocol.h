@@ -0,0 +1,111 @@
+#ifndef BOT_PROTOCOL_H
+#define BOT_PROTOCOL_H
+
+#include "bitboard.h"
+
+#include <GL/glew.h>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+/*
+  Line protocol for letting an engine in another process play.
+  After the opening position only changes are sent: the move that
+  was made, the piece that joined the queue, and any rows that
+  differ from what the engine can work out for itself. Messages are
+  buffered and only flushed when the host needs an answer, so a
+  whole piece costs one write and one read on each side.
+
+  Host to engine, one message per line:
+    start <columns> <rows> <held> <queue> <row>...   full position, rows bottom first in hex
+    suggest                                          asks for a move
+    play <placement>                                 the move that was made
+    piece <piece>                                    a piece joined the end of the queue
+    rows <row>:<hex>...                              rows that differ from what the engine expects
+    garbage <lines> <hole>                           full rows pushed in from below, open at one column
+    quit
+  Engine to host:
+    move <placement>
+    none                                             no move fits
+  Pieces are letters from IJLOSTZ, or - for none. A queue is a run of
+  letters starting with the current piece. A placement is
+  "<piece> <rotation> <row> <column> <hold>" with rotation 0 to 3 from
+  spawn clockwise, and row and column locating the top left of the
+  piece's template the same way PlayField does. Holding into an empty
+  slot plays the second piece in the queue, as in the guideline.
+*/
+
+// What both sides know about the game
+struct BotPosition
+{
+  BotPosition();
+
+  void Play(const Placement& placement);
+  
+  BitBoard board;
+  std::deque<TetroType> queue;
+  TetroType held;
+  bool can_hold;
+};
+
+class BotHost
+{
+public:
+  BotHost();
+
+  // Runs the command with its standard input and output connected to the host.
+  // The process should ignore SIGPIPE, or an engine that dies takes the host with it.
+  bool Launch(const std::vector<std::string>& command);
+  
+  void Start(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held);
+  // Returns false if the engine has no move or stopped answering
+  bool Suggest(Placement* placement);
+  void Play(const Placement& placement);
+  void AddPiece(TetroType piece);
+  void Garbage(GLint lines, GLint hole);
+  // Sends whatever rows of the real board the engine doesn't expect
+  void Sync(const BitBoard& board);
+  void Quit();
+
+  const BotPosition& Position() const { return position_; }
+
+  virtual ~BotHost();
+private:
+  BotHost(const BotHost&);
+  void operator=(const BotHost&);
+
+  FILE* to_engine_;
+  FILE* from_engine_;
+  pid_t pid_;
+  BotPosition position_;
+  std::string line_;
+};
+
+class BotEngine
+{
+public:
+  BotEngine(FILE* input, FILE* output);
+
+  // Reads one message and applies it, returning false on quit or end of input.
+  // Sets *bsuggest when the host is waiting for a move.
+  bool Read(bool* bsuggest);
+  // A null placement answers that no move fits
+  void Answer(const Placement* placement);
+
+  const BotPosition& Position() const { return position_; }
+
+  virtual ~BotEngine();
+private:
+  FILE* input_;
+  FILE* output_;
+  BotPosition position_;
+  std::vector<char> line_;
+};
+
+char PieceLetter(TetroType type);
+TetroType PieceFromLetter(char letter);
+
+
+#endif // BOT_PROTOCOL_H
@@ -0,0 +1,113 @@
+#include "evaluator.h"
+
+#include <cstdlib>
+#include <fstream>
+
+EvalWeights EvalWeights::Default()
+{
+  // https://codemyroad.wordpress.com/2013/04/14/tetris-ai-the-near-perfect-player/
+  EvalWeights eval = { { -0.510066, -0.35663, -0.184483, 0.760666, 0, 0, 0, 0 } };
+  return eval;
+}
+
+bool EvalWeights::Load(const std::string& filename)
+{
+  std::ifstream file(filename);
+  EvalWeights loaded;
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    {
+      if (!(file >> loaded.weights[i]))
+	return false;
+    }
+  *this = loaded;
+  return true;
+}
+
+bool EvalWeights::Save(const std::string& filename) const
+{
+  std::ofstream file(filename);
+  file.precision(17);
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    file << weights[i] << (i + 1 < kNumEvalFeatures ? ' ' : '\n');
+  return static_cast<bool>(file);
+}
+
+Evaluator::Evaluator(const EvalWeights& weights) : weights_(weights)
+{ }
+
+double Evaluator::Evaluate(const BitBoard& board) const
+{
+  double features[kNumEvalFeatures];
+  Features(board, features);
+  
+  double value = 0;
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    {
+      if (i != kLinesCleared)
+	value += weights_.weights[i] * features[i];
+    }
+  return value;
+}
+
+void Evaluator::EvaluateBatch(const BitBoard* boards, GLint count, double* values) const
+{
+  for (GLint i = 0; i < count; ++i)
+    values[i] = Evaluate(boards[i]);
+}
+
+void Evaluator::Features(const BitBoard& board, double features[kNumEvalFeatures])
+{
+  const GLint ncols = board.NumCols();
+  const uint16_t full = board.FullRow();
+  const GLint height = board.Height();
+  GLint heights[BitBoard::kMaxCols] = { 0 };
+  
+  GLint holes = 0, row_transitions = 0, column_transitions = 0, well_cells = 0;
+  uint16_t above = 0;
+  // walk down from the top so "above" holds every column covered so far
+  for (GLint row = height - 1; row >= 0; --row)
+    {
+      uint16_t mask = board.Row(row);
+      uint16_t newly_covered = mask & ~above;
+      for (GLint col = 0; newly_covered; ++col, newly_covered >>= 1)
+	{
+	  if (newly_covered & 1)
+	    heights[col] = row + 1;
+	}
+      holes += __builtin_popcount(above & ~mask & full);
+      above |= mask;
+
+      // walls count as filled
+      uint32_t walled = (static_cast<uint32_t>(mask) << 1) | 1 | (1u << (ncols + 1));
+      row_transitions += __builtin_popcount((walled ^ (walled >> 1)) & ((1u << (ncols + 1)) - 1));
+      uint16_t below = row > 0 ? board.Row(row - 1) : full;
+      column_transitions += __builtin_popcount((mask ^ below) & full);
+      
+      uint16_t wells = ~mask & ((mask << 1) | 1) & ((mask >> 1) | (1 << (ncols - 1))) & full;
+      well_cells += __builtin_popcount(wells);
+    }
+
+  GLint aggregate_height = 0, bumpiness = 0, max_height = 0;
+  for (GLint col = 0; col < ncols; ++col)
+    {
+      aggregate_height += heights[col];
+      if (heights[col] > max_height)
+	max_height = heights[col];
+      if (col > 0)
+	bumpiness += std::abs(heights[col] - heights[col - 1]);
+    }
+
+  features[kAggregateHeight] = aggregate_height;
+  features[kHoles] = holes;
+  features[kBumpiness] = bumpiness;
+  features[kLinesCleared] = 0;
+  features[kMaxHeight] = max_height;
+  features[kRowTransitions] = row_transitions;
+  features[kColumnTransitions] = column_transitions;
+  features[kWellCells] = well_cells;
+}
+
+Evaluator::~Evaluator()
+{
+  
+}
@@ -0,0 +1,57 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "bitboard.h"
+
+#include <GL/glew.h>
+#include <string>
+
+enum EvalFeature
+  {
+    kAggregateHeight,
+    kHoles,
+    kBumpiness,
+    kLinesCleared,
+    kMaxHeight,
+    kRowTransitions,
+    kColumnTransitions,
+    kWellCells,
+    kNumEvalFeatures
+  };
+
+struct EvalWeights
+{
+  static EvalWeights Default();
+
+  // Plain text, one weight per feature in EvalFeature order
+  bool Load(const std::string& filename);
+  bool Save(const std::string& filename) const;
+  
+  double weights[kNumEvalFeatures];
+};
+
+/*
+  Linear heuristic over stack features.
+  Higher values are better for the player.
+*/
+
+class Evaluator
+{
+public:
+  explicit Evaluator(const EvalWeights& weights);
+
+  virtual double Evaluate(const BitBoard& board) const;
+  // Scores many boards in one call, which learned evaluators can do much faster
+  virtual void EvaluateBatch(const BitBoard* boards, GLint count, double* values) const;
+  double LineClearReward(GLint lines) const { return weights_.weights[kLinesCleared] * lines; }
+
+  static void Features(const BitBoard& board, double features[kNumEvalFeatures]);
+  const EvalWeights& Weights() const { return weights_; }
+
+  virtual ~Evaluator();
+private:
+  EvalWeights weights_;
+};
+
+
+#endif // EVALUATOR_H
@@ -0,0 +1,208 @@
+#include "expectimax.h"
+
+#include <algorithm>
+
+const GLint ExpectimaxSearch::kCacheBits_ = 18;
+const double ExpectimaxSearch::kGameOverValue_ = -1e6;
+
+ExpectimaxSearch::ExpectimaxSearch(const Evaluator& evaluator, const Randomizer& randomizer) : evaluator_(evaluator),
+											       randomizer_(randomizer),
+											       time_budget_(0.1),
+											       probability_cutoff_(0.01),
+											       max_depth_(4),
+											       stop_(nullptr),
+											       babort_(false),
+											       completed_depth_(0),
+											       nodes_(0),
+											       cache_hits_(0),
+											       cache_(1 << kCacheBits_),
+											       generation_(1)
+{
+  for (CacheEntry& entry : cache_)
+    entry.generation = 0;
+}
+
+void ExpectimaxSearch::ClearCache()
+{
+  ++generation_;
+}
+
+bool ExpectimaxSearch::Search(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold, Placement* best)
+{
+  deadline_ = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget_));
+  completed_depth_ = 0;
+  nodes_ = 0;
+  cache_hits_ = 0;
+  babort_ = false;
+  placements_.resize(max_depth_ + 1);
+  
+  std::vector<Placement> candidates;
+  GeneratePlacements(board, current, &candidates);
+  
+  // holding swaps in the held piece, or the next piece if nothing is held yet
+  std::vector<Placement> hold_candidates;
+  TetroType hold_piece = held != kNone ? held : next;
+  TetroType hold_next = held != kNone ? next : kNone;
+  if (can_hold && hold_piece != kNone && hold_piece != current)
+    {
+      GeneratePlacements(board, hold_piece, &hold_candidates);
+      for (Placement& placement : hold_candidates)
+	placement.hold = true;
+      candidates.insert(candidates.end(), hold_candidates.begin(), hold_candidates.end());
+    }
+  
+  if (candidates.empty())
+    return false;
+  *best = candidates.front();
+  
+  for (GLint depth = 1; depth <= max_depth_; ++depth)
+    {
+      double best_value = kGameOverValue_ * 2;
+      Placement best_placement = candidates.front();
+      for (const Placement& placement : candidates)
+	{
+	  double value = Child(board, placement, placement.hold ? hold_next : next, depth - 1, 1.0);
+	  if (babort_)
+	    break;
+	  if (value > best_value)
+	    {
+	      best_value = value;
+	      best_placement = placement;
+	    }
+	}
+      // a partially searched depth is not comparable with the finished one
+      if (babort_)
+	break;
+      *best = best_placement;
+      completed_depth_ = depth;
+      if (progress_)
+	progress_(best_placement, depth);
+    }
+  return true;
+}
+
+double ExpectimaxSearch::Child(const BitBoard& board, const Placement& placement, TetroType next, GLint depth, double probability)
+{
+  BitBoard child(board);
+  GLint lines = child.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+  double reward = evaluator_.LineClearReward(lines);
+  
+  if (depth == 0)
+    return reward + evaluator_.Evaluate(child);
+  if (next != kNone)
+    return reward + MaxNode(child, next, kNone, depth, probability);
+  return reward + ChanceNode(child, depth, probability);
+}
+
+double ExpectimaxSearch::MaxNode(const BitBoard& board, TetroType piece, TetroType next, GLint depth, double probability)
+{
+  if (OutOfTime())
+    return 0;
+
+  // the piece to place is part of the position, unlike at a chance node
+  uint64_t key = board.Hash() ^ ((static_cast<uint64_t>(piece) + 1) * 0x9e3779b97f4a7c15ULL);
+  double cached = 0;
+  if (next == kNone && Lookup(key, depth, &cached))
+    return cached;
+
+  std::vector<Placement>& placements = placements_[depth];
+  GeneratePlacements(board, piece, &placements);
+  if (placements.empty())
+    return kGameOverValue_;
+  
+  double best_value = kGameOverValue_;
+  // the children are all leaves, so score them in one batch
+  if (depth == 1)
+    {
+      const GLint count = placements.size();
+      leaf_boards_.assign(count, board);
+      leaf_rewards_.resize(count);
+      leaf_values_.resize(count);
+      for (GLint i = 0; i < count; ++i)
+	{
+	  const Placement& placement = placements[i];
+	  leaf_rewards_[i] = evaluator_.LineClearReward(leaf_boards_[i].Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col));
+	}
+      evaluator_.EvaluateBatch(leaf_boards_.data(), count, leaf_values_.data());
+      for (GLint i = 0; i < count; ++i)
+	best_value = std::max(best_value, leaf_rewards_[i] + leaf_values_[i]);
+      if (next == kNone)
+	Store(key, depth, best_value);
+      return best_value;
+    }
+
+  for (GLint i = 0; i < static_cast<GLint>(placements.size()); ++i)
+    {
+      double value = Child(board, placements[i], next, depth - 1, probability);
+      if (babort_)
+	return 0;
+      if (value > best_value)
+	best_value = value;
+    }
+  if (next == kNone)
+    Store(key, depth, best_value);
+  return best_value;
+}
+
+double ExpectimaxSearch::ChanceNode(const BitBoard& board, GLint depth, double probability)
+{
+  if (probability < probability_cutoff_)
+    return evaluator_.Evaluate(board);
+
+  uint64_t key = board.Hash();
+  double value = 0;
+  if (Lookup(key, depth, &value))
+    return value;
+
+  for (GLint type = kTetroI; type <= kTetroZ; ++type)
+    {
+      double p = randomizer_.Probability(static_cast<TetroType>(type));
+      if (p > 0)
+	value += p * MaxNode(board, static_cast<TetroType>(type), kNone, depth, probability * p);
+    }
+  if (babort_)
+    return 0;
+
+  Store(key, depth, value);
+  return value;
+}
+
+bool ExpectimaxSearch::Lookup(uint64_t key, GLint depth, double* value)
+{
+  // Entries outlive the search that made them, so the subtree under the
+  // placement that was played is already filled in when the next piece
+  // arrives. A value searched deeper is better than a fresh shallow one,
+  // even if it was pruned harder when it sat further from the root.
+  const CacheEntry& entry = cache_[key & ((1 << kCacheBits_) - 1)];
+  if (entry.generation != generation_ || entry.key != key || entry.depth < depth)
+    return false;
+  ++cache_hits_;
+  *value = entry.value;
+  return true;
+}
+
+void ExpectimaxSearch::Store(uint64_t key, GLint depth, double value)
+{
+  CacheEntry& entry = cache_[key & ((1 << kCacheBits_) - 1)];
+  // don't let a shallow result push out a deeper one for the same position
+  if (entry.generation == generation_ && entry.key == key && entry.depth > depth)
+    return;
+  entry.key = key;
+  entry.depth = depth;
+  entry.generation = generation_;
+  entry.value = value;
+}
+
+bool ExpectimaxSearch::OutOfTime()
+{
+  // always let the first depth finish so there is a move to play, unless told to stop
+  if (babort_ || ((++nodes_ & 255) == 0 &&
+		  ((stop_ && *stop_) || (completed_depth_ > 0 && std::chrono::steady_clock::now() > deadline_))))
+    babort_ = true;
+  return babort_;
+}
+
+ExpectimaxSearch::~ExpectimaxSearch()
+{
+  
+}
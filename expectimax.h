@@ -0,0 +1,93 @@
+#ifndef EXPECTIMAX_H
+#define EXPECTIMAX_H
+
+#include "bitboard.h"
+#include "evaluator.h"
+#include "randomizer.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/*
+  Expectimax search over placements.
+  Max nodes choose a placement for a known piece, chance nodes
+  average over the next unseen piece weighted by the randomizer.
+  Deepens one piece at a time until the time budget runs out,
+  leaving branches whose probability is below the cutoff unexpanded.
+  Node values are kept between searches, so consecutive pieces pick up
+  where the last search left off.
+*/
+
+class ExpectimaxSearch
+{
+public:
+  ExpectimaxSearch(const Evaluator& evaluator, const Randomizer& randomizer);
+
+  void SetTimeBudget(double seconds) { time_budget_ = seconds; }
+  void SetProbabilityCutoff(double cutoff) { probability_cutoff_ = cutoff; }
+  void SetMaxDepth(GLint depth) { max_depth_ = depth; }
+  // Searching stops as soon as the flag is set
+  void SetStopFlag(const std::atomic<bool>* stop) { stop_ = stop; }
+  // Called with the best placement each time a depth finishes
+  void SetProgressCallback(const std::function<void(const Placement&, GLint)>& callback) { progress_ = callback; }
+
+  // Returns false if the current piece has nowhere to go
+  bool Search(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold, Placement* best);
+
+  // Forget every cached value, needed if the evaluator's weights change
+  void ClearCache();
+
+  GLint CompletedDepth() const { return completed_depth_; }
+  GLuint NodesSearched() const { return nodes_; }
+  GLuint CacheHits() const { return cache_hits_; }
+
+  virtual ~ExpectimaxSearch();
+private:
+  struct CacheEntry
+  {
+    uint64_t key;
+    GLint depth;
+    GLuint generation;
+    double value;
+  };
+  
+  double MaxNode(const BitBoard& board, TetroType piece, TetroType next, GLint depth, double probability);
+  double ChanceNode(const BitBoard& board, GLint depth, double probability);
+  double Child(const BitBoard& board, const Placement& placement, TetroType next, GLint depth, double probability);
+  bool Lookup(uint64_t key, GLint depth, double* value);
+  void Store(uint64_t key, GLint depth, double value);
+  bool OutOfTime();
+
+  const Evaluator& evaluator_;
+  const Randomizer& randomizer_;
+  
+  double time_budget_;
+  double probability_cutoff_;
+  GLint max_depth_;
+  const std::atomic<bool>* stop_;
+  std::function<void(const Placement&, GLint)> progress_;
+
+  std::chrono::steady_clock::time_point deadline_;
+  bool babort_;
+  GLint completed_depth_;
+  GLuint nodes_;
+  GLuint cache_hits_;
+
+  std::vector<CacheEntry> cache_;
+  GLuint generation_;
+  // one placement list per ply so recursion doesn't reallocate
+  std::vector< std::vector<Placement> > placements_;
+  std::vector<BitBoard> leaf_boards_;
+  std::vector<double> leaf_rewards_;
+  std::vector<double> leaf_values_;
+
+  static const GLint kCacheBits_;
+  static const double kGameOverValue_;
+};
+
+
+#endif // EXPECTIMAX_H
@@ -0,0 +1,83 @@
+#include "bot_plugin.h"
+#include "evaluator.h"
+#include "expectimax.h"
+#include "nn_evaluator.h"
+#include "randomizer.h"
+
+#include <cstdlib>
+
+/*
+  The expectimax search packaged as a bot plugin, both as a bot for
+  tournaments and as an example of the plugin interface. Boards are
+  scored by the network file named in TETRIS_BOT_NETWORK when it is
+  set, and by the linear weights otherwise.
+*/
+
+namespace
+{
+  // leaves room for the last depth to be cut short and answered
+  const double kBudgetShare = 0.8;
+  const char kNetworkVariable[] = "TETRIS_BOT_NETWORK";
+
+  struct ExpectimaxBot
+  {
+    ExpectimaxBot() : evaluator(EvalWeights::Default()),
+		      search(evaluator, randomizer)
+    { }
+    
+    Randomizer randomizer;
+    NetworkEvaluator evaluator;
+    ExpectimaxSearch search;
+  };
+
+  void* Create()
+  {
+    ExpectimaxBot* bot = new ExpectimaxBot;
+    const char* network = std::getenv(kNetworkVariable);
+    if (network && *network && !bot->evaluator.Load(network))
+      {
+	delete bot;
+	return nullptr;
+      }
+    return bot;
+  }
+
+  void Destroy(void* bot)
+  {
+    delete static_cast<ExpectimaxBot*>(bot);
+  }
+
+  void Suggest(void* opaque, const TetrisBotState* state, const TetrisBotHost* host)
+  {
+    ExpectimaxBot* bot = static_cast<ExpectimaxBot*>(opaque);
+    if (state->queue_length < 1 || state->rows > BitBoard::kMaxRows || state->columns > BitBoard::kMaxCols)
+      return;
+    
+    BitBoard board(state->rows, state->columns);
+    for (int32_t row = 0; row < state->rows; ++row)
+      board.SetRow(row, state->board[row]);
+
+    // every finished depth is a better answer than the last
+    bot->search.SetTimeBudget(state->cpu_budget * kBudgetShare);
+    bot->search.SetProgressCallback([host](const Placement& best, GLint)
+				    {
+				      TetrisBotPlacement placement;
+				      placement.piece = best.type;
+				      placement.rotation = best.rotation;
+				      placement.hold = best.hold;
+				      placement.row = best.row;
+				      placement.column = best.col;
+				      host->answer(host->context, &placement);
+				    });
+    Placement best;
+    bot->search.Search(board, static_cast<TetroType>(state->queue[0]), state->queue_length > 1 ? static_cast<TetroType>(state->queue[1]) : kNone,
+		       static_cast<TetroType>(state->held), state->can_hold, &best);
+  }
+
+  const TetrisBotPlugin kPlugin = { TETRIS_BOT_ABI_VERSION, "expectimax", &Create, &Destroy, &Suggest };
+}
+
+extern "C" const TetrisBotPlugin* tetris_bot_plugin()
+{
+  return &kPlugin;
+}
@@ -0,0 +1,134 @@
+#include "game.h"
+#include "playfield.h"
+#include "state_feed.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  "watch" prints a running game's state feed. "bench" plays a
+  scripted game into a feed as fast as it can while another thread
+  reads it, timing the writer and checking that every frame the
+  reader got was one the writer actually published.
+*/
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+const char kPieceLetters[] = "IJLOSTZ";
+
+void Usage()
+{
+  std::cerr << "usage: feed watch [<name>]" << std::endl;
+  std::cerr << "       feed bench [<frames>]" << std::endl;
+}
+
+char Letter(int8_t piece)
+{
+  return piece >= 0 && piece < 7 ? kPieceLetters[piece] : '-';
+}
+
+uint64_t Hash(const StateFeedFrame& frame)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&frame);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(frame); ++i)
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  return hash;
+}
+
+int Watch(const std::string& name)
+{
+  StateFeedReader reader;
+  if (!reader.Open(name))
+    {
+      std::cerr << reader.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+  StateFeedFrame frame;
+  while (true)
+    {
+      if (reader.ReadLatest(&frame))
+	std::cout << "frame " << frame.number << ": score " << frame.score << ", lines " << frame.lines << ", level " << frame.level
+		  << ", falling " << Letter(frame.falling) << " at " << frame.row << "," << frame.col << ", next " << Letter(frame.next)
+		  << ", held " << Letter(frame.held) << (frame.bgame_over ? ", game over" : "") << std::endl;
+      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+}
+
+int Bench(uint64_t frames)
+{
+  const std::string name = "/tetris_feed_bench";
+  StateFeedWriter writer;
+  StateFeedReader reader;
+  if (!writer.Open(name) || !reader.Open(name))
+    {
+      std::cerr << writer.Error() << reader.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+  Game game(&playfield);
+  game.Seed(1);
+  game.Restart();
+  game.BeginPlay();
+
+  // what the writer put out, to check the reader's copies against afterwards
+  std::vector<uint64_t> published_hashes(frames);
+  std::vector< std::pair<uint64_t, uint64_t> > read_hashes;
+  std::atomic<bool> bdone(false);
+  std::thread reader_thread([&]
+			    {
+			      StateFeedFrame frame;
+			      while (!bdone)
+				if (reader.ReadLatest(&frame))
+				  read_hashes.push_back(std::make_pair(frame.number, Hash(frame)));
+			    });
+
+  StateFeedReader checker;
+  checker.Open(name);
+  StateFeedFrame frame;
+  double publish_seconds = 0;
+  for (uint64_t i = 0; i < frames; ++i)
+    {
+      if (game.IsGameOver())
+	{
+	  game.Restart();
+	  game.BeginPlay();
+	}
+      game.Press(i % 7 == 0 ? 1 << (i / 7 % 7) : 0);
+      game.Update();
+      
+      auto start = std::chrono::steady_clock::now();
+      writer.Publish(game, playfield);
+      publish_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      // nothing else writes this slot until the ring comes round, so reading it back here is safe
+      checker.Read(i, &frame);
+      published_hashes[i] = Hash(frame);
+    }
+  bdone = true;
+  reader_thread.join();
+
+  uint64_t mismatches = 0;
+  for (auto& read : read_hashes)
+    if (read.first >= frames || published_hashes[read.first] != read.second)
+      ++mismatches;
+  std::cout << frames << " frames, " << publish_seconds * 1e9 / frames << " ns to publish a frame, reader got "
+	    << read_hashes.size() << " frames with " << reader.Retries() << " retries, " << mismatches << " torn" << std::endl;
+  return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc >= 2 && std::string(argv[1]) == "watch")
+    return Watch(argc >= 3 ? argv[2] : "/tetris_state");
+  if (argc >= 2 && std::string(argv[1]) == "bench")
+    return Bench(argc >= 3 ? strtoull(argv[2], nullptr, 10) : 1000000);
+  Usage();
+  return EXIT_FAILURE;
+}
@@ -1,6 +1,7 @@
 #include "game.h"
 
-#include <ctime>
+#include <algorithm>
+#include <limits>
 
 const GLfloat Game::kPauseForLineClear_ = 30;
 const GLfloat Game::kLockFrameLimit_ = 30;
@@ -8,16 +9,20 @@ const GLint Game::kLockMovesLimit_ = 15;
 const GLint Game::kMaxLevels_ = 20;
 const GLfloat Game::kLineClearsPerLevel_ = 10;
 const GLfloat Game::kSoftDropMultiplier_ = 20;
-
-std::default_random_engine Game::rng_(time(0));
-std::uniform_int_distribution<int> Game::distribution_(0,6);
+// there's no grey tile, so garbage borrows one of the piece colours
+const TileColor Game::kGarbageColor_ = kBlue;
 
 Game::Game(PlayField* pf) : playfield_(pf),
-			    next_tetro_type_(GenTetroType()),
-			    held_tetro_type_(kNone),
-			    level_(1),
+			    input_queue_(nullptr),
+			    input_time_(std::numeric_limits<double>::infinity()),
 			    score_(0),
+			    level_(1),
 			    lines_(0),
+			    pieces_spawned_(0),
+			    pieces_locked_(0),
+			    next_tetro_type_(GenTetroType()),
+			    held_tetro_type_(kNone),
+			    bsoft_drop_held_(false),
 			    bgame_setup_(false)
 { }
 
@@ -25,6 +30,9 @@ void Game::Restart()
 {
   score_ = 0;
   lines_ = 0;
+  pieces_locked_ = 0;
+  garbage_.clear();
+  last_lock_ = LockResult();
 
   next_tetro_type_ = GenTetroType();
   held_tetro_type_ = kNone;
@@ -43,10 +51,17 @@ void Game::Restart()
   brotate_right_ = false;
   brotate_left_ = false;
   bcan_swap_held_tetro_ = true;
+  bsoft_drop_held_ = false;
+  blast_move_rotation_ = false;
 
   bgame_over_ = false;
   bgrounded_ = false;
   bpaused_for_line_clear_ = false;
+
+  // presses meant for the last game, like the hard drop that topped it out, mustn't reach this one
+  InputEvent event;
+  while (input_queue_ && input_queue_->Front(&event))
+    input_queue_->Pop();
   
   playfield_->Clear();
   bgame_setup_ = true;
@@ -60,15 +75,15 @@ void Game::BeginPlay()
 
 void Game::Update()
 {
+  if (input_queue_)
+    DrainInput();
+  
   if (bpaused_for_line_clear_)
     {
       ++line_clear_frame_counter_;
       if (line_clear_frame_counter_ < kPauseForLineClear_)
 	return;
-      UpdateScoreForLineClear(playfield_->NumLinesCleared());
-      playfield_->ClearLines();
-      SpawnTetro();
-      bpaused_for_line_clear_ = false;
+      FinishLineClear();
     }
 
   ++move_down_frame_counter_;
@@ -85,12 +100,14 @@ void Game::Update()
   // move horizontal
   if (bmove_left_)
     {
-      playfield_->MoveFallingTetroHorizontal(-1);
+      if (playfield_->MoveFallingTetroHorizontal(-1))
+	blast_move_rotation_ = false;
       bmove_left_ = false;
     }
   if (bmove_right_)
     {
-      playfield_->MoveFallingTetroHorizontal(1);
+      if (playfield_->MoveFallingTetroHorizontal(1))
+	blast_move_rotation_ = false;
       bmove_right_ = false;
     }
   
@@ -102,12 +119,14 @@ void Game::Update()
     }
   else if (brotate_right_)
     {
-      playfield_->RotateFallingTetro(kRight);
+      if (playfield_->RotateFallingTetro(kRight))
+	blast_move_rotation_ = true;
       brotate_right_ = false;
     }
   else if (brotate_left_)
     {
-      playfield_->RotateFallingTetro(kLeft);
+      if (playfield_->RotateFallingTetro(kLeft))
+	blast_move_rotation_ = true;
       brotate_left_ = false;
     }
 
@@ -117,8 +136,12 @@ void Game::Update()
       double softdrop_multiplier = bsoft_drop_ ? kSoftDropMultiplier_ : 1;
       if (move_down_frame_counter_ >= frames_per_row_ / softdrop_multiplier)
 	{
-	  if (playfield_->MoveFallingTetroVertical(-1) && bsoft_drop_)
-	    score_ += 1;
+	  if (playfield_->MoveFallingTetroVertical(-1))
+	    {
+	      blast_move_rotation_ = false;
+	      if (bsoft_drop_)
+		score_ += 1;
+	    }
 	  move_down_frame_counter_ = 0;
 	}
       CheckLock();
@@ -130,7 +153,8 @@ void Game::Update()
       // if we CAN move to desired position. we know we can.
       // maintaining uniformity by treating it like a soft drop.
       GLint rows_to_bottom = playfield_->FallingTetroRow() - playfield_->GhostRow();
-      playfield_->MoveFallingTetroVertical(-rows_to_bottom);
+      if (playfield_->MoveFallingTetroVertical(-rows_to_bottom))
+	blast_move_rotation_ = false;
       score_ += 2 * level_ * rows_to_bottom;
       Lock();
     }
@@ -139,6 +163,125 @@ void Game::Update()
   bsoft_drop_ = false;
 }
 
+GLint Game::FramesUntilEvent() const
+{
+  if (bpaused_for_line_clear_)
+    return kPauseForLineClear_ - line_clear_frame_counter_;
+  // after a move the grounded flag is only brought up to date by the next Update
+  bool grounded = playfield_->IsGrounded();
+  if (bgame_over_ || playfield_->FallingTetroType() == kNone || grounded != bgrounded_ || moves_before_lock_ >= kLockMovesLimit_)
+    return 1;
+  
+  if (grounded)
+    return std::max<GLint>(1, kLockFrameLimit_ - lock_frame_counter_);
+  return std::max(1, frames_per_row_ - move_down_frame_counter_);
+}
+
+void Game::SkipFrames(GLint frames)
+{
+  if (frames <= 0)
+    return;
+  if (bpaused_for_line_clear_)
+    {
+      line_clear_frame_counter_ += frames;
+      return;
+    }
+
+  if (bgrounded_)
+    {
+      lock_frame_counter_ += frames;
+      // gravity keeps trying to move a grounded piece and starts over each time it fails
+      if (move_down_frame_counter_ >= frames_per_row_)
+	{
+	  move_down_frame_counter_ = 0;
+	  --frames;
+	}
+      move_down_frame_counter_ = (move_down_frame_counter_ + frames) % frames_per_row_;
+    }
+  else
+    {
+      lock_frame_counter_ = 0;
+      move_down_frame_counter_ += frames;
+    }
+}
+
+/*
+  Takes queued events up to the input time, one frame's worth at a
+  time. A press that would undo or be hidden by one already taken this
+  frame, such as a second move left or a move after a hard drop, is
+  left for the next frame instead, so quick taps are never merged.
+*/
+void Game::DrainInput()
+{
+  const GLuint kHorizontal = kInputLeft | kInputRight;
+  const GLuint kRotation = kInputRotateRight | kInputRotateLeft;
+  // presses held over through a line clear pause count as this frame's
+  GLuint pressed = PendingInputs();
+  InputEvent event;
+  while (input_queue_->Front(&event) && event.time <= input_time_)
+    {
+      if (event.input == kInputSoftDrop)
+	{
+	  bsoft_drop_held_ = event.bpressed;
+	}
+      else if (event.bpressed)
+	{
+	  GLuint group = event.input & kHorizontal ? kHorizontal : event.input & kRotation ? kRotation : event.input;
+	  // hold swaps the piece straight away, so it mustn't jump ahead of moves meant for the old one
+	  if (pressed & (group | kInputHardDrop) || (event.input == kInputHold && pressed))
+	    break;
+	  Press(event.input);
+	  pressed |= event.input;
+	}
+      input_queue_->Pop();
+    }
+  if (bsoft_drop_held_)
+    bsoft_drop_ = true;
+}
+
+void Game::FinishLineClear()
+{
+  UpdateScoreForLineClear(playfield_->NumLinesCleared());
+  playfield_->ClearLines();
+  SpawnTetro();
+  bpaused_for_line_clear_ = false;
+}
+
+bool Game::Place(const Placement& placement)
+{
+  if (bgame_over_ || bpaused_for_line_clear_ || (placement.hold && !bcan_swap_held_tetro_))
+    return false;
+
+  // only what the generator offers, so nothing gets locked in mid air or behind an overhang
+  TetroType type = !placement.hold ? playfield_->FallingTetroType() : held_tetro_type_ != kNone ? held_tetro_type_ : next_tetro_type_;
+  if (placement.type != type)
+    return false;
+  GeneratePlacements(BitBoard::FromPlayField(*playfield_), type, &placements_);
+  auto found = std::find_if(placements_.begin(), placements_.end(), [&placement](const Placement& legal)
+			    {
+			      return legal.rotation == placement.rotation && legal.row == placement.row && legal.col == placement.col;
+			    });
+  if (found == placements_.end())
+    return false;
+
+  if (placement.hold)
+    Hold();
+  GLint spawn_row = playfield_->FallingTetroRow();
+  playfield_->PlaceFallingTetro(placement.rotation, placement.row, placement.col);
+  
+  // scored as a hard drop from where the piece spawned
+  if (spawn_row > placement.row)
+    score_ += 2 * level_ * (spawn_row - placement.row);
+  move_down_frame_counter_ = 0;
+  bhard_drop_ = false;
+  bsoft_drop_ = false;
+  blast_move_rotation_ = false;
+  Lock();
+  if (bpaused_for_line_clear_ && !bgame_over_)
+    FinishLineClear();
+  return true;
+}
+
 void Game::UpdateScoreForLineClear(GLuint lines)
 {
   // http://tetris.wikia.com/wiki/Scoring
@@ -168,28 +311,98 @@ void Game::UpdateScoreForLineClear(GLuint lines)
     }
 }
 
+void Game::QueueGarbage(GLint lines, GLint hole)
+{
+  if (lines <= 0)
+    return;
+  GarbageBatch batch = { lines, hole };
+  garbage_.push_back(batch);
+}
+
+GLint Game::CancelGarbage(GLint lines)
+{
+  size_t cancelled = 0;
+  for ( ; cancelled < garbage_.size() && lines > 0; ++cancelled)
+    {
+      GLint taken = std::min(lines, garbage_[cancelled].lines);
+      lines -= taken;
+      garbage_[cancelled].lines -= taken;
+      if (garbage_[cancelled].lines > 0)
+	break;
+    }
+  garbage_.erase(garbage_.begin(), garbage_.begin() + cancelled);
+  return lines;
+}
+
+GLint Game::PendingGarbage() const
+{
+  GLint lines = 0;
+  for (const GarbageBatch& batch : garbage_)
+    lines += batch.lines;
+  return lines;
+}
+
+void Game::RaiseGarbage()
+{
+  for (const GarbageBatch& batch : garbage_)
+    {
+      if (!playfield_->InsertGarbage(batch.lines, batch.hole, kGarbageColor_))
+	{
+	  GameOver();
+	  break;
+	}
+    }
+  garbage_.clear();
+}
+
 void Game::Hold()
 {
   if (bcan_swap_held_tetro_ && !bpaused_for_line_clear_)
     {
       TetroType falling = playfield_->FallingTetro().Type();
+      bool spawned;
       if (held_tetro_type_ == kNone)
 	{
-	  playfield_->SpawnTetro(GenTetroType());
+	  // an empty hold brings on the next piece, as in the guideline, so nothing unseen comes out
+	  spawned = playfield_->SpawnTetro(next_tetro_type_);
+	  next_tetro_type_ = GenTetroType();
 	}
       else
 	{
-	  playfield_->SpawnTetro(held_tetro_type_);
+	  spawned = playfield_->SpawnTetro(held_tetro_type_);
 	}
+      if (!spawned)
+	GameOver();
+      ++pieces_spawned_;
+      blast_move_rotation_ = false;
       held_tetro_type_ = falling;
       bcan_swap_held_tetro_ = false;
     }
 }
 
+void Game::Press(GLuint inputs)
+{
+  if (inputs & kInputLeft)
+    MoveLeft();
+  if (inputs & kInputRight)
+    MoveRight();
+  if (inputs & kInputRotateRight)
+    RotateRight();
+  if (inputs & kInputRotateLeft)
+    RotateLeft();
+  if (inputs & kInputSoftDrop)
+    SoftDrop();
+  if (inputs & kInputHardDrop)
+    HardDrop();
+  if (inputs & kInputHold)
+    Hold();
+}
+
 void Game::SpawnTetro()
 {
   if (!playfield_->SpawnTetro(next_tetro_type_))
     GameOver();
+  ++pieces_spawned_;
 
   next_tetro_type_ = GenTetroType();
 
@@ -201,9 +414,24 @@ bool Game::IsGrounded()
   return playfield_->IsGrounded();
 }
 
+bool Game::IsTSpin() const
+{
+  if (playfield_->FallingTetroType() != kTetroT || !blast_move_rotation_)
+    return false;
+  // three of the four corners around the T's centre taken, walls and floor included
+  GLint row = playfield_->FallingTetroRow();
+  GLint col = playfield_->FallingTetroCol();
+  GLint corners = 0;
+  for (GLint delta_row = 0; delta_row <= 2; delta_row += 2)
+    for (GLint delta_col = 0; delta_col <= 2; delta_col += 2)
+      if (!playfield_->IsTileOpen(row - delta_row, col + delta_col))
+	++corners;
+  return corners >= 3;
+}
+
 TetroType Game::GenTetroType()
 {
-  return static_cast<TetroType>(distribution_(rng_));
+  return randomizer_.Next();
 }
 
 Game::~Game()
@@ -229,14 +457,19 @@ void Game::CheckLock()
 
 void Game::Lock()
 {
+  last_lock_.lock_frames = lock_frame_counter_;
   lock_frame_counter_ = 0;
   bgrounded_ = false;
   bcan_swap_held_tetro_ = true;
+  last_lock_.btspin = IsTSpin();
+  blast_move_rotation_ = false;
     
     if (!playfield_->LockFallingTetro()) {
       GameOver();
       return;
     }
+    ++pieces_locked_;
+    last_lock_.lines = playfield_->NumLinesCleared();
     
     if (playfield_->NumLinesCleared() > 0)
       {
@@ -245,7 +478,9 @@ void Game::Lock()
       }
     else
       {
-	SpawnTetro();
+	RaiseGarbage();
+	if (!bgame_over_)
+	  SpawnTetro();
       }
   
 }
@@ -276,6 +511,74 @@ GLint Game::FramesPerRowForLevel(GLint level)
   return -1;
 }
 
+GLuint Game::PendingInputs() const
+{
+  return (bmove_left_ ? kInputLeft : 0) | (bmove_right_ ? kInputRight : 0) |
+    (brotate_right_ ? kInputRotateRight : 0) | (brotate_left_ ? kInputRotateLeft : 0) |
+    (bsoft_drop_ ? kInputSoftDrop : 0) | (bhard_drop_ ? kInputHardDrop : 0);
+}
+
+void Game::Save(GameSnapshot* snapshot) const
+{
+  playfield_->Save(&snapshot->playfield);
+  snapshot->randomizer = randomizer_;
+  snapshot->score = score_;
+  snapshot->level = level_;
+  snapshot->lines = lines_;
+  snapshot->pieces_spawned = pieces_spawned_;
+  snapshot->pieces_locked = pieces_locked_;
+  snapshot->garbage = garbage_;
+  snapshot->last_lock = last_lock_;
+  snapshot->next = next_tetro_type_;
+  snapshot->held = held_tetro_type_;
+  snapshot->moves_before_lock = moves_before_lock_;
+  snapshot->lock_frame_counter = lock_frame_counter_;
+  snapshot->frames_per_row = frames_per_row_;
+  snapshot->move_down_frame_counter = move_down_frame_counter_;
+  snapshot->line_clear_frame_counter = line_clear_frame_counter_;
+  snapshot->inputs = PendingInputs();
+  snapshot->bsoft_drop_held = bsoft_drop_held_;
+  snapshot->blast_move_rotation = blast_move_rotation_;
+  snapshot->bcan_swap_held_tetro = bcan_swap_held_tetro_;
+  snapshot->bgame_setup = bgame_setup_;
+  snapshot->bgame_over = bgame_over_;
+  snapshot->bgrounded = bgrounded_;
+  snapshot->bpaused_for_line_clear = bpaused_for_line_clear_;
+}
+
+void Game::Restore(const GameSnapshot& snapshot)
+{
+  playfield_->Restore(snapshot.playfield);
+  randomizer_ = snapshot.randomizer;
+  score_ = snapshot.score;
+  level_ = snapshot.level;
+  lines_ = snapshot.lines;
+  pieces_spawned_ = snapshot.pieces_spawned;
+  pieces_locked_ = snapshot.pieces_locked;
+  garbage_ = snapshot.garbage;
+  last_lock_ = snapshot.last_lock;
+  next_tetro_type_ = snapshot.next;
+  held_tetro_type_ = snapshot.held;
+  moves_before_lock_ = snapshot.moves_before_lock;
+  lock_frame_counter_ = snapshot.lock_frame_counter;
+  frames_per_row_ = snapshot.frames_per_row;
+  move_down_frame_counter_ = snapshot.move_down_frame_counter;
+  line_clear_frame_counter_ = snapshot.line_clear_frame_counter;
+  bmove_left_ = snapshot.inputs & kInputLeft;
+  bmove_right_ = snapshot.inputs & kInputRight;
+  brotate_right_ = snapshot.inputs & kInputRotateRight;
+  brotate_left_ = snapshot.inputs & kInputRotateLeft;
+  bsoft_drop_ = snapshot.inputs & kInputSoftDrop;
+  bhard_drop_ = snapshot.inputs & kInputHardDrop;
+  bsoft_drop_held_ = snapshot.bsoft_drop_held;
+  blast_move_rotation_ = snapshot.blast_move_rotation;
+  bcan_swap_held_tetro_ = snapshot.bcan_swap_held_tetro;
+  bgame_setup_ = snapshot.bgame_setup;
+  bgame_over_ = snapshot.bgame_over;
+  bgrounded_ = snapshot.bgrounded;
+  bpaused_for_line_clear_ = snapshot.bpaused_for_line_clear;
+}
+
 void Game::GameOver()
 {
   bgame_over_ = true;
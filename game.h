@@ -1,10 +1,65 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include "bitboard.h"
+#include "input_queue.h"
 #include "playfield.h"
+#include "randomizer.h"
 
 #include <GL/glew.h>
-#include <random>
+#include <vector>
+
+// Inputs pressed during one frame, as a bitmask
+enum GameInput
+  {
+    kInputLeft = 1 << 0,
+    kInputRight = 1 << 1,
+    kInputRotateRight = 1 << 2,
+    kInputRotateLeft = 1 << 3,
+    kInputSoftDrop = 1 << 4,
+    kInputHardDrop = 1 << 5,
+    kInputHold = 1 << 6
+  };
+
+// Garbage lines sent in one attack, which all share a hole
+struct GarbageBatch
+{
+  GLint lines;
+  GLint hole;
+};
+
+// What the last piece to lock did, for versus rules to score
+struct LockResult
+{
+  GLint lines;
+  // frames it sat on the stack before locking
+  GLint lock_frames;
+  bool btspin;
+};
+
+struct GameSnapshot
+{
+  PlayFieldSnapshot playfield;
+  Randomizer randomizer;
+  GLuint score, level, lines, pieces_spawned, pieces_locked;
+  TetroType next, held;
+  std::vector<GarbageBatch> garbage;
+  LockResult last_lock;
+  GLint moves_before_lock;
+  GLint lock_frame_counter;
+  GLint frames_per_row;
+  GLint move_down_frame_counter;
+  GLint line_clear_frame_counter;
+  // the pending input flags, which a line clear pause holds on to
+  GLuint inputs;
+  bool bsoft_drop_held;
+  bool blast_move_rotation;
+  bool bcan_swap_held_tetro;
+  bool bgame_setup;
+  bool bgame_over;
+  bool bgrounded;
+  bool bpaused_for_line_clear;
+};
 
 class Game
 {
@@ -13,6 +68,8 @@ public:
 
   void Restart();
   void BeginPlay();
+  // Makes the piece sequence repeatable, takes effect from the next Restart
+  void Seed(unsigned int seed) { randomizer_.Seed(seed); }
   bool IsGameSetup() { return bgame_setup_; }
   
   GLuint Score() const { return score_; }
@@ -21,6 +78,12 @@ public:
   
   TetroType Next() const { return next_tetro_type_; }
   TetroType Held() const { return held_tetro_type_; }
+  bool CanHold() const { return bcan_swap_held_tetro_; }
+  const Randomizer& GetRandomizer() const { return randomizer_; }
+  // Counts every piece put into play, including swaps from hold
+  GLuint PiecesSpawned() const { return pieces_spawned_; }
+  GLuint PiecesLocked() const { return pieces_locked_; }
+  const LockResult& LastLock() const { return last_lock_; }
   
   float LockTimerPercent() const { return lock_frame_counter_ / kLockFrameLimit_; }
   bool IsPausedForLineClear() const { return bpaused_for_line_clear_; }
@@ -28,6 +91,10 @@ public:
   
   void Update();
   bool IsGameOver() const { return bgame_over_; }
+  // Updates with no input until one of them moves, locks or spawns a piece, counting that one
+  GLint FramesUntilEvent() const;
+  // Same as that many Updates with no input, for fewer frames than FramesUntilEvent
+  void SkipFrames(GLint frames);
   
   void MoveLeft() { bmove_left_ = true; }
   void MoveRight() { bmove_right_ = true; }
@@ -36,21 +103,44 @@ public:
   void SoftDrop() { bsoft_drop_ = true; }
   void HardDrop() { bhard_drop_ = true; }
   void Hold();
+  // Presses every GameInput in the mask
+  void Press(GLuint inputs);
+  // Events in the queue are taken at the start of each Update; Restart drops any left over
+  void SetInputQueue(InputQueue* queue) { input_queue_ = queue; }
+  // The time the next Update stands for; queued events stamped after it wait for a later one
+  void SetInputTime(double time) { input_time_ = time; }
+  // Garbage rises into the stack the next time a piece locks without clearing lines
+  void QueueGarbage(GLint lines, GLint hole);
+  // Takes up to that many lines off the oldest garbage and returns how many were left over
+  GLint CancelGarbage(GLint lines);
+  GLint PendingGarbage() const;
+  // Plays a whole piece in one call, skipping gravity and the lock and line clear timers.
+  // Returns false, changing nothing, unless the placement is one GeneratePlacements offers.
+  bool Place(const Placement& placement);
 
   void LevelUp() { level_ = level_ < 30 ? level_ + 1 : level_; }
   void LevelDown() { level_ = level_ > 1 ? level_ - 1 : level_; }
+  void SetLevel(GLuint level) { level_ = level < 1 ? 1 : level > 30 ? 30 : level; }
 
   void GameOver();
-  
+
+  // Saves the game and its playfield, for going back to this frame later
+  void Save(GameSnapshot* snapshot) const;
+  void Restore(const GameSnapshot& snapshot);
   
   virtual ~Game();
 private:  
   void UpdateScoreForLineClear(GLuint lines);
+  void FinishLineClear();
+  void DrainInput();
+  GLuint PendingInputs() const;
   
   void SpawnTetro();
   TetroType GenTetroType();
   
   bool IsGrounded();
+  bool IsTSpin() const;
+  void RaiseGarbage();
   
   void CheckLock();
   void Lock();
@@ -58,13 +148,23 @@ private:
   GLint FramesPerRowForLevel(GLint level);
 
   PlayField* playfield_;
+  Randomizer randomizer_;
+  InputQueue* input_queue_;
+  double input_time_;
   
   GLuint score_;
   GLuint level_;
   GLuint lines_;
+  GLuint pieces_spawned_;
+  GLuint pieces_locked_;
   
   TetroType next_tetro_type_;
   TetroType held_tetro_type_;
+
+  std::vector<GarbageBatch> garbage_;
+  LockResult last_lock_;
+  // scratch for checking Place against the move generator
+  std::vector<Placement> placements_;
   
   GLint moves_before_lock_;
   GLint lock_frame_counter_;
@@ -84,6 +184,10 @@ private:
   bool brotate_right_;
   bool brotate_left_;
   bool bcan_swap_held_tetro_;
+  // soft drop from the queue lasts from press to release
+  bool bsoft_drop_held_;
+  // a T that rotated into place rather than moving there can score a spin
+  bool blast_move_rotation_;
 
   bool bgame_setup_;
   bool bgame_over_;
@@ -91,9 +195,6 @@ private:
   bool bgrounded_;
   bool bpaused_for_line_clear_;
 
-  static std::default_random_engine rng_;
-  static std::uniform_int_distribution<int> distribution_;
-  
   static const GLfloat kPauseForLineClear_;
   
   static const GLfloat kLockFrameLimit_;
@@ -104,6 +205,8 @@ private:
   static const GLfloat kLineClearsPerLevel_;
   
   static const GLfloat kSoftDropMultiplier_;
+
+  static const TileColor kGarbageColor_;
 };
 
 
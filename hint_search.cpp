@@ -0,0 +1,108 @@
+#include "hint_search.h"
+
+// Long enough to reach full depth, the next piece cuts it short anyway
+const double HintSearch::kTimeBudget_ = 2.0;
+
+HintSearch::HintSearch(const EvalWeights& weights, const Randomizer& randomizer) : evaluator_(weights),
+										   search_(evaluator_, randomizer),
+										   current_(kNone),
+										   next_(kNone),
+										   held_(kNone),
+										   bcan_hold_(false),
+										   requested_position_(0),
+										   bquit_(false),
+										   bstop_search_(false),
+										   latest_position_(0),
+										   best_(0)
+{
+  search_.SetTimeBudget(kTimeBudget_);
+  search_.SetStopFlag(&bstop_search_);
+  thread_ = std::thread(&HintSearch::Run, this);
+}
+
+void HintSearch::Start(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    board_ = board;
+    current_ = current;
+    next_ = next;
+    held_ = held;
+    bcan_hold_ = can_hold;
+    ++requested_position_;
+    latest_position_ = requested_position_;
+    bstop_search_ = true;
+  }
+  request_ready_.notify_one();
+}
+
+// The word holds the position number in the low 32 bits and the placement above it
+bool HintSearch::Best(Placement* placement) const
+{
+  uint64_t best = best_;
+  if (!(best >> 63) || static_cast<GLuint>(best) != latest_position_)
+    return false;
+
+  placement->type = static_cast<TetroType>((best >> 32) & 0x7);
+  placement->rotation = static_cast<RotationState>((best >> 35) & 0x3);
+  placement->row = static_cast<GLint>((best >> 37) & 0xff);
+  placement->col = static_cast<GLint>((best >> 45) & 0xff) - BitBoard::kMaxCols;
+  placement->hold = (best >> 53) & 1;
+  return true;
+}
+
+void HintSearch::Publish(const Placement& placement, GLuint position)
+{
+  uint64_t packed = static_cast<uint64_t>(position) |
+    static_cast<uint64_t>(placement.type) << 32 |
+    static_cast<uint64_t>(placement.rotation) << 35 |
+    static_cast<uint64_t>(placement.row & 0xff) << 37 |
+    static_cast<uint64_t>((placement.col + BitBoard::kMaxCols) & 0xff) << 45 |
+    static_cast<uint64_t>(placement.hold) << 53 |
+    1ULL << 63;
+  best_ = packed;
+}
+
+void HintSearch::Run()
+{
+  GLuint searched_position = 0;
+  while (true)
+    {
+      BitBoard board;
+      TetroType current, next, held;
+      bool can_hold;
+      GLuint position;
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	request_ready_.wait(lock, [&] { return bquit_ || requested_position_ != searched_position; });
+	if (bquit_)
+	  return;
+	board = board_;
+	current = current_;
+	next = next_;
+	held = held_;
+	can_hold = bcan_hold_;
+	position = searched_position = requested_position_;
+	bstop_search_ = false;
+      }
+
+      search_.SetProgressCallback([this, position](const Placement& placement, GLint)
+				  {
+				    if (!bstop_search_)
+				      Publish(placement, position);
+				  });
+      Placement best;
+      search_.Search(board, current, next, held, can_hold, &best);
+    }
+}
+
+HintSearch::~HintSearch()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bquit_ = true;
+    bstop_search_ = true;
+  }
+  request_ready_.notify_one();
+  thread_.join();
+}
@@ -0,0 +1,61 @@
+#ifndef HINT_SEARCH_H
+#define HINT_SEARCH_H
+
+#include "bitboard.h"
+#include "evaluator.h"
+#include "expectimax.h"
+#include "randomizer.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+/*
+  Runs an expectimax search on its own thread for the placement hint.
+  The render loop hands over each new piece with Start and reads the
+  best placement found so far with Best. Neither call waits on the
+  search; results are published through a single atomic word.
+*/
+
+class HintSearch
+{
+public:
+  HintSearch(const EvalWeights& weights, const Randomizer& randomizer);
+
+  // Drops whatever is being searched and starts on the new position
+  void Start(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold);
+  // False until the first depth for the latest position is done
+  bool Best(Placement* placement) const;
+
+  virtual ~HintSearch();
+private:
+  HintSearch(const HintSearch&);
+  void operator=(const HintSearch&);
+
+  void Run();
+  void Publish(const Placement& placement, GLuint position);
+
+  Evaluator evaluator_;
+  ExpectimaxSearch search_;
+
+  std::mutex mutex_;
+  std::condition_variable request_ready_;
+  BitBoard board_;
+  TetroType current_, next_, held_;
+  bool bcan_hold_;
+  GLuint requested_position_;
+  bool bquit_;
+
+  std::atomic<bool> bstop_search_;
+  std::atomic<GLuint> latest_position_;
+  std::atomic<uint64_t> best_;
+  std::thread thread_;
+
+  static const double kTimeBudget_;
+};
+
+
+#endif // HINT_SEARCH_H
@@ -0,0 +1,70 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+  Bounded queue between exactly one producer thread and one consumer
+  thread. Each side only writes its own index, so neither ever takes
+  a lock or waits on the other; a full queue just refuses the push.
+  The capacity must be a power of two.
+*/
+
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+  SpscQueue() : head_(0), tail_(0) { }
+
+  // Producer side
+  bool Push(const T& item)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == N)
+      return false;
+    items_[tail & (N - 1)] = item;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side: looks at the oldest item without taking it
+  bool Front(T* item) const
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+      return false;
+    *item = items_[head & (N - 1)];
+    return true;
+  }
+  
+  void Pop()
+  {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  
+private:
+  static_assert((N & (N - 1)) == 0, "SpscQueue capacity must be a power of two");
+  
+  // on separate cache lines so the two threads don't keep stealing each other's
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+  alignas(64) T items_[N];
+};
+
+// One key going down or up
+struct InputEvent
+{
+  // seconds, on whatever clock the game loop passes to Game::SetInputTime
+  double time;
+  // a GameInput
+  GLuint input;
+  bool bpressed;
+};
+
+typedef SpscQueue<InputEvent, 256> InputQueue;
+
+
+#endif // INPUT_QUEUE_H
@@ -0,0 +1,602 @@
+#include "leaderboard.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t Leaderboard::kMagic_ = 0x4c425431; // "LBT1"
+const uint32_t Leaderboard::kSnapshotMagic_ = 0x4c425331; // "LBS1"
+const GLint Leaderboard::kBatchMs_ = 5;
+const GLint Leaderboard::kRetryMs_ = 1000;
+const uint64_t Leaderboard::kSnapshotRecords_ = 1 << 16;
+
+namespace
+{
+  // values below this each get a bucket of their own
+  const uint32_t kExactValues = 1 << 12;
+  // and above it, each power of two is cut into 1 << kSubBucketBits
+  const GLint kSubBucketBits = 11;
+  const size_t kNumBuckets = kExactValues + (32 - 12) * (1 << kSubBucketBits);
+  const size_t kTopEntries = 100;
+}
+
+struct LeaderboardRecord
+{
+  uint32_t magic;
+  uint32_t checksum;
+  uint64_t sequence;
+  LeaderboardEntry entry;
+};
+
+struct LeaderboardTop
+{
+  uint64_t count;
+  LeaderboardEntry entries[kTopEntries];
+};
+
+// Laid out at the start of the snapshot, before a LeaderboardTop and
+// then nbuckets Fenwick cells for each board
+struct LeaderboardSnapshot
+{
+  uint32_t magic;
+  uint32_t checksum;
+  // games in the snapshot; the log goes on from here
+  uint64_t sequence;
+  uint64_t nbuckets;
+  uint64_t ntop;
+  uint64_t totals[kNumBoards];
+};
+
+namespace
+{
+  uint32_t Fnv1a(const void* data, size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+      {
+	hash ^= bytes[i];
+	hash *= 16777619u;
+      }
+    return hash;
+  }
+
+  // Over everything after the checksum
+  uint32_t Checksum(const LeaderboardRecord& record)
+  {
+    return Fnv1a(&record.sequence, sizeof(record) - offsetof(LeaderboardRecord, sequence));
+  }
+
+  size_t SnapshotSize()
+  {
+    return sizeof(LeaderboardSnapshot) + kNumBoards * (sizeof(LeaderboardTop) + kNumBuckets * sizeof(uint64_t));
+  }
+
+  uint32_t Checksum(const LeaderboardSnapshot* snapshot)
+  {
+    return Fnv1a(&snapshot->sequence, SnapshotSize() - offsetof(LeaderboardSnapshot, sequence));
+  }
+
+  // Where a value sorts on a board, or false if the game has no place there
+  bool BoardKey(LeaderboardKind board, uint32_t value, uint64_t* key)
+  {
+    if (board == kBoardSprint)
+      {
+	*key = value;
+	return value > 0;
+      }
+    *key = std::numeric_limits<uint32_t>::max() - value;
+    return true;
+  }
+
+  uint32_t BoardValue(LeaderboardKind board, const LeaderboardEntry& entry)
+  {
+    return board == kBoardScore ? entry.score : board == kBoardLines ? entry.lines : entry.sprint_ms;
+  }
+
+  size_t ValueBucket(uint32_t value)
+  {
+    if (value < kExactValues)
+      return value;
+    GLint top = 31 - __builtin_clz(value);
+    return kExactValues + (top - 12) * (1 << kSubBucketBits)
+      + ((value >> (top - kSubBucketBits)) & ((1 << kSubBucketBits) - 1));
+  }
+
+  // The bucket a value counts in, the best first
+  size_t BoardBucket(LeaderboardKind board, uint32_t value)
+  {
+    return board == kBoardSprint ? ValueBucket(value) : kNumBuckets - 1 - ValueBucket(value);
+  }
+
+  std::string Directory(const std::string& path)
+  {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos)
+      return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+  }
+}
+
+Leaderboard::Leaderboard() : fd_(-1),
+			     next_sequence_(0),
+			     log_size_(0),
+			     snapshot_sequence_(0),
+			     epoch_(0),
+			     submitted_(0),
+			     written_(0),
+			     flush_target_(0),
+			     failed_writes_(0),
+			     btorn_(false),
+			     bstop_(false)
+{
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      std::vector< std::atomic<uint64_t> >(kNumBuckets).swap(counts_[board]);
+      totals_[board] = 0;
+      building_[board] = new LeaderboardTop();
+      tops_[board] = new LeaderboardTop();
+      bchanged_[board] = false;
+    }
+  readers_[0] = 0;
+  readers_[1] = 0;
+}
+
+bool Leaderboard::Open(const std::string& path)
+{
+  Close();
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd_ < 0)
+    {
+      error_ = path + ": " + strerror(errno);
+      return false;
+    }
+  path_ = path;
+  if (!Replay())
+    {
+      Close();
+      return false;
+    }
+  bstop_ = false;
+  writer_ = std::thread(&Leaderboard::WriterLoop, this);
+  return true;
+}
+
+bool Leaderboard::LoadSnapshot()
+{
+  std::string path = path_ + ".snapshot";
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    {
+      if (errno == ENOENT)
+	return true;
+      error_ = path + ": " + strerror(errno);
+      return false;
+    }
+  struct stat status;
+  if (fstat(fd, &status) != 0)
+    {
+      error_ = path + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+  if (static_cast<size_t>(status.st_size) != SnapshotSize())
+    {
+      error_ = path + ": not a snapshot of these boards";
+      close(fd);
+      return false;
+    }
+  void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+    {
+      error_ = path + ": " + strerror(errno);
+      return false;
+    }
+  const LeaderboardSnapshot* snapshot = static_cast<const LeaderboardSnapshot*>(memory);
+  // it's only ever renamed into place whole, so a bad one is not from a crash
+  bool bvalid = snapshot->magic == kSnapshotMagic_ && snapshot->nbuckets == kNumBuckets
+    && snapshot->ntop == kTopEntries && snapshot->checksum == Checksum(snapshot);
+  if (bvalid)
+    {
+      const LeaderboardTop* tops = reinterpret_cast<const LeaderboardTop*>(snapshot + 1);
+      const uint64_t* cells = reinterpret_cast<const uint64_t*>(tops + kNumBoards);
+      for (GLint board = 0; board < kNumBoards; ++board)
+	{
+	  totals_[board] = snapshot->totals[board];
+	  *building_[board] = tops[board];
+	  bchanged_[board] = true;
+	  for (size_t i = 0; i < kNumBuckets; ++i)
+	    counts_[board][i].store(cells[board * kNumBuckets + i], std::memory_order_relaxed);
+	}
+      next_sequence_ = snapshot_sequence_ = snapshot->sequence;
+    }
+  else
+    {
+      error_ = path + ": damaged snapshot";
+    }
+  munmap(memory, status.st_size);
+  return bvalid;
+}
+
+bool Leaderboard::Replay()
+{
+  if (!LoadSnapshot())
+    return false;
+  struct stat status;
+  if (fstat(fd_, &status) != 0)
+    {
+      error_ = path_ + ": " + strerror(errno);
+      return false;
+    }
+  size_t nrecords = status.st_size / sizeof(LeaderboardRecord);
+  size_t valid = 0;
+  bool bnewer = false;
+  if (nrecords > 0)
+    {
+      void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (memory == MAP_FAILED)
+	{
+	  error_ = path_ + ": " + strerror(errno);
+	  return false;
+	}
+      madvise(memory, status.st_size, MADV_SEQUENTIAL);
+      const LeaderboardRecord* records = static_cast<const LeaderboardRecord*>(memory);
+      // the log is emptied after each snapshot, but a crash can come first
+      // and leave games the snapshot already has
+      uint64_t first = records[0].sequence;
+      if (records[0].magic == kMagic_ && records[0].checksum == Checksum(records[0]) && first > next_sequence_)
+	{
+	  error_ = path_ + ": the log starts after the snapshot";
+	  munmap(memory, status.st_size);
+	  return false;
+	}
+      for ( ; valid < nrecords; ++valid)
+	{
+	  const LeaderboardRecord& record = records[valid];
+	  if (record.magic != kMagic_ || record.checksum != Checksum(record) || record.sequence != first + valid)
+	    break;
+	  if (record.sequence < next_sequence_)
+	    continue;
+	  Insert(record.entry);
+	  ++next_sequence_;
+	  bnewer = true;
+	}
+      munmap(memory, status.st_size);
+    }
+  Publish();
+
+  // a crash can leave part of a record, or a batch whose sync never finished, at the end
+  log_size_ = bnewer ? valid * sizeof(LeaderboardRecord) : 0;
+  if (log_size_ != status.st_size && ftruncate(fd_, log_size_) != 0)
+    {
+      error_ = path_ + ": " + strerror(errno);
+      return false;
+    }
+  return true;
+}
+
+void Leaderboard::Close()
+{
+  if (writer_.joinable())
+    {
+      {
+	std::lock_guard<std::mutex> lock(mutex_);
+	bstop_ = true;
+      }
+      wake_.notify_one();
+      writer_.join();
+    }
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      for (std::atomic<uint64_t>& cell : counts_[board])
+	cell.store(0, std::memory_order_relaxed);
+      totals_[board] = 0;
+      building_[board]->count = 0;
+      bchanged_[board] = true;
+    }
+  Publish();
+  next_sequence_ = snapshot_sequence_ = 0;
+  log_size_ = 0;
+  pending_.clear();
+  submitted_ = written_ = flush_target_ = 0;
+  btorn_ = false;
+}
+
+void Leaderboard::Submit(const LeaderboardEntry& entry)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.push_back(entry);
+  ++submitted_;
+}
+
+void Leaderboard::Flush()
+{
+  if (!writer_.joinable())
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  uint64_t target = submitted_;
+  flush_target_ = target;
+  wake_.notify_one();
+  flushed_.wait(lock, [this, target] { return written_ >= target; });
+}
+
+void Leaderboard::WriterLoop()
+{
+  std::vector<LeaderboardEntry> batch;
+  std::vector<LeaderboardRecord> records;
+  // how much of the batch is on the boards already, from an attempt that failed
+  size_t on_boards = 0;
+  bool bfailed = false;
+  while (true)
+    {
+      uint64_t target;
+      bool bstop;
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	// let a burst build up so one sync covers it, unless someone is waiting on a flush;
+	// after a failure, give the disk a while however many are waiting
+	if (bfailed)
+	  wake_.wait_for(lock, std::chrono::milliseconds(kRetryMs_), [this] { return bstop_; });
+	else
+	  wake_.wait_for(lock, std::chrono::milliseconds(kBatchMs_),
+			 [this] { return bstop_ || flush_target_ > written_; });
+	batch.insert(batch.end(), pending_.begin(), pending_.end());
+	pending_.clear();
+	target = submitted_;
+	bstop = bstop_;
+      }
+
+      // the boards take the games whatever the disk does, so a full disk doesn't stop play
+      if (on_boards < batch.size())
+	{
+	  for ( ; on_boards < batch.size(); ++on_boards)
+	    Insert(batch[on_boards]);
+	  Publish();
+	}
+
+      bfailed = !batch.empty() && !Append(batch, &records);
+      if (bfailed)
+	{
+	  ++failed_writes_;
+	}
+      else
+	{
+	  next_sequence_ += batch.size();
+	  batch.clear();
+	  on_boards = 0;
+	}
+
+      // only when the boards hold exactly what's in the log and the snapshot
+      if (!bfailed && next_sequence_ > snapshot_sequence_
+	  && (bstop || next_sequence_ - snapshot_sequence_ >= kSnapshotRecords_) && !WriteSnapshot())
+	++failed_writes_;
+
+      // games still failing to write at Close are given up on
+      if (!bfailed || bstop)
+	{
+	  {
+	    std::lock_guard<std::mutex> lock(mutex_);
+	    written_ = target;
+	  }
+	  flushed_.notify_all();
+	}
+      if (bstop)
+	return;
+    }
+}
+
+bool Leaderboard::Append(const std::vector<LeaderboardEntry>& batch, std::vector<LeaderboardRecord>* records)
+{
+  if (btorn_)
+    {
+      if (ftruncate(fd_, log_size_) != 0)
+	return false;
+      btorn_ = false;
+    }
+  records->resize(batch.size());
+  for (size_t i = 0; i < batch.size(); ++i)
+    {
+      LeaderboardRecord& record = (*records)[i];
+      std::memset(&record, 0, sizeof(record));
+      record.magic = kMagic_;
+      record.sequence = next_sequence_ + i;
+      record.entry = batch[i];
+      record.checksum = Checksum(record);
+    }
+  const char* data = reinterpret_cast<const char*>(records->data());
+  size_t size = records->size() * sizeof(LeaderboardRecord), done = 0;
+  while (done < size)
+    {
+      ssize_t nwritten = write(fd_, data + done, size - done);
+      if (nwritten < 0 && errno == EINTR)
+	continue;
+      if (nwritten <= 0)
+	break;
+      done += nwritten;
+    }
+  if (done == size && fdatasync(fd_) == 0)
+    {
+      log_size_ += size;
+      return true;
+    }
+  // a torn or unsynced batch would make Replay drop every record after it,
+  // so it comes off again before anything else goes on
+  btorn_ = ftruncate(fd_, log_size_) != 0;
+  return false;
+}
+
+bool Leaderboard::WriteSnapshot()
+{
+  // whatever happens, the next try is a full interval away
+  snapshot_sequence_ = next_sequence_;
+
+  std::string path = path_ + ".snapshot", temporary = path + ".tmp";
+  int fd = open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  size_t size = SnapshotSize();
+  // claim the blocks up front, as running out of them through the map is a SIGBUS
+  void* memory = posix_fallocate(fd, 0, size) == 0
+    ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+  if (memory == MAP_FAILED)
+    {
+      close(fd);
+      unlink(temporary.c_str());
+      return false;
+    }
+  LeaderboardSnapshot* snapshot = static_cast<LeaderboardSnapshot*>(memory);
+  LeaderboardTop* tops = reinterpret_cast<LeaderboardTop*>(snapshot + 1);
+  uint64_t* cells = reinterpret_cast<uint64_t*>(tops + kNumBoards);
+  snapshot->magic = kSnapshotMagic_;
+  snapshot->sequence = next_sequence_;
+  snapshot->nbuckets = kNumBuckets;
+  snapshot->ntop = kTopEntries;
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      snapshot->totals[board] = totals_[board];
+      tops[board] = *building_[board];
+      for (size_t i = 0; i < kNumBuckets; ++i)
+	cells[board * kNumBuckets + i] = counts_[board][i].load(std::memory_order_relaxed);
+    }
+  snapshot->checksum = Checksum(snapshot);
+  bool bsynced = msync(memory, size, MS_SYNC) == 0;
+  munmap(memory, size);
+  bsynced = fsync(fd) == 0 && bsynced;
+  close(fd);
+  if (!bsynced || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      unlink(temporary.c_str());
+      return false;
+    }
+  int directory = open(Directory(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  bsynced = directory >= 0 && fsync(directory) == 0;
+  if (directory >= 0)
+    close(directory);
+  // the log can't go until the rename is sure to last; if it stays, Replay skips what it has
+  if (!bsynced || ftruncate(fd_, 0) != 0)
+    return false;
+  log_size_ = 0;
+  return true;
+}
+
+void Leaderboard::Insert(const LeaderboardEntry& entry)
+{
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      LeaderboardKind kind = static_cast<LeaderboardKind>(board);
+      uint32_t value = BoardValue(kind, entry);
+      uint64_t key;
+      if (!BoardKey(kind, value, &key))
+	continue;
+
+      std::vector< std::atomic<uint64_t> >& cells = counts_[board];
+      for (size_t i = BoardBucket(kind, value) + 1; i <= kNumBuckets; i += i & -i)
+	cells[i - 1].fetch_add(1, std::memory_order_relaxed);
+      ++totals_[board];
+
+      // behind the games it ties with, which got there first
+      LeaderboardTop* top = building_[board];
+      size_t place = top->count;
+      for ( ; place > 0; --place)
+	{
+	  uint64_t other;
+	  BoardKey(kind, BoardValue(kind, top->entries[place - 1]), &other);
+	  if (other <= key)
+	    break;
+	}
+      if (place == kTopEntries)
+	continue;
+      size_t last = std::min<size_t>(top->count, kTopEntries - 1);
+      for (size_t i = last; i > place; --i)
+	top->entries[i] = top->entries[i - 1];
+      top->entries[place] = entry;
+      top->count = last + 1;
+      bchanged_[board] = true;
+    }
+}
+
+void Leaderboard::Publish()
+{
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      if (!bchanged_[board])
+	continue;
+      retired_.push_back(tops_[board].exchange(new LeaderboardTop(*building_[board])));
+      bchanged_[board] = false;
+    }
+  if (retired_.empty())
+    return;
+
+  // readers that came in after the flip can only have found the new arrays
+  uint64_t epoch = epoch_.fetch_add(1);
+  while (readers_[epoch & 1] != 0)
+    std::this_thread::yield();
+  for (const LeaderboardTop* top : retired_)
+    delete top;
+  retired_.clear();
+}
+
+uint64_t Leaderboard::BeginRead() const
+{
+  while (true)
+    {
+      uint64_t epoch = epoch_;
+      ++readers_[epoch & 1];
+      // the writer may have flipped in between and not be waiting on us
+      if (epoch_ == epoch)
+	return epoch;
+      --readers_[epoch & 1];
+    }
+}
+
+void Leaderboard::EndRead(uint64_t epoch) const
+{
+  --readers_[epoch & 1];
+}
+
+void Leaderboard::Top(LeaderboardKind board, size_t count, std::vector<LeaderboardEntry>* entries) const
+{
+  uint64_t epoch = BeginRead();
+  const LeaderboardTop* top = tops_[board];
+  entries->assign(top->entries, top->entries + std::min<uint64_t>(count, top->count));
+  EndRead(epoch);
+}
+
+uint64_t Leaderboard::Rank(LeaderboardKind board, uint32_t value) const
+{
+  uint64_t key;
+  if (!BoardKey(board, value, &key))
+    return totals_[board] + 1;
+  // games already on the board in the same bucket keep their places
+  const std::vector< std::atomic<uint64_t> >& cells = counts_[board];
+  uint64_t ahead = 0;
+  for (size_t i = BoardBucket(board, value) + 1; i > 0; i -= i & -i)
+    ahead += cells[i - 1].load(std::memory_order_relaxed);
+  return ahead + 1;
+}
+
+uint64_t Leaderboard::Size(LeaderboardKind board) const
+{
+  return totals_[board];
+}
+
+Leaderboard::~Leaderboard()
+{
+  Close();
+  for (GLint board = 0; board < kNumBoards; ++board)
+    {
+      delete building_[board];
+      delete tops_[board];
+    }
+}
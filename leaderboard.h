@@ -0,0 +1,157 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+enum LeaderboardKind
+  {
+    kBoardScore,
+    kBoardLines,
+    // fastest to clear the sprint lines, lowest first
+    kBoardSprint,
+    kNumBoards
+  };
+
+// One finished game, laid out the same on disk as in memory
+struct LeaderboardEntry
+{
+  char name[16];
+  uint32_t score;
+  uint32_t lines;
+  // 0 when the game never cleared the sprint lines
+  uint32_t sprint_ms;
+  uint32_t seed;
+  // seconds since the epoch
+  uint64_t time;
+};
+
+struct LeaderboardRecord;
+struct LeaderboardTop;
+
+/*
+  Persistent high scores for score, lines and sprint times.
+  Submissions are appended to a log of fixed size records by a writer
+  thread, which writes whatever has queued up since its last pass in
+  one go and syncs it once, so a burst of games costs one fsync every
+  few milliseconds. A batch that fails to write or sync is cut back
+  off the log and tried again, so the log only ever holds whole,
+  synced records in order.
+
+  Memory stays the same however many games are played. Each board
+  keeps full entries for only its best games, and answers ranks from
+  a Fenwick tree of game counts over value buckets: one per value up
+  to 4096, then 2048 to each power of two, so a rank is exact below
+  4096 and above that counts games within 1/2048 of the value as
+  ties. Every so often, and at Close, the writer writes the boards
+  through a map into a snapshot file beside the log, renames it into
+  place and empties the log. Opening maps the snapshot and replays
+  only the log written since, dropping a torn record left at the end
+  by a crash.
+
+  Readers never take a lock. Counts are relaxed atomics, and each
+  game lands in exactly one of the tree nodes a rank reads, so a rank
+  counts a game being added or doesn't, never half of it. The best
+  games are a copied array per board, published once a batch is in;
+  readers check in on a counter for the current epoch, and the writer
+  frees a replaced array only after moving the epoch on and seeing the
+  old epoch's readers leave, RCU style. Submit only queues the entry,
+  so a match server tick never waits on the disk or the boards.
+*/
+
+class Leaderboard
+{
+public:
+  Leaderboard();
+
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return fd_ >= 0; }
+  const std::string& Error() const { return error_; }
+
+  // Queues a finished game, without waiting on the disk or on readers
+  void Submit(const LeaderboardEntry& entry);
+  // Returns once everything submitted so far is on disk and on the boards,
+  // which with a failing disk is not until it recovers or Close gives up
+  void Flush();
+
+  // The best count entries on a board, best first, up to the 100 a board keeps
+  void Top(LeaderboardKind board, size_t count, std::vector<LeaderboardEntry>* entries) const;
+  // The place, from 1, a game with this score, line count or sprint time would take
+  uint64_t Rank(LeaderboardKind board, uint32_t value) const;
+  uint64_t Size(LeaderboardKind board) const;
+  // Attempts at writing a batch that failed and had to be retried, the
+  // games being on the boards meanwhile, and snapshots that failed to write
+  uint64_t FailedWrites() const { return failed_writes_; }
+
+  virtual ~Leaderboard();
+private:
+  Leaderboard(const Leaderboard&);
+  void operator=(const Leaderboard&);
+
+  bool Replay();
+  // Loads the boards from the snapshot, if there is one
+  bool LoadSnapshot();
+  // Writes the boards as of next_sequence_ and empties the log, or leaves both as they were
+  bool WriteSnapshot();
+  void WriterLoop();
+  // Appends and syncs a batch, or leaves the log as it was
+  bool Append(const std::vector<LeaderboardEntry>& batch, std::vector<LeaderboardRecord>* records);
+  void Insert(const LeaderboardEntry& entry);
+  // Hands the best games built so far to readers, then frees what they replaced
+  void Publish();
+  // Readers hold an epoch from BeginRead to EndRead
+  uint64_t BeginRead() const;
+  void EndRead(uint64_t epoch) const;
+
+  int fd_;
+  std::string path_;
+  std::string error_;
+  // games in the log and the snapshot together, all of them synced
+  uint64_t next_sequence_;
+  off_t log_size_;
+  // where the last snapshot was written, or tried
+  uint64_t snapshot_sequence_;
+
+  // Fenwick trees of game counts, by bucket from best to worst
+  std::vector< std::atomic<uint64_t> > counts_[kNumBoards];
+  std::atomic<uint64_t> totals_[kNumBoards];
+  std::atomic<const LeaderboardTop*> tops_[kNumBoards];
+  // the writer's best games, ahead of tops_ by the batch being written
+  LeaderboardTop* building_[kNumBoards];
+  bool bchanged_[kNumBoards];
+  // arrays readers may still be on, freed once they can't be
+  std::vector<const LeaderboardTop*> retired_;
+
+  mutable std::atomic<uint64_t> epoch_;
+  mutable std::atomic<uint64_t> readers_[2];
+
+  std::mutex mutex_;
+  std::condition_variable flushed_;
+  std::condition_variable wake_;
+  std::vector<LeaderboardEntry> pending_;
+  uint64_t submitted_;
+  uint64_t written_;
+  uint64_t flush_target_;
+  std::atomic<uint64_t> failed_writes_;
+  // a failed batch is still past log_size_ on disk
+  bool btorn_;
+  bool bstop_;
+  std::thread writer_;
+
+  static const uint32_t kMagic_;
+  static const uint32_t kSnapshotMagic_;
+  static const GLint kBatchMs_;
+  static const GLint kRetryMs_;
+  static const uint64_t kSnapshotRecords_;
+};
+
+
+#endif // LEADERBOARD_H
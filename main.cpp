@@ -6,9 +6,13 @@
 #include "tetromino_renderer.h"
 #include "hud_renderer.h"
 #include "game.h"
+#include "hint_search.h"
+#include "state_feed.h"
+#include "metrics.h"
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <chrono>
 #include <iostream>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -30,6 +34,8 @@ const GLfloat kWidth = 3 * kMargin + kHudWidth + kPlayFieldWidth;
 const GLfloat kHeight = 2 * kMargin + kPlayFieldHeight;
 const GLfloat kFrameRate = 60.0f;
 const GLfloat kUpdateTimeStep = 1.0f / 60.0f;
+const char kStateFeedName[] = "/tetris_state";
+const uint16_t kMetricsPort = 9464;
 
 enum GameState
   {
@@ -40,9 +46,12 @@ enum GameState
   };
 
 GameState game_state = kGameStart;
+bool bshow_hint = false;
 
 PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
 Game tetris(&playfield);
+// filled by KeyCallback, emptied by tetris.Update
+InputQueue input_queue;
 
 float delta_time = 0.0f;
 float last_frame = 0.0f;
@@ -85,6 +94,7 @@ int main()
   glewInit();
 
   glfwSetKeyCallback(window, KeyCallback);
+  tetris.SetInputQueue(&input_queue);
 
   glm::mat4 projection = glm::ortho(0.0f, (float)kWidth, 0.0f, (float)kHeight);
 
@@ -145,6 +155,20 @@ int main()
 				       texture_renderer,
 				       tetro_textures);
 
+  HintSearch hint_search(EvalWeights::Default(), tetris.GetRandomizer());
+  GLuint hinted_piece = 0;
+
+  // for overlays and other processes on this machine, the game runs fine without it
+  StateFeedWriter state_feed;
+  if (!state_feed.Open(kStateFeedName))
+    std::cerr << "State feed unavailable: " << state_feed.Error() << std::endl;
+  MetricsServer metrics_server;
+  if (!metrics_server.Start(kMetricsPort))
+    std::cerr << "Metrics unavailable: " << metrics_server.Error() << std::endl;
+  GameMetrics game_metrics;
+  GLuint pieces_seen = 0;
+  MetricCounter& frames_rendered = Metrics().GetCounter("tetris_frames_rendered_total", "Frames drawn.");
+
   GLfloat previous = glfwGetTime();
   GLfloat lag = 0.f;
   // game loop
@@ -178,13 +202,24 @@ int main()
 	  
 	  while (lag >= kUpdateTimeStep)
 	    {
+	      // keys are matched to the frame they were pressed in, not to when we got round to rendering
+	      tetris.SetInputTime(current_frame - lag + kUpdateTimeStep);
+	      auto update_start = std::chrono::steady_clock::now();
 	      tetris.Update();
+	      game_metrics.RecordUpdate(tetris, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - update_start).count(),
+					&pieces_seen);
 	      if (tetris.IsGameOver())
 		{
 		  game_state = kGameOver;
 		}
 	      lag -= kUpdateTimeStep;
 	    }
+
+	  if (bshow_hint && tetris.PiecesSpawned() != hinted_piece && !tetris.IsPausedForLineClear())
+	    {
+	      hinted_piece = tetris.PiecesSpawned();
+	      hint_search.Start(BitBoard::FromPlayField(playfield), playfield.FallingTetroType(), tetris.Next(), tetris.Held(), tetris.CanHold());
+	    }
 	  
 	  hud_renderer.RenderHud(tetris.Next(), tetris.Held(), tetris.Score(), tetris.Lines(), tetris.Level());
 	  playfield_renderer.Render(playfield);
@@ -197,6 +232,15 @@ int main()
 	    {
 	      tetromino_renderer.RenderOnPlayfield(playfield.FallingTetroRow(), playfield.FallingTetroCol(),  playfield.FallingTetro());
 	      ghost_renderer.RenderOnPlayfield(playfield.GhostRow(), playfield.GhostCol(), playfield.FallingTetro());
+
+	      Placement hint;
+	      if (bshow_hint && hint_search.Best(&hint))
+		{
+		  Tetromino hint_tetro(hint.type);
+		  for (GLint turn = 0; turn < hint.rotation; ++turn)
+		    hint_tetro.Rotate(kRight);
+		  ghost_renderer.RenderOnPlayfield(hint.row, hint.col, hint_tetro);
+		}
 	    }
 	  
 	  break;
@@ -218,6 +262,8 @@ int main()
 	  break;
 	}
       
+      state_feed.Publish(tetris, playfield);
+      frames_rendered.Add();
       glfwSwapBuffers(window);
       glfwPollEvents();
     }
@@ -226,8 +272,31 @@ int main()
 }
 
 
+GLuint GameInputForKey(int key)
+{
+  switch (key)
+    {
+    case GLFW_KEY_LEFT: return kInputLeft;
+    case GLFW_KEY_RIGHT: return kInputRight;
+    case GLFW_KEY_UP: return kInputRotateRight;
+    case GLFW_KEY_Z: return kInputRotateLeft;
+    case GLFW_KEY_DOWN: return kInputSoftDrop;
+    case GLFW_KEY_SPACE: return kInputHardDrop;
+    case GLFW_KEY_C: return kInputHold;
+    default: return 0;
+    }
+}
+
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+  GLuint input = GameInputForKey(key);
+  // releases always go through so soft drop can't stick on across a pause
+  if (input && action == GLFW_RELEASE)
+    {
+      InputEvent event = { glfwGetTime(), input, false };
+      input_queue.Push(event);
+    }
+  
   switch (game_state)
     {
     case kGameStart:
@@ -245,20 +314,14 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
     case kGameRunning:
       if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 	game_state = kGamePaused;
-      if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-	tetris.HardDrop();
-      if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
-	tetris.Hold();
-      if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-	tetris.RotateRight();
-      if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
-	tetris.RotateLeft();
-      if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-	tetris.SoftDrop();
-      if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-	tetris.MoveLeft();
-      if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-	tetris.MoveRight();
+      // key repeat keeps a piece sliding, but nothing else goes twice for one press
+      if (input && (action == GLFW_PRESS || (action == GLFW_REPEAT && (input & (kInputLeft | kInputRight)))))
+	{
+	  InputEvent event = { glfwGetTime(), input, true };
+	  input_queue.Push(event);
+	}
+      if (key == GLFW_KEY_H && action == GLFW_PRESS)
+	bshow_hint = !bshow_hint;
       break;
 
     case kGamePaused:
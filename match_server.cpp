@@ -0,0 +1,612 @@
+#include "match_server.h"
+#include "bitboard.h"
+#include "bot_protocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+  GLuint InputFromLetter(char letter)
+  {
+    switch (letter)
+      {
+      case 'L': return kInputLeft;
+      case 'R': return kInputRight;
+      case 'X': return kInputRotateRight;
+      case 'Z': return kInputRotateLeft;
+      case 'D': return kInputSoftDrop;
+      case 'H': return kInputHardDrop;
+      case 'C': return kInputHold;
+      default: return 0;
+      }
+  }
+}
+
+const GLint MatchServer::kNumRows_ = 22;
+const GLint MatchServer::kNumCols_ = 10;
+const double MatchServer::kTickSeconds_ = 1.0 / 60.0;
+const GLint MatchServer::kMaxCatchUpTicks_ = 5;
+const size_t MatchServer::kMaxLineLength_ = 4096;
+const size_t MatchServer::kMaxOutput_ = 1 << 20;
+const size_t MatchServer::kMaxSpareSessions_ = 1024;
+// buffers a slow client grew past this go back rather than sit in a spare session
+const size_t MatchServer::kMaxSpareBuffer_ = 1 << 16;
+const GLuint MatchServer::kSprintLines_ = 40;
+const size_t MatchServer::kMaxTopEntries_ = 100;
+// about two seconds of frames; a client further ahead than that loses keys
+const size_t MatchServer::kMaxQueuedKeys_ = 128;
+
+MatchServer::Session::Session(int socket_fd, GLint nrows, GLint ncols) : playfield(nrows, ncols),
+									 game(&playfield),
+									 output_sent(0),
+									 index(0),
+									 keys_delivered(0),
+									 pieces_reported(0),
+									 pieces_recorded(0),
+									 last_frame(0),
+									 start_frame(0),
+									 seed(0),
+									 sprint_ms(0),
+									 bplaying(false),
+									 bwaiting_to_write(false),
+									 bdirty(false),
+									 bclosed(false)
+{
+  fd = socket_fd;
+  blistener = false;
+  std::strncpy(name, "anonymous", sizeof(name));
+}
+
+void MatchServer::Session::Reset(int socket_fd)
+{
+  fd = socket_fd;
+  playfield.Clear();
+  if (input.capacity() > kMaxSpareBuffer_)
+    std::string().swap(input);
+  if (output.capacity() > kMaxSpareBuffer_)
+    std::string().swap(output);
+  input.clear();
+  output.clear();
+  output_sent = 0;
+  keys.clear();
+  keys_delivered = 0;
+  pieces_reported = 0;
+  pieces_recorded = 0;
+  last_frame = 0;
+  start_frame = 0;
+  seed = 0;
+  sprint_ms = 0;
+  std::strncpy(name, "anonymous", sizeof(name));
+  bplaying = false;
+  bwaiting_to_write = false;
+  bdirty = false;
+  bclosed = false;
+}
+
+MatchServer::MatchServer(GLint nworkers) : leaderboard_(nullptr),
+					   nsessions_(0),
+					   sessions_metric_(Metrics().GetGauge("tetris_server_sessions", "Connections open on the match server.")),
+					   tick_metric_(Metrics().GetHistogram("tetris_server_tick_seconds", "Time a match server worker spent on one tick.",
+									       { 10000, 50000, 100000, 500000, 1000000, 2000000, 5000000, 16666667 }, 1e-9)),
+					   bstop_(false)
+{
+  GLint ncores = std::max(1u, std::thread::hardware_concurrency());
+  if (nworkers <= 0)
+    nworkers = ncores;
+  for (GLint i = 0; i < nworkers; ++i)
+    {
+      std::unique_ptr<Worker> worker(new Worker);
+      worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      worker->core = i % ncores;
+      worker->frames = 0;
+      worker->updates = 0;
+      worker->messages = 0;
+      worker->slowest_tick_ns = 0;
+      workers_.push_back(std::move(worker));
+    }
+}
+
+bool MatchServer::Listen(int fd, const std::string& what)
+{
+  if (listen(fd, SOMAXCONN) != 0)
+    {
+      error_ = "listen on " + what + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+
+  std::unique_ptr<Socket> listener(new Socket);
+  listener->fd = fd;
+  listener->blistener = true;
+  // only one worker wakes per connection, and it keeps the session
+  for (auto& worker : workers_)
+    {
+      epoll_event event;
+      event.events = EPOLLIN | EPOLLEXCLUSIVE;
+      event.data.ptr = listener.get();
+      epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+  listeners_.push_back(std::move(listener));
+  return true;
+}
+
+bool MatchServer::ListenTcp(uint16_t port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      error_ = "bind to port " + std::to_string(port) + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+  return Listen(fd, "port " + std::to_string(port));
+}
+
+bool MatchServer::ListenUnix(const std::string& path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path))
+    {
+      error_ = path + ": path too long";
+      return false;
+    }
+  std::strcpy(address.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      error_ = "bind to " + path + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+  unix_path_ = path;
+  return Listen(fd, path);
+}
+
+void MatchServer::Start()
+{
+  for (auto& worker : workers_)
+    threads_.push_back(std::thread(&MatchServer::WorkerLoop, this, worker.get()));
+}
+
+void MatchServer::Stop()
+{
+  bstop_ = true;
+  for (std::thread& thread : threads_)
+    thread.join();
+  threads_.clear();
+}
+
+MatchServerStats MatchServer::Stats()
+{
+  MatchServerStats stats = { nsessions_, 0, 0, 0, 0 };
+  uint64_t slowest = 0;
+  for (auto& worker : workers_)
+    {
+      stats.frames += worker->frames.exchange(0);
+      stats.updates += worker->updates.exchange(0);
+      stats.messages += worker->messages.exchange(0);
+      slowest = std::max(slowest, worker->slowest_tick_ns.exchange(0));
+    }
+  stats.slowest_tick = slowest * 1e-9;
+  return stats;
+}
+
+void MatchServer::WorkerLoop(Worker* worker)
+{
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(worker->core, &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+  typedef std::chrono::steady_clock Clock;
+  const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(kTickSeconds_));
+  Clock::time_point next_tick = Clock::now() + tick;
+  std::vector<epoll_event> events(256);
+  while (!bstop_)
+    {
+      GLint timeout = std::chrono::duration_cast<std::chrono::milliseconds>(next_tick - Clock::now()).count();
+      GLint nevents = epoll_wait(worker->epoll_fd, events.data(), events.size(), std::max(0, timeout));
+      for (GLint i = 0; i < nevents; ++i)
+	{
+	  Socket* socket = static_cast<Socket*>(events[i].data.ptr);
+	  if (socket->blistener)
+	    {
+	      Accept(worker, socket->fd);
+	      continue;
+	    }
+	  
+	  Session* session = static_cast<Session*>(socket);
+	  if (session->bclosed)
+	    continue;
+	  if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	    Read(worker, session);
+	  if (!session->bclosed && (events[i].events & EPOLLOUT) && !Flush(worker, session))
+	    Close(worker, session);
+	}
+
+      // a worker that falls behind catches up a few frames, then lets the rest go
+      GLint ticks = 0;
+      Clock::time_point now = Clock::now();
+      while (now >= next_tick && ticks < kMaxCatchUpTicks_)
+	{
+	  Tick(worker);
+	  next_tick += tick;
+	  ++ticks;
+	}
+      if (now >= next_tick)
+	next_tick = now + tick;
+      if (ticks)
+	{
+	  uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - now).count() / ticks;
+	  tick_metric_.Observe(elapsed);
+	  uint64_t slowest = worker->slowest_tick_ns;
+	  while (elapsed > slowest && !worker->slowest_tick_ns.compare_exchange_weak(slowest, elapsed));
+	}
+    }
+
+  // closed sessions waiting for Tick gave up their fd, which may already be another worker's connection
+  for (auto& session : worker->sessions)
+    if (!session->bclosed)
+      close(session->fd);
+  nsessions_ -= worker->sessions.size();
+  sessions_metric_.Add(-static_cast<int64_t>(worker->sessions.size()));
+  worker->sessions.clear();
+  worker->closed.clear();
+}
+
+void MatchServer::Accept(Worker* worker, int listen_fd)
+{
+  while (true)
+    {
+      int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0)
+	return;
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+      std::unique_ptr<Session> session;
+      if (worker->spare.empty())
+	{
+	  session.reset(new Session(fd, kNumRows_, kNumCols_));
+	}
+      else
+	{
+	  session = std::move(worker->spare.back());
+	  worker->spare.pop_back();
+	  session->Reset(fd);
+	}
+      session->index = worker->sessions.size();
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = session.get();
+      if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+	{
+	  close(fd);
+	  continue;
+	}
+      worker->sessions.push_back(std::move(session));
+      ++nsessions_;
+      sessions_metric_.Add(1);
+    }
+}
+
+void MatchServer::Read(Worker* worker, Session* session)
+{
+  char buffer[4096];
+  while (true)
+    {
+      ssize_t nread = read(session->fd, buffer, sizeof(buffer));
+      if (nread < 0 && errno == EINTR)
+	continue;
+      if (nread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	break;
+      if (nread <= 0)
+	{
+	  Close(worker, session);
+	  return;
+	}
+      session->input.append(buffer, nread);
+    }
+
+  size_t start = 0, end;
+  while ((end = session->input.find('\n', start)) != std::string::npos)
+    {
+      Handle(worker, session, session->input.substr(start, end - start));
+      if (session->bclosed)
+	return;
+      start = end + 1;
+    }
+  session->input.erase(0, start);
+  if (session->input.size() > kMaxLineLength_)
+    Close(worker, session);
+}
+
+void MatchServer::Handle(Worker* worker, Session* session, const std::string& line)
+{
+  ++worker->messages;
+  if (line.compare(0, 5, "keys ") == 0)
+    {
+      GLuint keys = 0;
+      for (size_t i = 5; i < line.size(); ++i)
+	keys |= InputFromLetter(line[i]);
+      if (!keys || session->keys.size() - session->keys_delivered >= kMaxQueuedKeys_)
+	return;
+      session->keys.push_back(keys);
+      // keys are due on the next frame, whatever the game was waiting for
+      uint64_t next_frame = worker->wheel.Now() + 1;
+      if (session->bplaying && (!session->IsScheduled() || session->deadline > next_frame))
+	worker->wheel.Schedule(session, next_frame);
+    }
+  else if (line.compare(0, 6, "start ") == 0)
+    {
+      Game& game = session->game;
+      session->seed = strtoul(line.c_str() + 6, nullptr, 10);
+      game.Seed(session->seed);
+      game.SetLevel(1);
+      game.Restart();
+      game.BeginPlay();
+      session->keys.clear();
+      session->keys_delivered = 0;
+      session->pieces_reported = 0;
+      session->pieces_recorded = 0;
+      session->last_frame = worker->wheel.Now();
+      session->start_frame = session->last_frame;
+      session->sprint_ms = 0;
+      session->bplaying = true;
+      worker->wheel.Schedule(session, session->last_frame + 1);
+    }
+  else if (line == "board")
+    {
+      BitBoard board = BitBoard::FromPlayField(session->playfield);
+      char hex[8];
+      session->output += "board";
+      for (GLint row = 0; row < board.NumRows(); ++row)
+	{
+	  snprintf(hex, sizeof(hex), " %x", board.Rows()[row]);
+	  session->output += hex;
+	}
+      session->output += '\n';
+      MarkDirty(worker, session);
+    }
+  else if (line.compare(0, 5, "name ") == 0)
+    {
+      // one word, so it can go back out in a space separated reply
+      size_t length = std::min(line.find(' ', 5), line.size()) - 5;
+      length = std::min(length, sizeof(session->name) - 1);
+      if (length > 0)
+	{
+	  std::memcpy(session->name, line.data() + 5, length);
+	  session->name[length] = '\0';
+	}
+    }
+  else if (line.compare(0, 4, "top ") == 0 && leaderboard_)
+    {
+      char board_name[16];
+      size_t count = 10;
+      if (sscanf(line.c_str() + 4, "%15s %zu", board_name, &count) < 1)
+	return;
+      LeaderboardKind board = strcmp(board_name, "lines") == 0 ? kBoardLines : strcmp(board_name, "sprint") == 0 ? kBoardSprint : kBoardScore;
+      std::vector<LeaderboardEntry>& entries = worker->top;
+      leaderboard_->Top(board, std::min(count, kMaxTopEntries_), &entries);
+      char message[64];
+      snprintf(message, sizeof(message), "top %s %zu", board == kBoardLines ? "lines" : board == kBoardSprint ? "sprint" : "score", entries.size());
+      session->output += message;
+      for (const LeaderboardEntry& entry : entries)
+	{
+	  snprintf(message, sizeof(message), " %.16s %u", entry.name, board == kBoardLines ? entry.lines : board == kBoardSprint ? entry.sprint_ms : entry.score);
+	  session->output += message;
+	}
+      session->output += '\n';
+      MarkDirty(worker, session);
+    }
+  else if (line == "quit")
+    {
+      Close(worker, session);
+    }
+}
+
+void MatchServer::Tick(Worker* worker)
+{
+  std::vector<TimerNode*>& due = worker->due;
+  due.clear();
+  worker->wheel.Tick(&due);
+  for (TimerNode* node : due)
+    Step(worker, static_cast<Session*>(node));
+
+  // one write per session per tick however many messages it got
+  for (Session* session : worker->dirty)
+    {
+      session->bdirty = false;
+      if (!session->bclosed && !session->bwaiting_to_write && !Flush(worker, session))
+	Close(worker, session);
+    }
+  worker->dirty.clear();
+
+  // closed sessions are only freed here, where nothing still points at them
+  for (Session* session : worker->closed)
+    {
+      size_t index = session->index;
+      std::unique_ptr<Session> freed = std::move(worker->sessions[index]);
+      worker->sessions[index] = std::move(worker->sessions.back());
+      worker->sessions.pop_back();
+      if (index < worker->sessions.size())
+	worker->sessions[index]->index = index;
+      if (worker->spare.size() < kMaxSpareSessions_)
+	worker->spare.push_back(std::move(freed));
+      --nsessions_;
+      sessions_metric_.Add(-1);
+    }
+  worker->closed.clear();
+}
+
+void MatchServer::Step(Worker* worker, Session* session)
+{
+  Game& game = session->game;
+  if (!session->bplaying)
+    return;
+
+  // nothing happened in the frames since the last Update, so they go in one step
+  uint64_t now = worker->wheel.Now();
+  game.SkipFrames(now - session->last_frame - 1);
+  worker->frames += now - session->last_frame;
+  ++worker->updates;
+  session->last_frame = now;
+  
+  if (session->keys_delivered < session->keys.size())
+    {
+      game.Press(session->keys[session->keys_delivered++]);
+      if (session->keys_delivered == session->keys.size())
+	{
+	  session->keys.clear();
+	  session->keys_delivered = 0;
+	}
+    }
+  if (!game.IsGameOver())
+    {
+      auto update_start = std::chrono::steady_clock::now();
+      game.Update();
+      game_metrics_.RecordUpdate(game, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - update_start).count(),
+				 &session->pieces_recorded);
+    }
+  if (!session->sprint_ms && game.Lines() >= kSprintLines_)
+    session->sprint_ms = std::max<uint32_t>(1, (now - session->start_frame) * kTickSeconds_ * 1000);
+
+  char message[96];
+  if (game.PiecesSpawned() != session->pieces_reported && !game.IsGameOver())
+    {
+      session->pieces_reported = game.PiecesSpawned();
+      snprintf(message, sizeof(message), "piece %u %c %c %c %u %u\n", game.PiecesSpawned(), PieceLetter(session->playfield.FallingTetroType()),
+	       PieceLetter(game.Next()), PieceLetter(game.Held()), game.Lines(), game.Score());
+      session->output += message;
+      MarkDirty(worker, session);
+    }
+  if (game.IsGameOver())
+    {
+      snprintf(message, sizeof(message), "over %u %u\n", game.Lines(), game.Score());
+      session->output += message;
+      if (leaderboard_)
+	{
+	  LeaderboardEntry entry;
+	  std::memcpy(entry.name, session->name, sizeof(entry.name));
+	  entry.score = game.Score();
+	  entry.lines = game.Lines();
+	  entry.sprint_ms = session->sprint_ms;
+	  entry.seed = session->seed;
+	  entry.time = time(nullptr);
+	  // the rank is read before the game itself is on the board, which is where it lands
+	  snprintf(message, sizeof(message), "place %lu\n", static_cast<unsigned long>(leaderboard_->Rank(kBoardScore, entry.score)));
+	  session->output += message;
+	  leaderboard_->Submit(entry);
+	}
+      session->bplaying = false;
+      MarkDirty(worker, session);
+      return;
+    }
+  // the rest of the queued keys go one a frame
+  worker->wheel.Schedule(session, now + (session->keys.empty() ? game.FramesUntilEvent() : 1));
+}
+
+void MatchServer::MarkDirty(Worker* worker, Session* session)
+{
+  if (session->output.size() - session->output_sent == 0)
+    return;
+  // a session already waiting on the socket has its write armed
+  if (session->bwaiting_to_write)
+    return;
+  if (!session->bdirty)
+    {
+      session->bdirty = true;
+      worker->dirty.push_back(session);
+    }
+}
+
+bool MatchServer::Flush(Worker* worker, Session* session)
+{
+  while (session->output_sent < session->output.size())
+    {
+      ssize_t nwritten = write(session->fd, session->output.data() + session->output_sent, session->output.size() - session->output_sent);
+      if (nwritten < 0 && errno == EINTR)
+	continue;
+      if (nwritten < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+	  // a client that stops reading is dropped rather than buffered for forever
+	  if (session->output.size() - session->output_sent > kMaxOutput_)
+	    return false;
+	  if (!session->bwaiting_to_write)
+	    {
+	      epoll_event event;
+	      event.events = EPOLLIN | EPOLLOUT;
+	      event.data.ptr = session;
+	      epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+	      session->bwaiting_to_write = true;
+	    }
+	  return true;
+	}
+      if (nwritten < 0)
+	return false;
+      session->output_sent += nwritten;
+    }
+
+  session->output.clear();
+  session->output_sent = 0;
+  if (session->bwaiting_to_write)
+    {
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = session;
+      epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, session->fd, &event);
+      session->bwaiting_to_write = false;
+    }
+  return true;
+}
+
+void MatchServer::Close(Worker* worker, Session* session)
+{
+  if (session->bclosed)
+    return;
+  epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, session->fd, nullptr);
+  close(session->fd);
+  worker->wheel.Cancel(session);
+  worker->closed.push_back(session);
+  session->bclosed = true;
+  session->bplaying = false;
+}
+
+MatchServer::~MatchServer()
+{
+  if (!threads_.empty())
+    Stop();
+  for (auto& listener : listeners_)
+    close(listener->fd);
+  if (!unix_path_.empty())
+    unlink(unix_path_.c_str());
+  for (auto& worker : workers_)
+    close(worker->epoll_fd);
+}
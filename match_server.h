@@ -0,0 +1,177 @@
+#ifndef MATCH_SERVER_H
+#define MATCH_SERVER_H
+
+#include "game.h"
+#include "leaderboard.h"
+#include "metrics.h"
+#include "playfield.h"
+#include "timer_wheel.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Hosts many independent games over TCP or UNIX sockets.
+  Each worker thread is pinned to a core and owns its own epoll set,
+  all of them waiting on the listening sockets. The worker that
+  accepts a connection keeps it for good, so a session's game is only
+  ever touched by one thread. Workers run at 60 Hz, but a game is
+  only woken on a timer wheel for the frames where something happens:
+  gravity moving the piece, the piece locking, the end of a line clear
+  pause, or keys to deliver. The idle frames in between are skipped in
+  one step. Each keys message is one frame of input; messages that come
+  in faster than that wait their turn, one per frame, so two taps are
+  two moves and left then right doesn't cancel out.
+
+  Client to server, one message per line:
+    start <seed>      begins a new game at level 1
+    keys <keys>       inputs for the next frame: L left, R right, X rotate right,
+                      Z rotate left, D soft drop, H hard drop, C hold
+    board             asks for the locked cells
+    name <name>       the name finished games go on the leaderboard under
+    top <board> <n>   asks for the best n games on the score, lines or sprint board
+    quit
+  Server to client:
+    piece <count> <falling> <next> <held> <lines> <score>   a new piece is in play
+    over <lines> <score>                                    the game ended
+    place <n>                                               where it ranks on the score board
+    top <board> <count> <name> <value>...                   best first
+    board <row>...                                          rows bottom first in hex
+  Pieces are letters from IJLOSTZ, or - for none. Place and top are
+  only sent when the server keeps a leaderboard.
+*/
+
+struct MatchServerStats
+{
+  GLint sessions;
+  // game frames played, and the Updates it took to play them
+  uint64_t frames;
+  uint64_t updates;
+  uint64_t messages;
+  // longest a worker spent on one tick since the last call, in seconds
+  double slowest_tick;
+};
+
+class MatchServer
+{
+public:
+  // 0 uses one worker per hardware thread
+  explicit MatchServer(GLint nworkers = 0);
+
+  bool ListenTcp(uint16_t port);
+  // Finished games go on the leaderboard from here on; set before Start
+  void SetLeaderboard(Leaderboard* leaderboard) { leaderboard_ = leaderboard; }
+  bool ListenUnix(const std::string& path);
+  const std::string& Error() const { return error_; }
+
+  // Starts the workers and returns straight away
+  void Start();
+  void Stop();
+  // Counters since the last call
+  MatchServerStats Stats();
+
+  virtual ~MatchServer();
+private:
+  MatchServer(const MatchServer&);
+  void operator=(const MatchServer&);
+
+  struct Socket
+  {
+    int fd;
+    bool blistener;
+  };
+
+  struct Session : Socket, TimerNode
+  {
+    Session(int socket_fd, GLint nrows, GLint ncols);
+    // Readies a closed session for a new connection, keeping its buffers
+    void Reset(int socket_fd);
+
+    PlayField playfield;
+    Game game;
+    std::string input;
+    std::string output;
+    size_t output_sent;
+    // position in the worker's sessions
+    size_t index;
+    // GameInput bits from keys messages, one entry per frame, oldest first
+    std::vector<GLuint> keys;
+    size_t keys_delivered;
+    GLuint pieces_reported;
+    // the game's lock count GameMetrics has seen
+    GLuint pieces_recorded;
+    // tick of the game's last Update
+    uint64_t last_frame;
+    uint64_t start_frame;
+    uint32_t seed;
+    // 0 until the game clears the sprint lines
+    uint32_t sprint_ms;
+    char name[16];
+    bool bplaying;
+    bool bwaiting_to_write;
+    // queued for the write at the end of the tick
+    bool bdirty;
+    bool bclosed;
+  };
+
+  struct Worker
+  {
+    int epoll_fd;
+    GLint core;
+    std::vector< std::unique_ptr<Session> > sessions;
+    // closed sessions kept for the next connections, so churn doesn't go back to the heap
+    std::vector< std::unique_ptr<Session> > spare;
+    std::vector<Session*> dirty;
+    std::vector<Session*> closed;
+    TimerWheel wheel;
+    std::vector<TimerNode*> due;
+    std::vector<LeaderboardEntry> top;
+    std::atomic<uint64_t> frames;
+    std::atomic<uint64_t> updates;
+    std::atomic<uint64_t> messages;
+    std::atomic<uint64_t> slowest_tick_ns;
+  };
+
+  bool Listen(int fd, const std::string& what);
+  void WorkerLoop(Worker* worker);
+  void Accept(Worker* worker, int listen_fd);
+  void Read(Worker* worker, Session* session);
+  void Handle(Worker* worker, Session* session, const std::string& line);
+  void Tick(Worker* worker);
+  void Step(Worker* worker, Session* session);
+  void MarkDirty(Worker* worker, Session* session);
+  bool Flush(Worker* worker, Session* session);
+  void Close(Worker* worker, Session* session);
+
+  std::vector< std::unique_ptr<Socket> > listeners_;
+  std::vector< std::unique_ptr<Worker> > workers_;
+  std::vector<std::thread> threads_;
+  Leaderboard* leaderboard_;
+  std::atomic<GLint> nsessions_;
+  GameMetrics game_metrics_;
+  MetricGauge& sessions_metric_;
+  MetricHistogram& tick_metric_;
+  std::atomic<bool> bstop_;
+  std::string error_;
+  std::string unix_path_;
+
+  static const GLint kNumRows_;
+  static const GLint kNumCols_;
+  static const double kTickSeconds_;
+  static const GLint kMaxCatchUpTicks_;
+  static const size_t kMaxLineLength_;
+  static const size_t kMaxOutput_;
+  static const size_t kMaxSpareSessions_;
+  static const size_t kMaxSpareBuffer_;
+  static const GLuint kSprintLines_;
+  static const size_t kMaxTopEntries_;
+  static const size_t kMaxQueuedKeys_;
+};
+
+
+#endif // MATCH_SERVER_H
@@ -0,0 +1,474 @@
+#include "mcts.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+const GLint MonteCarloSearch::kMaxPathLength_ = 64;
+// deep enough to reach the position after the played piece and the revealed one
+const GLint MonteCarloSearch::kReuseDepth_ = 3;
+const double MonteCarloSearch::kGameOverValue_ = -1e3;
+
+enum NodeState
+  {
+    kLeaf,
+    kExpanding,
+    kExpanded,
+    kTerminal
+  };
+
+MonteCarloSearch::MonteCarloSearch(const Evaluator& evaluator, const Randomizer& randomizer, ThreadPool* pool) : evaluator_(evaluator),
+														 randomizer_(randomizer),
+														 pool_(pool),
+														 time_budget_(0.1),
+														 root_trees_(2),
+														 rollout_depth_(8),
+														 rollout_policy_(kHeuristicRollout),
+														 exploration_(0.5),
+														 nodes_per_tree_(1 << 16),
+														 searches_(0),
+														 rollouts_(0),
+														 rollout_pieces_(0)
+{ }
+
+bool MonteCarloSearch::Search(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold, Placement* best)
+{
+  deadline_ = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget_));
+  ++searches_;
+  
+  double cumulative = 0;
+  for (GLint type = kTetroI; type <= kTetroZ; ++type)
+    {
+      cumulative += randomizer_.Probability(static_cast<TetroType>(type));
+      piece_cdf_[type] = cumulative;
+    }
+
+  const GLint nthreads = pool_->NumThreads();
+  const GLint ntrees = std::max(1, std::min(root_trees_, nthreads));
+  while (static_cast<GLint>(trees_.size()) < ntrees)
+    {
+      trees_.push_back(std::unique_ptr<Tree>(new Tree));
+      std::vector<Node>(nodes_per_tree_).swap(trees_.back()->nodes);
+      std::vector<Node>(nodes_per_tree_).swap(trees_.back()->previous);
+      trees_.back()->bprevious = false;
+    }
+  for (GLint i = 0; i < ntrees; ++i)
+    {
+      Tree& tree = *trees_[i];
+      // the last search's nodes go to previous, and the ones before become scratch
+      tree.nodes.swap(tree.previous);
+      if (tree.nodes.size() != nodes_per_tree_)
+	std::vector<Node>(nodes_per_tree_).swap(tree.nodes);
+      // only a change of SetNodesPerTree makes the last tree unusable
+      if (tree.previous.size() != nodes_per_tree_)
+	tree.bprevious = false;
+      double min_value = tree.min_value, max_value = tree.max_value;
+      ExpandRoot(tree, board, current, next, held, can_hold);
+      if (tree.bprevious && tree.nodes[0].state == kExpanded)
+	ReuseSubtrees(tree, min_value, max_value);
+      tree.bprevious = true;
+    }
+  if (trees_[0]->nodes[0].state == kTerminal)
+    return false;
+
+  workers_.resize(nthreads);
+  for (GLint i = 0; i < nthreads; ++i)
+    {
+      workers_[i].rng.seed(searches_ * 7919 + i + 1);
+      workers_[i].placements.reserve(4 * BitBoard::kMaxCols);
+      workers_[i].rollouts = 0;
+      workers_[i].rollout_pieces = 0;
+    }
+
+  pool_->ParallelFor(nthreads, [&](GLint i)
+		     {
+		       Tree& tree = *trees_[i % ntrees];
+		       Worker& worker = workers_[i];
+		       while (std::chrono::steady_clock::now() < deadline_)
+			 Iterate(tree, worker);
+		     });
+
+  rollouts_ = 0;
+  rollout_pieces_ = 0;
+  for (const Worker& worker : workers_)
+    {
+      rollouts_ += worker.rollouts;
+      rollout_pieces_ += worker.rollout_pieces;
+    }
+
+  // every tree expanded the root the same way, so children line up by index
+  const Node& root = trees_[0]->nodes[0];
+  GLuint best_child = 0, best_visits = 0;
+  for (GLuint child = 0; child < root.nchildren; ++child)
+    {
+      GLuint visits = 0;
+      for (GLint i = 0; i < ntrees; ++i)
+	visits += trees_[i]->nodes[root.first_child + child].visits;
+      if (visits > best_visits || child == 0)
+	{
+	  best_visits = visits;
+	  best_child = child;
+	}
+    }
+  *best = trees_[0]->nodes[root.first_child + best_child].move;
+  return true;
+}
+
+void MonteCarloSearch::InitNode(Node& node, const BitBoard& board, TetroType piece, TetroType next)
+{
+  node.board = board;
+  node.piece = piece;
+  node.next = next;
+  node.reward = 0;
+  node.visits = 0;
+  node.virtual_loss = 0;
+  node.value_sum = 0;
+  node.state = kLeaf;
+  node.first_child = 0;
+  node.nchildren = 0;
+}
+
+void MonteCarloSearch::ExpandRoot(Tree& tree, const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold)
+{
+  std::vector<Placement> candidates;
+  GeneratePlacements(board, current, &candidates);
+
+  // holding swaps in the held piece, or the next piece if nothing is held yet
+  TetroType hold_piece = held != kNone ? held : next;
+  TetroType hold_next = held != kNone ? next : kNone;
+  if (can_hold && hold_piece != kNone && hold_piece != current)
+    {
+      std::vector<Placement> hold_candidates;
+      GeneratePlacements(board, hold_piece, &hold_candidates);
+      for (Placement& placement : hold_candidates)
+	placement.hold = true;
+      candidates.insert(candidates.end(), hold_candidates.begin(), hold_candidates.end());
+    }
+
+  Node& root = tree.nodes[0];
+  InitNode(root, board, current, next);
+  tree.used = 1 + candidates.size();
+  tree.min_value = 0;
+  tree.max_value = 0;
+  if (candidates.empty() || tree.used > tree.nodes.size())
+    {
+      root.state = kTerminal;
+      return;
+    }
+
+  root.first_child = 1;
+  root.nchildren = candidates.size();
+  for (GLuint i = 0; i < root.nchildren; ++i)
+    {
+      const Placement& placement = candidates[i];
+      Node& child = tree.nodes[root.first_child + i];
+      InitNode(child, board, placement.hold ? hold_next : next, kNone);
+      child.move = placement;
+      child.reward = evaluator_.LineClearReward(child.board.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col));
+    }
+  root.state = kExpanded;
+}
+
+uint64_t MonteCarloSearch::NodeKey(const Node& node)
+{
+  return node.board.Hash() ^ ((static_cast<uint64_t>(node.piece) + 1) * 0x9e3779b97f4a7c15ULL) ^ ((static_cast<uint64_t>(node.next) + 1) * 0xc2b2ae3d27d4eb4fULL);
+}
+
+void MonteCarloSearch::ReuseSubtrees(Tree& tree, double min_value, double max_value)
+{
+  // Index the top of the previous tree. The new root's children are
+  // positions the last search already reached a few plies down, and a
+  // node with the same board and the same known pieces has the same
+  // subtree no matter how it was reached.
+  reuse_index_.clear();
+  copy_stack_.clear();
+  copy_stack_.push_back(std::make_pair(0u, 0u));
+  for (size_t i = 0; i < copy_stack_.size(); ++i)
+    {
+      const Node& node = tree.previous[copy_stack_[i].first];
+      GLuint depth = copy_stack_[i].second;
+      if (depth > 0 && node.visits > 0)
+	reuse_index_.insert(std::make_pair(NodeKey(node), copy_stack_[i].first));
+      if (node.state == kExpanded && depth < static_cast<GLuint>(kReuseDepth_))
+	for (GLuint child = node.first_child; child < node.first_child + node.nchildren; ++child)
+	  copy_stack_.push_back(std::make_pair(child, depth + 1));
+    }
+
+  Node& root = tree.nodes[0];
+  GLuint reused = 0;
+  for (GLuint child = root.first_child; child < root.first_child + root.nchildren; ++child)
+    {
+      const Node& node = tree.nodes[child];
+      std::unordered_map<uint64_t, GLuint>::const_iterator match = reuse_index_.find(NodeKey(node));
+      if (match == reuse_index_.end())
+	continue;
+      const Node& old = tree.previous[match->second];
+      if (old.piece != node.piece || old.next != node.next || old.board != node.board)
+	continue;
+      CopySubtree(tree, match->second, child);
+      root.visits += node.visits;
+      AtomicAdd(root.value_sum, node.value_sum);
+      ++reused;
+    }
+
+  // the carried-over values were normalised against the old range
+  if (reused > 0)
+    {
+      AtomicMin(tree.min_value, min_value);
+      AtomicMax(tree.max_value, max_value);
+    }
+}
+
+void MonteCarloSearch::CopySubtree(Tree& tree, GLuint from, GLuint to)
+{
+  copy_stack_.clear();
+  copy_stack_.push_back(std::make_pair(from, to));
+  while (!copy_stack_.empty())
+    {
+      const Node& old = tree.previous[copy_stack_.back().first];
+      Node& node = tree.nodes[copy_stack_.back().second];
+      copy_stack_.pop_back();
+      
+      node.visits = static_cast<GLuint>(old.visits);
+      node.value_sum = static_cast<double>(old.value_sum);
+      GLint state = old.state;
+      if (state == kTerminal)
+	node.state = kTerminal;
+      if (state != kExpanded)
+	continue;
+      
+      // out of room, so the node keeps its statistics and expands again later
+      GLuint first = tree.used;
+      if (first + old.nchildren > tree.nodes.size())
+	continue;
+      tree.used = first + old.nchildren;
+      for (GLuint i = 0; i < old.nchildren; ++i)
+	{
+	  const Node& old_child = tree.previous[old.first_child + i];
+	  Node& child = tree.nodes[first + i];
+	  InitNode(child, old_child.board, old_child.piece, old_child.next);
+	  child.move = old_child.move;
+	  child.reward = old_child.reward;
+	  copy_stack_.push_back(std::make_pair(old.first_child + i, first + i));
+	}
+      node.first_child = first;
+      node.nchildren = old.nchildren;
+      node.state = kExpanded;
+    }
+}
+
+bool MonteCarloSearch::Expand(Tree& tree, Node& node, Worker& worker)
+{
+  GLint expected = kLeaf;
+  if (!node.state.compare_exchange_strong(expected, kExpanding))
+    return false;
+
+  if (node.piece == kNone)
+    {
+      GLuint first = tree.used.fetch_add(7);
+      if (first + 7 > tree.nodes.size())
+	{
+	  node.state = kLeaf;
+	  return false;
+	}
+      for (GLint type = kTetroI; type <= kTetroZ; ++type)
+	InitNode(tree.nodes[first + type], node.board, static_cast<TetroType>(type), kNone);
+      node.first_child = first;
+      node.nchildren = 7;
+      node.state = kExpanded;
+      return true;
+    }
+
+  GeneratePlacements(node.board, node.piece, &worker.placements);
+  if (worker.placements.empty())
+    {
+      node.state = kTerminal;
+      return true;
+    }
+  
+  GLuint count = worker.placements.size();
+  GLuint first = tree.used.fetch_add(count);
+  if (first + count > tree.nodes.size())
+    {
+      node.state = kLeaf;
+      return false;
+    }
+  for (GLuint i = 0; i < count; ++i)
+    {
+      const Placement& placement = worker.placements[i];
+      Node& child = tree.nodes[first + i];
+      InitNode(child, node.board, node.next, kNone);
+      child.move = placement;
+      child.reward = evaluator_.LineClearReward(child.board.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col));
+    }
+  node.first_child = first;
+  node.nchildren = count;
+  node.state = kExpanded;
+  return true;
+}
+
+void MonteCarloSearch::Iterate(Tree& tree, Worker& worker)
+{
+  GLuint path[kMaxPathLength_];
+  GLint length = 0;
+  path[length++] = 0;
+
+  double value = 0;
+  while (true)
+    {
+      Node& node = tree.nodes[path[length - 1]];
+      GLint state = node.state;
+      if (state == kTerminal)
+	{
+	  value = kGameOverValue_;
+	  break;
+	}
+      if (state == kLeaf && Expand(tree, node, worker))
+	{
+	  value = node.state == kTerminal ? kGameOverValue_ : Rollout(node, worker);
+	  break;
+	}
+      // another thread is expanding this node, or the tree is full
+      if (node.state != kExpanded || length == kMaxPathLength_)
+	{
+	  value = Rollout(node, worker);
+	  break;
+	}
+      GLuint child = SelectChild(tree, node, worker);
+      tree.nodes[child].virtual_loss += 1;
+      path[length++] = child;
+    }
+  Backup(tree, path, length, value);
+}
+
+GLuint MonteCarloSearch::SelectChild(Tree& tree, const Node& node, Worker& worker)
+{
+  if (node.piece == kNone)
+    return node.first_child + SamplePiece(worker);
+
+  const double min_value = tree.min_value;
+  const double range = std::max(1e-9, tree.max_value - min_value);
+  const double log_visits = std::log(static_cast<double>(node.visits + node.virtual_loss + 1));
+  
+  GLuint best = node.first_child;
+  double best_score = -1;
+  for (GLuint child = node.first_child; child < node.first_child + node.nchildren; ++child)
+    {
+      const Node& candidate = tree.nodes[child];
+      GLuint pending = candidate.virtual_loss;
+      GLuint visits = candidate.visits + pending;
+      if (visits == 0)
+	return child;
+      // threads still playing out this child count as losses until they report back
+      double mean = (candidate.value_sum + pending * min_value) / visits;
+      double score = (mean - min_value) / range + exploration_ * std::sqrt(log_visits / visits);
+      if (score > best_score)
+	{
+	  best_score = score;
+	  best = child;
+	}
+    }
+  return best;
+}
+
+double MonteCarloSearch::Rollout(const Node& node, Worker& worker)
+{
+  BitBoard board(node.board);
+  TetroType piece = node.piece != kNone ? node.piece : SamplePiece(worker);
+  TetroType next = node.piece != kNone ? node.next : kNone;
+  double value = 0;
+  ++worker.rollouts;
+  
+  for (GLint depth = 0; depth < rollout_depth_; ++depth)
+    {
+      GeneratePlacements(board, piece, &worker.placements);
+      if (worker.placements.empty())
+	return value + kGameOverValue_;
+
+      const Placement* choice = &worker.placements[0];
+      if (rollout_policy_ == kRandomRollout)
+	{
+	  choice = &worker.placements[worker.rng() % worker.placements.size()];
+	}
+      else
+	{
+	  const GLint count = worker.placements.size();
+	  worker.boards.assign(count, board);
+	  worker.rewards.resize(count);
+	  worker.values.resize(count);
+	  for (GLint i = 0; i < count; ++i)
+	    {
+	      const Placement& placement = worker.placements[i];
+	      worker.rewards[i] = evaluator_.LineClearReward(worker.boards[i].Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col));
+	    }
+	  evaluator_.EvaluateBatch(worker.boards.data(), count, worker.values.data());
+	  
+	  double best_value = -std::numeric_limits<double>::infinity();
+	  for (GLint i = 0; i < count; ++i)
+	    {
+	      double placement_value = worker.rewards[i] + worker.values[i];
+	      if (placement_value > best_value)
+		{
+		  best_value = placement_value;
+		  choice = &worker.placements[i];
+		}
+	    }
+	}
+
+      value += evaluator_.LineClearReward(board.Place(GetPieceMask(choice->type, choice->rotation), choice->row, choice->col));
+      ++worker.rollout_pieces;
+      piece = next != kNone ? next : SamplePiece(worker);
+      next = kNone;
+    }
+  return value + evaluator_.Evaluate(board);
+}
+
+TetroType MonteCarloSearch::SamplePiece(Worker& worker)
+{
+  double roll = std::uniform_real_distribution<double>(0, piece_cdf_[kTetroZ])(worker.rng);
+  GLint type = kTetroI;
+  while (type < kTetroZ && roll >= piece_cdf_[type])
+    ++type;
+  return static_cast<TetroType>(type);
+}
+
+void MonteCarloSearch::Backup(Tree& tree, const GLuint* path, GLint length, double value)
+{
+  AtomicMin(tree.min_value, value);
+  AtomicMax(tree.max_value, value);
+  for (GLint i = length - 1; i >= 0; --i)
+    {
+      Node& node = tree.nodes[path[i]];
+      value += node.reward;
+      AtomicAdd(node.value_sum, value);
+      node.visits += 1;
+      if (i > 0)
+	node.virtual_loss -= 1;
+    }
+}
+
+void MonteCarloSearch::AtomicAdd(std::atomic<double>& target, double value)
+{
+  double current = target;
+  while (!target.compare_exchange_weak(current, current + value))
+    ;
+}
+
+void MonteCarloSearch::AtomicMin(std::atomic<double>& target, double value)
+{
+  double current = target;
+  while (value < current && !target.compare_exchange_weak(current, value))
+    ;
+}
+
+void MonteCarloSearch::AtomicMax(std::atomic<double>& target, double value)
+{
+  double current = target;
+  while (value > current && !target.compare_exchange_weak(current, value))
+    ;
+}
+
+MonteCarloSearch::~MonteCarloSearch()
+{
+  
+}
@@ -0,0 +1,141 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include "bitboard.h"
+#include "evaluator.h"
+#include "randomizer.h"
+#include "thread_pool.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum RolloutPolicy
+  {
+    kRandomRollout,
+    kHeuristicRollout
+  };
+
+/*
+  Monte Carlo tree search over placements.
+  Several independent trees are searched at once (root parallelism)
+  and each tree is shared by a group of threads that steer away from
+  each other with virtual loss. Rollouts play the compact board forward
+  from a leaf and score it with the evaluator. Their visit counts are
+  summed over the trees to pick the move.
+  Each search starts from whatever the last search learned about the
+  position it reached: matching subtrees are carried over to the new
+  root along with their statistics.
+*/
+
+class MonteCarloSearch
+{
+public:
+  MonteCarloSearch(const Evaluator& evaluator, const Randomizer& randomizer, ThreadPool* pool);
+
+  void SetTimeBudget(double seconds) { time_budget_ = seconds; }
+  void SetRootTrees(GLint trees) { root_trees_ = trees; }
+  void SetRolloutDepth(GLint depth) { rollout_depth_ = depth; }
+  void SetRolloutPolicy(RolloutPolicy policy) { rollout_policy_ = policy; }
+  void SetExploration(double exploration) { exploration_ = exploration; }
+  void SetNodesPerTree(GLuint nodes) { nodes_per_tree_ = nodes; }
+
+  // Returns false if the current piece has nowhere to go
+  bool Search(const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold, Placement* best);
+
+  uint64_t Rollouts() const { return rollouts_; }
+  uint64_t RolloutPieces() const { return rollout_pieces_; }
+
+  virtual ~MonteCarloSearch();
+private:
+  // A node with piece == kNone is a chance node with one child per piece type
+  struct Node
+  {
+    BitBoard board;
+    Placement move;
+    TetroType piece;
+    TetroType next;
+    double reward;
+    
+    std::atomic<GLuint> visits;
+    std::atomic<GLuint> virtual_loss;
+    std::atomic<double> value_sum;
+    std::atomic<GLint> state;
+    GLuint first_child;
+    GLuint nchildren;
+  };
+
+  struct Tree
+  {
+    std::vector<Node> nodes;
+    // the previous search's nodes, kept so they can be reused
+    std::vector<Node> previous;
+    bool bprevious;
+    std::atomic<GLuint> used;
+    std::atomic<double> min_value;
+    std::atomic<double> max_value;
+  };
+
+  // Scratch space owned by one thread so a playout never allocates
+  struct Worker
+  {
+    std::minstd_rand rng;
+    std::vector<Placement> placements;
+    // candidate boards for the heuristic rollout, scored as one batch
+    std::vector<BitBoard> boards;
+    std::vector<double> rewards;
+    std::vector<double> values;
+    uint64_t rollouts;
+    uint64_t rollout_pieces;
+  };
+  
+  void ExpandRoot(Tree& tree, const BitBoard& board, TetroType current, TetroType next, TetroType held, bool can_hold);
+  void ReuseSubtrees(Tree& tree, double min_value, double max_value);
+  void CopySubtree(Tree& tree, GLuint from, GLuint to);
+  static uint64_t NodeKey(const Node& node);
+  void InitNode(Node& node, const BitBoard& board, TetroType piece, TetroType next);
+  void Iterate(Tree& tree, Worker& worker);
+  GLuint SelectChild(Tree& tree, const Node& node, Worker& worker);
+  bool Expand(Tree& tree, Node& node, Worker& worker);
+  double Rollout(const Node& node, Worker& worker);
+  TetroType SamplePiece(Worker& worker);
+  void Backup(Tree& tree, const GLuint* path, GLint length, double value);
+  
+  static void AtomicAdd(std::atomic<double>& target, double value);
+  static void AtomicMin(std::atomic<double>& target, double value);
+  static void AtomicMax(std::atomic<double>& target, double value);
+
+  const Evaluator& evaluator_;
+  const Randomizer& randomizer_;
+  ThreadPool* pool_;
+
+  double time_budget_;
+  GLint root_trees_;
+  GLint rollout_depth_;
+  RolloutPolicy rollout_policy_;
+  double exploration_;
+  GLuint nodes_per_tree_;
+
+  std::vector< std::unique_ptr<Tree> > trees_;
+  std::vector<Worker> workers_;
+  std::unordered_map<uint64_t, GLuint> reuse_index_;
+  std::vector< std::pair<GLuint, GLuint> > copy_stack_;
+  std::chrono::steady_clock::time_point deadline_;
+  double piece_cdf_[7];
+  GLuint searches_;
+  uint64_t rollouts_;
+  uint64_t rollout_pieces_;
+
+  static const GLint kMaxPathLength_;
+  static const GLint kReuseDepth_;
+  static const double kGameOverValue_;
+};
+
+
+#endif // MCTS_H
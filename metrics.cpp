@@ -0,0 +1,318 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+const size_t MetricsServer::kMaxRequest_ = 4096;
+
+GLint NextMetricShard()
+{
+  static std::atomic<GLint> next(0);
+  return next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+}
+
+void* MetricAllocation::operator new(size_t size)
+{
+  void* memory;
+  if (posix_memalign(&memory, 64, size) != 0)
+    throw std::bad_alloc();
+  return memory;
+}
+
+void MetricAllocation::operator delete(void* memory)
+{
+  free(memory);
+}
+
+MetricCounter::MetricCounter()
+{
+  for (Shard& shard : shards_)
+    shard.value = 0;
+}
+
+uint64_t MetricCounter::Value() const
+{
+  uint64_t value = 0;
+  for (const Shard& shard : shards_)
+    value += shard.value.load(std::memory_order_relaxed);
+  return value;
+}
+
+MetricHistogram::MetricHistogram(const std::vector<uint64_t>& bounds) : nbounds_(std::min<GLint>(bounds.size(), kMetricMaxBuckets))
+{
+  std::copy(bounds.begin(), bounds.begin() + nbounds_, bounds_);
+  for (Shard& shard : shards_)
+    {
+      for (auto& count : shard.counts)
+	count = 0;
+      shard.sum = 0;
+    }
+}
+
+void MetricHistogram::Counts(uint64_t counts[kMetricMaxBuckets + 1], uint64_t* sum) const
+{
+  std::fill(counts, counts + kMetricMaxBuckets + 1, 0);
+  *sum = 0;
+  for (const Shard& shard : shards_)
+    {
+      for (GLint bucket = 0; bucket <= nbounds_; ++bucket)
+	counts[bucket] += shard.counts[bucket].load(std::memory_order_relaxed);
+      *sum += shard.sum.load(std::memory_order_relaxed);
+    }
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+}
+
+MetricsRegistry::Metric* MetricsRegistry::Find(const std::string& name, const std::string& help, MetricType type,
+					       double scale, const std::string& labels)
+{
+  Family* family = nullptr;
+  for (auto& candidate : families_)
+    if (candidate->name == name)
+      family = candidate.get();
+  if (!family)
+    {
+      families_.push_back(std::unique_ptr<Family>(new Family));
+      family = families_.back().get();
+      family->name = name;
+      family->help = help;
+      family->type = type;
+      family->scale = scale;
+    }
+  for (auto& metric : family->metrics)
+    if (metric->labels == labels)
+      return metric.get();
+  family->metrics.push_back(std::unique_ptr<Metric>(new Metric));
+  family->metrics.back()->labels = labels;
+  return family->metrics.back().get();
+}
+
+MetricCounter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help, const std::string& labels)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Metric* metric = Find(name, help, kCounter, 1, labels);
+  if (!metric->counter)
+    metric->counter.reset(new MetricCounter);
+  return *metric->counter;
+}
+
+MetricGauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Metric* metric = Find(name, help, kGauge, 1, labels);
+  if (!metric->gauge)
+    metric->gauge.reset(new MetricGauge);
+  return *metric->gauge;
+}
+
+MetricHistogram& MetricsRegistry::GetHistogram(const std::string& name, const std::string& help, const std::vector<uint64_t>& bounds,
+					       double scale, const std::string& labels)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Metric* metric = Find(name, help, kHistogram, scale, labels);
+  if (!metric->histogram)
+    metric->histogram.reset(new MetricHistogram(bounds));
+  return *metric->histogram;
+}
+
+std::string MetricsRegistry::Render() const
+{
+  static const char* kTypeNames[] = { "counter", "gauge", "histogram" };
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string text;
+  char line[256];
+  for (const auto& family : families_)
+    {
+      text += "# HELP " + family->name + " " + family->help + "\n";
+      text += "# TYPE " + family->name + " " + kTypeNames[family->type] + "\n";
+      for (const auto& metric : family->metrics)
+	{
+	  std::string labels = metric->labels.empty() ? "" : "{" + metric->labels + "}";
+	  if (metric->counter)
+	    {
+	      snprintf(line, sizeof(line), " %llu\n", static_cast<unsigned long long>(metric->counter->Value()));
+	      text += family->name + labels + line;
+	    }
+	  else if (metric->gauge)
+	    {
+	      snprintf(line, sizeof(line), " %lld\n", static_cast<long long>(metric->gauge->Value()));
+	      text += family->name + labels + line;
+	    }
+	  else if (metric->histogram)
+	    {
+	      const MetricHistogram& histogram = *metric->histogram;
+	      uint64_t counts[kMetricMaxBuckets + 1], sum, total = 0;
+	      histogram.Counts(counts, &sum);
+	      std::string prefix = metric->labels.empty() ? "{" : "{" + metric->labels + ",";
+	      // buckets are cumulative in the text format
+	      for (GLint bucket = 0; bucket <= histogram.NumBounds(); ++bucket)
+		{
+		  total += counts[bucket];
+		  if (bucket < histogram.NumBounds())
+		    snprintf(line, sizeof(line), "le=\"%g\"} %llu\n", histogram.Bound(bucket) * family->scale, static_cast<unsigned long long>(total));
+		  else
+		    snprintf(line, sizeof(line), "le=\"+Inf\"} %llu\n", static_cast<unsigned long long>(total));
+		  text += family->name + "_bucket" + prefix + line;
+		}
+	      snprintf(line, sizeof(line), " %g\n", sum * family->scale);
+	      text += family->name + "_sum" + labels + line;
+	      snprintf(line, sizeof(line), " %llu\n", static_cast<unsigned long long>(total));
+	      text += family->name + "_count" + labels + line;
+	    }
+	}
+    }
+  return text;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+}
+
+MetricsRegistry& Metrics()
+{
+  static MetricsRegistry registry;
+  return registry;
+}
+
+GameMetrics::GameMetrics() : update_ns_(Metrics().GetHistogram("tetris_game_update_seconds", "Time spent in Game::Update.",
+								 { 250, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 1000000 }, 1e-9)),
+			     pieces_(Metrics().GetCounter("tetris_pieces_total", "Pieces locked.")),
+			     lock_delay_(Metrics().GetHistogram("tetris_lock_delay_frames", "Frames a piece sat on the stack before locking.",
+								{ 0, 5, 10, 15, 20, 25, 30 }))
+{
+  for (GLint lines = 1; lines <= 4; ++lines)
+    line_clears_[lines - 1] = &Metrics().GetCounter("tetris_line_clears_total", "Line clears by the number of lines cleared at once.",
+						    "lines=\"" + std::to_string(lines) + "\"");
+}
+
+void GameMetrics::RecordUpdate(const Game& game, uint64_t update_ns, GLuint* pieces_seen)
+{
+  update_ns_.Observe(update_ns);
+  // a restart starts the count again
+  if (game.PiecesLocked() < *pieces_seen)
+    *pieces_seen = 0;
+  if (game.PiecesLocked() == *pieces_seen)
+    return;
+  pieces_.Add(game.PiecesLocked() - *pieces_seen);
+  *pieces_seen = game.PiecesLocked();
+
+  const LockResult& lock = game.LastLock();
+  lock_delay_.Observe(lock.lock_frames);
+  if (lock.lines > 0)
+    line_clears_[std::min(lock.lines, 4) - 1]->Add();
+}
+
+MetricsServer::MetricsServer() : listen_fd_(-1),
+				 bstop_(false)
+{
+}
+
+bool MetricsServer::Start(uint16_t port)
+{
+  listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0)
+    {
+      error_ = std::string("metrics socket: ") + strerror(errno);
+      return false;
+    }
+  int on = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  // only for scrapers on this machine
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_fd_, 16) != 0)
+    {
+      error_ = "metrics port " + std::to_string(port) + ": " + strerror(errno);
+      close(listen_fd_);
+      listen_fd_ = -1;
+      return false;
+    }
+  bstop_ = false;
+  thread_ = std::thread(&MetricsServer::Serve, this);
+  return true;
+}
+
+void MetricsServer::Stop()
+{
+  if (!thread_.joinable())
+    return;
+  bstop_ = true;
+  thread_.join();
+  close(listen_fd_);
+  listen_fd_ = -1;
+}
+
+void MetricsServer::Serve()
+{
+  pollfd listener = { listen_fd_, POLLIN, 0 };
+  while (!bstop_)
+    {
+      // wakes now and then to see if it should stop
+      if (poll(&listener, 1, 200) <= 0)
+	continue;
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+	continue;
+      // a scraper that stalls mustn't hold up the next one for long
+      timeval timeout = { 1, 0 };
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      Respond(fd);
+      close(fd);
+    }
+}
+
+void MetricsServer::Respond(int fd)
+{
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequest_)
+    {
+      ssize_t nread = read(fd, buffer, sizeof(buffer));
+      if (nread < 0 && errno == EINTR)
+	continue;
+      if (nread <= 0)
+	return;
+      request.append(buffer, nread);
+    }
+
+  std::string status = "200 OK", body;
+  if (request.compare(0, 13, "GET /metrics ") == 0)
+    body = Metrics().Render();
+  else if (request.compare(0, 4, "GET ") == 0)
+    status = "404 Not Found";
+  else
+    status = "405 Method Not Allowed";
+
+  std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+    std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+  size_t sent = 0;
+  while (sent < response.size())
+    {
+      ssize_t nwritten = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+      if (nwritten < 0 && errno == EINTR)
+	continue;
+      if (nwritten <= 0)
+	return;
+      sent += nwritten;
+    }
+}
+
+MetricsServer::~MetricsServer()
+{
+  Stop();
+}
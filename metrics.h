@@ -0,0 +1,196 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "game.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+const GLint kMetricShards = 16;
+const GLint kMetricMaxBuckets = 16;
+
+GLint NextMetricShard();
+
+// The shard this thread records into, handed out round robin on first use
+inline GLint MetricShard()
+{
+  static thread_local GLint shard = NextMetricShard();
+  return shard;
+}
+
+// Heap allocation on a cache line, which a plain new doesn't promise for alignas types before C++17
+struct MetricAllocation
+{
+  static void* operator new(size_t size);
+  static void operator delete(void* memory);
+};
+
+class MetricCounter : public MetricAllocation
+{
+public:
+  MetricCounter();
+  void Add(uint64_t n = 1) { shards_[MetricShard()].value.fetch_add(n, std::memory_order_relaxed); }
+  uint64_t Value() const;
+private:
+  struct alignas(64) Shard
+  {
+    std::atomic<uint64_t> value;
+  };
+  Shard shards_[kMetricShards];
+};
+
+// A value that goes up and down, such as how many sessions are open
+class MetricGauge
+{
+public:
+  MetricGauge() : value_(0) { }
+  void Set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+  int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+private:
+  std::atomic<int64_t> value_;
+};
+
+// Counts of recorded values at or below each bound, in whole units such as nanoseconds
+class MetricHistogram : public MetricAllocation
+{
+public:
+  explicit MetricHistogram(const std::vector<uint64_t>& bounds);
+  void Observe(uint64_t value)
+  {
+    GLint bucket = 0;
+    while (bucket < nbounds_ && value > bounds_[bucket])
+      ++bucket;
+    Shard& shard = shards_[MetricShard()];
+    shard.counts[bucket].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+  GLint NumBounds() const { return nbounds_; }
+  uint64_t Bound(GLint bucket) const { return bounds_[bucket]; }
+  // Per bucket counts, the last one for values past every bound
+  void Counts(uint64_t counts[kMetricMaxBuckets + 1], uint64_t* sum) const;
+private:
+  struct alignas(64) Shard
+  {
+    std::atomic<uint64_t> counts[kMetricMaxBuckets + 1];
+    std::atomic<uint64_t> sum;
+  };
+  GLint nbounds_;
+  uint64_t bounds_[kMetricMaxBuckets];
+  Shard shards_[kMetricShards];
+};
+
+/*
+  Process wide metrics in the Prometheus text format.
+  Recording is a relaxed add into the recording thread's own shard,
+  so threads never share a cache line and nothing takes a lock; the
+  shards are only summed when the metrics are scraped. Metrics are
+  looked up by name and labels once, usually into a static beside the
+  code that records them, and live as long as the process.
+*/
+
+class MetricsRegistry
+{
+public:
+  MetricsRegistry();
+
+  // Finds or makes a metric. Labels are a Prometheus label list such as lines="4", or empty.
+  MetricCounter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = "");
+  MetricGauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = "");
+  // Recorded values are multiplied by scale when scraped, so nanoseconds can be shown as seconds
+  MetricHistogram& GetHistogram(const std::string& name, const std::string& help, const std::vector<uint64_t>& bounds,
+				double scale = 1, const std::string& labels = "");
+
+  std::string Render() const;
+
+  virtual ~MetricsRegistry();
+private:
+  MetricsRegistry(const MetricsRegistry&);
+  void operator=(const MetricsRegistry&);
+
+  enum MetricType
+    {
+      kCounter,
+      kGauge,
+      kHistogram
+    };
+
+  struct Metric
+  {
+    std::string labels;
+    std::unique_ptr<MetricCounter> counter;
+    std::unique_ptr<MetricGauge> gauge;
+    std::unique_ptr<MetricHistogram> histogram;
+  };
+
+  // Metrics sharing a name, which are rendered together
+  struct Family
+  {
+    std::string name;
+    std::string help;
+    MetricType type;
+    double scale;
+    std::vector< std::unique_ptr<Metric> > metrics;
+  };
+
+  // With the mutex held
+  Metric* Find(const std::string& name, const std::string& help, MetricType type, double scale, const std::string& labels);
+
+  mutable std::mutex mutex_;
+  std::vector< std::unique_ptr<Family> > families_;
+};
+
+MetricsRegistry& Metrics();
+
+// The counters every game host keeps, fed from outside Game so replays and search don't count
+class GameMetrics
+{
+public:
+  GameMetrics();
+  // After each Update of a game; pieces_seen is the game's lock count at the last call
+  void RecordUpdate(const Game& game, uint64_t update_ns, GLuint* pieces_seen);
+private:
+  MetricHistogram& update_ns_;
+  MetricCounter& pieces_;
+  MetricHistogram& lock_delay_;
+  MetricCounter* line_clears_[4];
+};
+
+/*
+  Answers GET /metrics on a loopback port with Metrics().Render(),
+  one connection at a time from its own thread.
+*/
+
+class MetricsServer
+{
+public:
+  MetricsServer();
+
+  bool Start(uint16_t port);
+  void Stop();
+  const std::string& Error() const { return error_; }
+
+  virtual ~MetricsServer();
+private:
+  MetricsServer(const MetricsServer&);
+  void operator=(const MetricsServer&);
+
+  void Serve();
+  void Respond(int fd);
+
+  int listen_fd_;
+  std::atomic<bool> bstop_;
+  std::thread thread_;
+  std::string error_;
+
+  static const size_t kMaxRequest_;
+};
+
+
+#endif // METRICS_H
@@ -0,0 +1,304 @@
+#include "nn_evaluator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NN_VECTOR_KERNELS 1
+#endif
+
+const GLint NetworkEvaluator::kBatchBlock_ = 64;
+const GLint NetworkEvaluator::kVectorWidth_ = 8;
+
+struct NetworkHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t nrows;
+  uint32_t ncols;
+  uint32_t nlayers;
+};
+
+struct NetworkLayerHeader
+{
+  uint32_t noutputs;
+  uint32_t activation;
+  uint32_t type;
+};
+
+namespace
+{
+  // Adds the lanes in the same pairs as HorizontalSum
+  float LaneSum(const float lanes[8])
+  {
+    return ((lanes[0] + lanes[4]) + (lanes[2] + lanes[6])) + ((lanes[1] + lanes[5]) + (lanes[3] + lanes[7]));
+  }
+
+  // Works each sum the way ForwardAvx2 does, in eight lanes of fused
+  // multiply-adds, so the two give the same scores to the last bit and
+  // searches break ties the same way on every CPU
+  void ForwardScalar(const float* weights, const int8_t* quantized, const float* scales, const float* bias, GLint stride, GLint noutputs,
+		     const float* inputs, GLint input_stride, GLint count, float* outputs, GLint output_stride)
+  {
+    for (GLint o = 0; o < noutputs; ++o)
+      {
+	for (GLint b = 0; b < count; ++b)
+	  {
+	    const float* x = inputs + b * input_stride;
+	    float lanes[8] = { 0 };
+	    for (GLint k = 0; k < stride; k += 8)
+	      {
+		for (GLint lane = 0; lane < 8; ++lane)
+		  {
+		    GLint index = o * stride + k + lane;
+		    float w = quantized ? static_cast<float>(quantized[index]) : weights[index];
+		    lanes[lane] = std::fma(w, x[k + lane], lanes[lane]);
+		  }
+	      }
+	    outputs[b * output_stride + o] = std::fma(LaneSum(lanes), quantized ? scales[o] : 1, bias[o]);
+	  }
+      }
+  }
+
+#ifdef NN_VECTOR_KERNELS
+  __attribute__((target("avx2,fma")))
+  float HorizontalSum(__m256 v)
+  {
+    __m128 low = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    low = _mm_add_ps(low, _mm_movehl_ps(low, low));
+    low = _mm_add_ss(low, _mm_movehdup_ps(low));
+    return _mm_cvtss_f32(low);
+  }
+
+  __attribute__((target("avx2,fma")))
+  __m256 LoadWeights(const float* weights, const int8_t* quantized, GLint index)
+  {
+    if (quantized)
+      return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(quantized + index))));
+    return _mm256_loadu_ps(weights + index);
+  }
+
+  // Four outputs for two boards are computed together so every load
+  // feeds several multiplies, and the whole batch is swept before
+  // moving on so those four weight rows stay in L1.
+  __attribute__((target("avx2,fma")))
+  void ForwardAvx2(const float* weights, const int8_t* quantized, const float* scales, const float* bias, GLint stride, GLint noutputs,
+		   const float* inputs, GLint input_stride, GLint count, float* outputs, GLint output_stride)
+  {
+    GLint o = 0;
+    for ( ; o + 4 <= noutputs; o += 4)
+      {
+	// two boards at a time, so each weight vector loaded feeds two multiplies
+	for (GLint b = 0; b < count; b += 2)
+	  {
+	    const float* x0 = inputs + b * input_stride;
+	    const float* x1 = b + 1 < count ? x0 + input_stride : x0;
+	    __m256 sum[2][4];
+	    for (GLint i = 0; i < 4; ++i)
+	      sum[0][i] = sum[1][i] = _mm256_setzero_ps();
+	    for (GLint k = 0; k < stride; k += 8)
+	      {
+		__m256 xk0 = _mm256_loadu_ps(x0 + k), xk1 = _mm256_loadu_ps(x1 + k);
+		for (GLint i = 0; i < 4; ++i)
+		  {
+		    __m256 w = LoadWeights(weights, quantized, (o + i) * stride + k);
+		    sum[0][i] = _mm256_fmadd_ps(w, xk0, sum[0][i]);
+		    sum[1][i] = _mm256_fmadd_ps(w, xk1, sum[1][i]);
+		  }
+	      }
+	    for (GLint j = 0; j < 2 && b + j < count; ++j)
+	      {
+		float* y = outputs + (b + j) * output_stride + o;
+		for (GLint i = 0; i < 4; ++i)
+		  y[i] = std::fma(HorizontalSum(sum[j][i]), quantized ? scales[o + i] : 1, bias[o + i]);
+	      }
+	  }
+      }
+    for ( ; o < noutputs; ++o)
+      {
+	for (GLint b = 0; b < count; ++b)
+	  {
+	    const float* x = inputs + b * input_stride;
+	    __m256 sum = _mm256_setzero_ps();
+	    for (GLint k = 0; k < stride; k += 8)
+	      sum = _mm256_fmadd_ps(LoadWeights(weights, quantized, o * stride + k), _mm256_loadu_ps(x + k), sum);
+	    outputs[b * output_stride + o] = std::fma(HorizontalSum(sum), quantized ? scales[o] : 1, bias[o]);
+	  }
+      }
+  }
+#endif
+
+  GLint PadToVector(GLint size, GLint width)
+  {
+    return (size + width - 1) / width * width;
+  }
+}
+
+NetworkEvaluator::NetworkEvaluator(const EvalWeights& weights) : Evaluator(weights),
+								 nrows_(0),
+								 ncols_(0),
+								 ninputs_(0),
+								 bvector_kernels_(false)
+{
+#ifdef NN_VECTOR_KERNELS
+  bvector_kernels_ = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+bool NetworkEvaluator::Load(const std::string& filename)
+{
+  layers_.clear();
+  FILE* file = std::fopen(filename.c_str(), "rb");
+  if (!file)
+    return false;
+
+  NetworkHeader header;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.magic, "TETRISNN", 8) == 0 && header.version == 1
+    && header.nrows > 0 && header.nrows <= BitBoard::kMaxRows && header.ncols > 0 && header.ncols <= BitBoard::kMaxCols && header.nlayers > 0;
+  std::vector<Layer> layers;
+  GLint ninputs = header.nrows * header.ncols + kNumEvalFeatures;
+  for (uint32_t i = 0; ok && i < header.nlayers; ++i)
+    {
+      NetworkLayerHeader layer_header;
+      ok = std::fread(&layer_header, sizeof(layer_header), 1, file) == 1 && layer_header.noutputs > 0 && layer_header.noutputs <= (1 << 16)
+	&& layer_header.activation <= 1 && layer_header.type <= 1;
+      if (!ok)
+	break;
+
+      layers.push_back(Layer());
+      Layer& layer = layers.back();
+      layer.ninputs = i == 0 ? ninputs : layers[i - 1].noutputs;
+      layer.noutputs = layer_header.noutputs;
+      layer.stride = PadToVector(layer.ninputs, kVectorWidth_);
+      layer.relu = layer_header.activation == 1;
+      layer.quantized = layer_header.type == 1;
+      layer.bias.resize(layer.noutputs);
+      
+      // read row by row into the padded layout
+      if (layer.quantized)
+	{
+	  layer.scales.resize(layer.noutputs);
+	  layer.quantized_weights.assign(layer.noutputs * layer.stride, 0);
+	  ok = std::fread(layer.scales.data(), sizeof(float), layer.noutputs, file) == static_cast<size_t>(layer.noutputs);
+	  for (GLint o = 0; ok && o < layer.noutputs; ++o)
+	    ok = std::fread(&layer.quantized_weights[o * layer.stride], 1, layer.ninputs, file) == static_cast<size_t>(layer.ninputs);
+	}
+      else
+	{
+	  layer.weights.assign(layer.noutputs * layer.stride, 0);
+	  for (GLint o = 0; ok && o < layer.noutputs; ++o)
+	    ok = std::fread(&layer.weights[o * layer.stride], sizeof(float), layer.ninputs, file) == static_cast<size_t>(layer.ninputs);
+	}
+      ok = ok && std::fread(layer.bias.data(), sizeof(float), layer.noutputs, file) == static_cast<size_t>(layer.noutputs);
+    }
+  std::fclose(file);
+  
+  if (!ok || layers.back().noutputs != 1)
+    return false;
+  nrows_ = header.nrows;
+  ncols_ = header.ncols;
+  ninputs_ = ninputs;
+  layers_.swap(layers);
+  return true;
+}
+
+double NetworkEvaluator::Evaluate(const BitBoard& board) const
+{
+  double value;
+  EvaluateBatch(&board, 1, &value);
+  return value;
+}
+
+void NetworkEvaluator::EvaluateBatch(const BitBoard* boards, GLint count, double* values) const
+{
+  if (layers_.empty() || count == 0 || boards[0].NumRows() != nrows_ || boards[0].NumCols() != ncols_)
+    {
+      // the base Evaluate by name, since the virtual one comes back here
+      for (GLint i = 0; i < count; ++i)
+	values[i] = Evaluator::Evaluate(boards[i]);
+      return;
+    }
+
+  // scratch is per thread so searches on several threads can share one network
+  static thread_local std::vector<float> activations[2];
+  GLint widest = layers_.front().stride;
+  for (const Layer& layer : layers_)
+    widest = std::max(widest, PadToVector(layer.noutputs, kVectorWidth_));
+  for (std::vector<float>& buffer : activations)
+    {
+      if (buffer.size() < static_cast<size_t>(kBatchBlock_ * widest))
+	buffer.resize(kBatchBlock_ * widest);
+    }
+
+  for (GLint first = 0; first < count; first += kBatchBlock_)
+    {
+      const GLint block = std::min(kBatchBlock_, count - first);
+      GLint stride = layers_.front().stride;
+      float* inputs = activations[0].data();
+      for (GLint b = 0; b < block; ++b)
+	{
+	  Encode(boards[first + b], inputs + b * stride);
+	  std::fill(inputs + b * stride + ninputs_, inputs + (b + 1) * stride, 0.0f);
+	}
+      
+      for (size_t i = 0; i < layers_.size(); ++i)
+	{
+	  const Layer& layer = layers_[i];
+	  float* outputs = activations[(i + 1) % 2].data();
+	  GLint output_stride = PadToVector(layer.noutputs, kVectorWidth_);
+	  Forward(layer, inputs, stride, block, outputs, output_stride);
+	  for (GLint b = 0; b < block; ++b)
+	    {
+	      float* y = outputs + b * output_stride;
+	      if (layer.relu)
+		{
+		  for (GLint o = 0; o < layer.noutputs; ++o)
+		    y[o] = std::max(0.0f, y[o]);
+		}
+	      // padding meets zero weights in the next layer, but must not be NaN
+	      std::fill(y + layer.noutputs, y + output_stride, 0.0f);
+	    }
+	  inputs = outputs;
+	  stride = output_stride;
+	}
+      for (GLint b = 0; b < block; ++b)
+	values[first + b] = inputs[b * stride];
+    }
+}
+
+void NetworkEvaluator::Forward(const Layer& layer, const float* inputs, GLint input_stride, GLint count, float* outputs, GLint output_stride) const
+{
+  const int8_t* quantized = layer.quantized ? layer.quantized_weights.data() : nullptr;
+#ifdef NN_VECTOR_KERNELS
+  if (bvector_kernels_)
+    {
+      ForwardAvx2(layer.weights.data(), quantized, layer.scales.data(), layer.bias.data(), layer.stride, layer.noutputs,
+		  inputs, input_stride, count, outputs, output_stride);
+      return;
+    }
+#endif
+  ForwardScalar(layer.weights.data(), quantized, layer.scales.data(), layer.bias.data(), layer.stride, layer.noutputs,
+		inputs, input_stride, count, outputs, output_stride);
+}
+
+void NetworkEvaluator::Encode(const BitBoard& board, float* inputs) const
+{
+  for (GLint row = 0; row < nrows_; ++row)
+    {
+      uint16_t mask = board.Row(row);
+      for (GLint col = 0; col < ncols_; ++col)
+	inputs[row * ncols_ + col] = (mask >> col) & 1;
+    }
+  double features[kNumEvalFeatures];
+  Features(board, features);
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    inputs[nrows_ * ncols_ + i] = features[i];
+}
+
+NetworkEvaluator::~NetworkEvaluator()
+{
+  
+}
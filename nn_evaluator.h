@@ -0,0 +1,75 @@
+#ifndef NN_EVALUATOR_H
+#define NN_EVALUATOR_H
+
+#include "bitboard.h"
+#include "evaluator.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+  Small fully connected network scoring boards for the search.
+  The input is the board's cells (1 filled, 0 open, bottom row first)
+  followed by the unweighted heuristic features, and the last layer
+  has a single output. Boards are scored a batch at a time so every
+  weight row is loaded once per batch instead of once per board.
+  Matrix multiplies use AVX2/FMA kernels when the CPU has them, with
+  a plain C++ fallback that adds in the same order with std::fma, so
+  scores come out the same to the bit, if slowly on CPUs without FMA.
+  Line clears are still rewarded by the linear weights.
+
+  File layout, little endian:
+    char magic[8] = "TETRISNN", uint32 version = 1,
+    uint32 rows, uint32 columns, uint32 layers, then per layer
+    uint32 outputs, uint32 activation (0 linear, 1 relu),
+    uint32 type (0 float32, 1 int8), then for float32 layers
+    float weights[outputs][inputs], for int8 layers
+    float scales[outputs] and int8 weights[outputs][inputs],
+    and for both float bias[outputs].
+*/
+
+class NetworkEvaluator : public Evaluator
+{
+public:
+  explicit NetworkEvaluator(const EvalWeights& weights);
+
+  bool Load(const std::string& filename);
+  bool IsLoaded() const { return !layers_.empty(); }
+
+  // Boards of another size than the network was trained on fall back to the linear weights
+  virtual double Evaluate(const BitBoard& board) const;
+  virtual void EvaluateBatch(const BitBoard* boards, GLint count, double* values) const;
+
+  virtual ~NetworkEvaluator();
+private:
+  struct Layer
+  {
+    GLint ninputs;
+    GLint noutputs;
+    // rows are padded to whole vectors with zero weights
+    GLint stride;
+    bool relu;
+    bool quantized;
+    std::vector<float> weights;
+    std::vector<int8_t> quantized_weights;
+    std::vector<float> scales;
+    std::vector<float> bias;
+  };
+
+  void Forward(const Layer& layer, const float* inputs, GLint input_stride, GLint count, float* outputs, GLint output_stride) const;
+  void Encode(const BitBoard& board, float* inputs) const;
+
+  GLint nrows_;
+  GLint ncols_;
+  GLint ninputs_;
+  std::vector<Layer> layers_;
+  bool bvector_kernels_;
+
+  static const GLint kBatchBlock_;
+  static const GLint kVectorWidth_;
+};
+
+
+#endif // NN_EVALUATOR_H
@@ -0,0 +1,198 @@
+#include "bitboard.h"
+#include "perfect_clear.h"
+#include "randomizer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Asks the perfect clear solver about one position, for practice and
+  for going over tournament games, or times it on a run of seeded
+  openings: an empty board and an eleven piece queue, which is the
+  usual four line perfect clear with a piece to spare for hold.
+*/
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+const char kPieceLetters[] = "IJLOSTZ";
+const GLint kOpeningPieces = 10;
+const GLint kDefaultTimeMs = 100;
+
+void Usage()
+{
+  std::cerr << "usage: pc solve <queue> [--held <piece>] [--no-hold] [--pieces <n>] [--board <rows>] [--threads <n>] [--time <ms>]" << std::endl;
+  std::cerr << "       pc bench <queries> [seed] [--threads <n>] [--time <ms>]" << std::endl;
+  std::cerr << "  queue    pieces in order starting with the one in play, e.g. TIOLJSZ" << std::endl;
+  std::cerr << "  --board  stack rows from the bottom separated by '/', '#' for filled, e.g. ####.#####/##...#####" << std::endl;
+  std::cerr << "  --time   give up on a query after this long, 0 for never, default " << kDefaultTimeMs << std::endl;
+}
+
+bool ParsePieces(const char* letters, std::vector<TetroType>* pieces)
+{
+  for ( ; *letters; ++letters)
+    {
+      const char* found = std::strchr(kPieceLetters, *letters);
+      if (!found)
+	return false;
+      pieces->push_back(static_cast<TetroType>(found - kPieceLetters));
+    }
+  return true;
+}
+
+void PrintSolution(const std::vector<Placement>& solution)
+{
+  for (const Placement& placement : solution)
+    std::cout << kPieceLetters[placement.type] << ' ' << placement.rotation << ' ' << placement.row << ' ' << placement.col
+	      << (placement.hold ? " hold" : "") << std::endl;
+}
+
+int Solve(GLint argc, char** argv)
+{
+  std::vector<TetroType> queue;
+  if (argc < 3 || !ParsePieces(argv[2], &queue))
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+  TetroType held = kNone;
+  bool can_hold = true;
+  GLint max_pieces = kOpeningPieces;
+  GLint nthreads = 0;
+  GLint time_ms = kDefaultTimeMs;
+  BitBoard board(kPlayFieldNumRows, kPlayFieldNumCols);
+  for (GLint arg = 3; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      std::vector<TetroType> piece;
+      if (flag == "--held" && arg + 1 < argc && ParsePieces(argv[++arg], &piece) && piece.size() == 1)
+	{
+	  held = piece[0];
+	}
+      else if (flag == "--no-hold")
+	{
+	  can_hold = false;
+	}
+      else if (flag == "--pieces" && arg + 1 < argc)
+	{
+	  max_pieces = atoi(argv[++arg]);
+	}
+      else if (flag == "--threads" && arg + 1 < argc)
+	{
+	  nthreads = atoi(argv[++arg]);
+	}
+      else if (flag == "--time" && arg + 1 < argc)
+	{
+	  time_ms = atoi(argv[++arg]);
+	}
+      else if (flag == "--board" && arg + 1 < argc)
+	{
+	  std::string rows = argv[++arg];
+	  GLint row = 0, col = 0;
+	  for (char c : rows)
+	    {
+	      if (c == '/')
+		{
+		  ++row;
+		  col = 0;
+		  continue;
+		}
+	      if (row < kPlayFieldNumRows && col < kPlayFieldNumCols && c == '#')
+		board.SetRow(row, board.Row(row) | 1 << col);
+	      ++col;
+	    }
+	}
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+
+  ThreadPool pool(nthreads);
+  PerfectClearSolver solver(&pool);
+  solver.SetTimeBudget(time_ms / 1000.0);
+  std::vector<Placement> solution;
+  auto start = std::chrono::steady_clock::now();
+  PerfectClearResult result = solver.Solve(board, queue, held, can_hold, max_pieces, &solution);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if (result == kClearFound)
+    PrintSolution(solution);
+  std::cout << (result == kClearFound ? "perfect clear in " + std::to_string(solution.size()) + " pieces" :
+		result == kNoClear ? std::string("no perfect clear") : std::string("out of time, unknown")) << ", "
+	    << solver.NodesSearched() << " nodes, " << seconds * 1000 << " ms" << std::endl;
+  return result == kClearFound ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int Bench(GLint argc, char** argv)
+{
+  GLint nqueries = atoi(argv[2]);
+  unsigned int seed = 1;
+  GLint nthreads = 0;
+  GLint time_ms = kDefaultTimeMs;
+  for (GLint arg = 3; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (flag == "--threads" && arg + 1 < argc)
+	nthreads = atoi(argv[++arg]);
+      else if (flag == "--time" && arg + 1 < argc)
+	time_ms = atoi(argv[++arg]);
+      else if (flag.compare(0, 2, "--") != 0)
+	seed = strtoul(argv[arg], nullptr, 10);
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+  if (nqueries < 1)
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+
+  ThreadPool pool(nthreads);
+  PerfectClearSolver solver(&pool);
+  solver.SetTimeBudget(time_ms / 1000.0);
+  Randomizer randomizer(seed);
+  BitBoard board(kPlayFieldNumRows, kPlayFieldNumCols);
+  std::vector<TetroType> queue(kOpeningPieces + 1);
+  std::vector<Placement> solution;
+  std::vector<double> times;
+  GLint solved = 0, unknown = 0;
+  uint64_t nodes = 0;
+  for (GLint query = 0; query < nqueries; ++query)
+    {
+      for (TetroType& piece : queue)
+	piece = randomizer.Next();
+      auto start = std::chrono::steady_clock::now();
+      PerfectClearResult result = solver.Solve(board, queue, kNone, true, kOpeningPieces, &solution);
+      solved += result == kClearFound;
+      unknown += result == kClearUnknown;
+      times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000);
+      nodes += solver.NodesSearched();
+    }
+
+  std::sort(times.begin(), times.end());
+  double total = 0;
+  for (double time : times)
+    total += time;
+  std::cout << solved << " of " << nqueries << " openings cleared, " << unknown << " out of time, " << nodes / nqueries << " nodes each, ms mean "
+	    << total / nqueries << " median " << times[nqueries / 2] << " max " << times.back() << " on " << pool.NumThreads() << " threads" << std::endl;
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc >= 3 && std::string(argv[1]) == "solve")
+    return Solve(argc, argv);
+  if (argc >= 3 && std::string(argv[1]) == "bench")
+    return Bench(argc, argv);
+  Usage();
+  return EXIT_FAILURE;
+}
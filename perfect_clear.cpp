@@ -0,0 +1,342 @@
+#include "perfect_clear.h"
+
+#include <algorithm>
+#include <climits>
+
+const GLint PerfectClearSolver::kMaxPackedCells_ = 64;
+// nodes between looks at the clock, which costs more than a node does
+const uint64_t PerfectClearSolver::kClockInterval_ = 1024;
+
+PerfectClearSolver::PerfectClearSolver(ThreadPool* pool) : pool_(pool),
+							   max_lines_(6),
+							   solved_order_(INT_MAX),
+							   nodes_(0),
+							   time_budget_(0.1),
+							   bout_of_time_(false)
+{ }
+
+PerfectClearResult PerfectClearSolver::Solve(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held, bool can_hold, GLint max_pieces,
+					     std::vector<Placement>* solution)
+{
+  solution->clear();
+  nodes_ = 0;
+  deadline_ = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(time_budget_));
+  bout_of_time_ = false;
+  
+  const GLint ncols = board.NumCols();
+  const GLint height = board.Height();
+  GLint filled = 0;
+  for (GLint row = 0; row < height; ++row)
+    filled += __builtin_popcount(board.Row(row));
+  GLint available = std::min<GLint>(max_pieces, queue.size() + (held != kNone ? 1 : 0));
+  
+  // try the lowest clear first, every piece adds four cells so the gap has to be a multiple of four
+  for (GLint lines = std::max(height, 1); lines <= max_lines_ && lines * ncols <= kMaxPackedCells_; ++lines)
+    {
+      GLint empty = lines * ncols - filled;
+      if (empty % 4 != 0 || empty / 4 > available)
+	continue;
+
+      Search root;
+      root.queue = &queue;
+      root.max_pieces = max_pieces;
+      std::vector<Option> options;
+      Options(root, board, lines, 0, held, can_hold, &options);
+      if (options.empty())
+	continue;
+
+      std::vector<Search> searches(options.size());
+      solved_order_ = INT_MAX;
+      pool_->ParallelFor(options.size(), [&](GLint i)
+			 {
+			   Search& search = searches[i];
+			   search.queue = &queue;
+			   search.max_pieces = max_pieces;
+			   search.order = i;
+			   search.nodes = 0;
+			   
+			   const Option& option = options[i];
+			   BitBoard child(board);
+			   GLint cleared = child.Place(GetPieceMask(option.placement.type, option.placement.rotation), option.placement.row, option.placement.col);
+			   if (Dfs(search, child, lines - cleared, option.next_index, option.held, 1))
+			     {
+			       // keep the earliest first placement so the answer doesn't depend on thread timing
+			       GLint order = solved_order_;
+			       while (i < order && !solved_order_.compare_exchange_weak(order, i))
+				 ;
+			     }
+			 });
+
+      for (const Search& search : searches)
+	nodes_ += search.nodes;
+      GLint order = solved_order_;
+      if (order != INT_MAX)
+	{
+	  solution->push_back(options[order].placement);
+	  solution->insert(solution->end(), searches[order].path.begin(), searches[order].path.end());
+	  return kClearFound;
+	}
+      // a higher clear could still be there, but so could this one
+      if (bout_of_time_)
+	return kClearUnknown;
+    }
+  return kNoClear;
+}
+
+void PerfectClearSolver::Options(Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, bool can_hold, std::vector<Option>* options) const
+{
+  const std::vector<TetroType>& queue = *search.queue;
+  const GLint size = queue.size();
+  options->clear();
+  
+  // the piece in play, the held piece swapped in, or the piece after it if nothing is held yet
+  TetroType pieces[3] = { kNone, kNone, kNone };
+  GLint next_index[3] = { index + 1, index + 1, index + 2 };
+  TetroType next_held[3] = { held, index < size ? queue[index] : kNone, index < size ? queue[index] : kNone };
+  if (index < size)
+    pieces[0] = queue[index];
+  if (can_hold && index < size && held != kNone && held != queue[index])
+    pieces[1] = held;
+  if (can_hold && index + 1 < size && held == kNone && queue[index + 1] != queue[index])
+    pieces[2] = queue[index + 1];
+
+  for (GLint i = 0; i < 3; ++i)
+    {
+      if (pieces[i] == kNone)
+	continue;
+      GeneratePlacements(board, pieces[i], &search.scratch);
+      for (Placement& placement : search.scratch)
+	{
+	  // nothing may stick out above the lines being cleared
+	  if (placement.row - GetPieceMask(placement.type, placement.rotation).min_row >= lines)
+	    continue;
+	  placement.hold = i > 0;
+	  Option option = { placement, next_index[i], next_held[i] };
+	  options->push_back(option);
+	}
+    }
+
+  // filling from the bottom up finds clears sooner
+  std::stable_sort(options->begin(), options->end(), [](const Option& a, const Option& b)
+		   {
+		     return a.placement.row - GetPieceMask(a.placement.type, a.placement.rotation).max_row <
+		       b.placement.row - GetPieceMask(b.placement.type, b.placement.rotation).max_row;
+		   });
+}
+
+bool PerfectClearSolver::Dfs(Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, GLint placed)
+{
+  ++search.nodes;
+  if (lines == 0)
+    return true;
+  if (time_budget_ > 0 && search.nodes % kClockInterval_ == 0 && std::chrono::steady_clock::now() > deadline_)
+    bout_of_time_ = true;
+  if (bout_of_time_)
+    return false;
+  // an earlier first placement already has an answer
+  if (solved_order_ < search.order)
+    return false;
+  Key key = { Pack(board, lines), static_cast<GLuint>(index | (held + 1) << 8 | lines << 12) };
+  if (search.failed.Contains(key))
+    return false;
+  if (!CanStillClear(search, board, lines, index, held, placed))
+    {
+      search.failed.Insert(key);
+      return false;
+    }
+
+  if (static_cast<GLint>(search.options.size()) <= placed)
+    search.options.resize(placed + 1);
+  std::vector<Option>& options = search.options[placed];
+  Options(search, board, lines, index, held, true, &options);
+  
+  for (const Option& option : options)
+    {
+      BitBoard child(board);
+      GLint cleared = child.Place(GetPieceMask(option.placement.type, option.placement.rotation), option.placement.row, option.placement.col);
+      search.path.push_back(option.placement);
+      if (Dfs(search, child, lines - cleared, option.next_index, option.held, placed + 1))
+	return true;
+      search.path.pop_back();
+    }
+
+  // a search cut short proved nothing
+  if (solved_order_ > search.order && !bout_of_time_)
+    search.failed.Insert(key);
+  return false;
+}
+
+bool PerfectClearSolver::CanStillClear(const Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, GLint placed) const
+{
+  const std::vector<TetroType>& queue = *search.queue;
+  const GLint ncols = board.NumCols();
+  
+  GLint available = std::min<GLint>(search.max_pieces - placed, queue.size() - index + (held != kNone ? 1 : 0));
+  GLint empty = 0, empty_even = 0;
+  uint16_t even_cols = 0x5555 & board.FullRow();
+  for (GLint row = 0; row < lines; ++row)
+    {
+      uint16_t open = ~board.Row(row) & board.FullRow();
+      empty += __builtin_popcount(open);
+      empty_even += __builtin_popcount(open & even_cols);
+    }
+  if (empty / 4 > available)
+    return false;
+
+  // Column parity: O, S and Z always cover two even and two odd columns, T and L/J
+  // shift the balance by at most two and I by at most four. Clearing a full row
+  // on an even width board leaves the balance alone.
+  if (ncols % 2 == 0)
+    {
+      GLint imbalance = std::abs(2 * empty_even - empty);
+      GLint correction = 0;
+      for (GLint i = index; i < static_cast<GLint>(queue.size()); ++i)
+	correction += queue[i] == kTetroI ? 4 : (queue[i] == kTetroT || queue[i] == kTetroJ || queue[i] == kTetroL ? 2 : 0);
+      correction += held == kTetroI ? 4 : (held == kTetroT || held == kTetroJ || held == kTetroL ? 2 : 0);
+      if (imbalance > correction)
+	return false;
+    }
+
+  return RegionsFillable(board, lines);
+}
+
+bool PerfectClearSolver::RegionsFillable(const BitBoard& board, GLint lines) const
+{
+  // A piece always lands inside one connected pocket of empty cells. Clearing rows
+  // can join pockets, but only ones sharing a column with filled cells between
+  // them, so pockets are grouped through those links and each group has to take
+  // a whole number of pieces.
+  const GLint ncols = board.NumCols();
+  const GLint ncells = lines * ncols;
+  const uint64_t region = ncells == 64 ? ~0ULL : (1ULL << ncells) - 1;
+  uint64_t first_col = 0, last_col = 0;
+  for (GLint row = 0; row < lines; ++row)
+    {
+      first_col |= 1ULL << (row * ncols);
+      last_col |= 1ULL << (row * ncols + ncols - 1);
+    }
+
+  uint64_t pockets[kMaxPackedCells_];
+  GLint group[kMaxPackedCells_];
+  GLint npockets = 0;
+  uint64_t open = region & ~Pack(board, lines);
+  while (open)
+    {
+      uint64_t pocket = open & (~open + 1);
+      while (true)
+	{
+	  uint64_t grown = pocket | ((pocket << 1) & ~first_col) | ((pocket >> 1) & ~last_col) | (pocket << ncols) | (pocket >> ncols);
+	  grown &= open;
+	  if (grown == pocket)
+	    break;
+	  pocket = grown;
+	}
+      open &= ~pocket;
+      group[npockets] = npockets;
+      pockets[npockets++] = pocket;
+    }
+
+  for (GLint col = 0; col < ncols; ++col)
+    {
+      GLint below = -1;
+      for (GLint row = 0; row < lines; ++row)
+	{
+	  uint64_t cell = 1ULL << (row * ncols + col);
+	  GLint pocket = 0;
+	  while (pocket < npockets && !(pockets[pocket] & cell))
+	    ++pocket;
+	  if (pocket == npockets)
+	    continue;
+	  if (below >= 0)
+	    {
+	      GLint a = below, b = pocket;
+	      while (group[a] != a)
+		a = group[a];
+	      while (group[b] != b)
+		b = group[b];
+	      group[std::max(a, b)] = std::min(a, b);
+	    }
+	  below = pocket;
+	}
+    }
+
+  GLint cells[kMaxPackedCells_] = { 0 };
+  for (GLint pocket = 0; pocket < npockets; ++pocket)
+    {
+      GLint root = pocket;
+      while (group[root] != root)
+	root = group[root];
+      cells[root] += __builtin_popcountll(pockets[pocket]);
+    }
+  for (GLint pocket = 0; pocket < npockets; ++pocket)
+    {
+      if (cells[pocket] % 4 != 0)
+	return false;
+    }
+  return true;
+}
+
+uint64_t PerfectClearSolver::Pack(const BitBoard& board, GLint lines) const
+{
+  uint64_t cells = 0;
+  for (GLint row = lines - 1; row >= 0; --row)
+    cells = (cells << board.NumCols()) | board.Row(row);
+  return cells;
+}
+
+// no real key has every state bit set
+static const GLuint kEmptySlot = ~0u;
+
+bool PerfectClearSolver::FailedSet::Contains(const Key& key) const
+{
+  const size_t mask = slots_.size() - 1;
+  for (size_t slot = Slot(key); slots_[slot].state != kEmptySlot; slot = (slot + 1) & mask)
+    {
+      if (slots_[slot] == key)
+	return true;
+    }
+  return false;
+}
+
+void PerfectClearSolver::FailedSet::Insert(const Key& key)
+{
+  if (2 * (count_ + 1) > slots_.size())
+    {
+      std::vector<Key> old(slots_.size() * 2);
+      old.swap(slots_);
+      Reset();
+      for (const Key& entry : old)
+	{
+	  if (entry.state != kEmptySlot)
+	    Insert(entry);
+	}
+    }
+  
+  const size_t mask = slots_.size() - 1;
+  size_t slot = Slot(key);
+  for ( ; slots_[slot].state != kEmptySlot; slot = (slot + 1) & mask)
+    {
+      if (slots_[slot] == key)
+	return;
+    }
+  slots_[slot] = key;
+  ++count_;
+}
+
+void PerfectClearSolver::FailedSet::Reset()
+{
+  Key empty = { 0, kEmptySlot };
+  std::fill(slots_.begin(), slots_.end(), empty);
+  count_ = 0;
+}
+
+size_t PerfectClearSolver::FailedSet::Slot(const Key& key) const
+{
+  uint64_t hash = (key.cells ^ (static_cast<uint64_t>(key.state) << 40)) * 0x9e3779b97f4a7c15ULL;
+  return (hash >> 32) & (slots_.size() - 1);
+}
+
+PerfectClearSolver::~PerfectClearSolver()
+{
+  
+}
@@ -0,0 +1,107 @@
+#ifndef PERFECT_CLEAR_H
+#define PERFECT_CLEAR_H
+
+#include "bitboard.h"
+#include "thread_pool.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+enum PerfectClearResult
+  {
+    kClearFound,
+    kNoClear,
+    // the time budget ran out before the search could tell
+    kClearUnknown
+  };
+
+/*
+  Searches for a placement sequence that empties the board using
+  only the given queue and hold. Sub-boards that fail are remembered
+  so transpositions are only searched once, and each first placement
+  is searched on its own thread. Proving there is no clear can take
+  far longer than finding one, so the search stops at a time budget.
+*/
+
+class PerfectClearSolver
+{
+public:
+  explicit PerfectClearSolver(ThreadPool* pool);
+
+  // Highest stack the solver will try to clear, limited by the packed board key
+  void SetMaxLines(GLint lines) { max_lines_ = lines; }
+
+  // Seconds a Solve may take before it gives up, 0 for no limit
+  void SetTimeBudget(double seconds) { time_budget_ = seconds; }
+
+  // queue[0] is the piece in play. Fills in the placements in the order they are played.
+  PerfectClearResult Solve(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held, bool can_hold, GLint max_pieces, std::vector<Placement>* solution);
+
+  uint64_t NodesSearched() const { return nodes_; }
+
+  virtual ~PerfectClearSolver();
+private:
+  struct Key
+  {
+    uint64_t cells;
+    GLuint state;
+    bool operator==(const Key& other) const { return cells == other.cells && state == other.state; }
+  };
+  // Open addressed set of positions already shown to fail
+  class FailedSet
+  {
+  public:
+    FailedSet() : slots_(1 << 12), count_(0) { Reset(); }
+    bool Contains(const Key& key) const;
+    void Insert(const Key& key);
+  private:
+    void Reset();
+    size_t Slot(const Key& key) const;
+    
+    std::vector<Key> slots_;
+    size_t count_;
+  };
+
+  // One way to play the next piece, with the queue and hold that follow it
+  struct Option
+  {
+    Placement placement;
+    GLint next_index;
+    TetroType held;
+  };
+
+  struct Search
+  {
+    const std::vector<TetroType>* queue;
+    GLint max_pieces;
+    GLint order;
+    FailedSet failed;
+    std::vector<Placement> path;
+    std::vector< std::vector<Option> > options;
+    std::vector<Placement> scratch;
+    uint64_t nodes;
+  };
+
+  void Options(Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, bool can_hold, std::vector<Option>* options) const;
+  bool Dfs(Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, GLint placed);
+  bool CanStillClear(const Search& search, const BitBoard& board, GLint lines, GLint index, TetroType held, GLint placed) const;
+  bool RegionsFillable(const BitBoard& board, GLint lines) const;
+  uint64_t Pack(const BitBoard& board, GLint lines) const;
+
+  ThreadPool* pool_;
+  GLint max_lines_;
+  std::atomic<GLint> solved_order_;
+  uint64_t nodes_;
+  double time_budget_;
+  std::chrono::steady_clock::time_point deadline_;
+  std::atomic<bool> bout_of_time_;
+
+  static const GLint kMaxPackedCells_;
+  static const uint64_t kClockInterval_;
+};
+
+
+#endif // PERFECT_CLEAR_H
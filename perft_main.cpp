@@ -0,0 +1,261 @@
+#include "bitboard.h"
+#include "playfield.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Counts every distinct sequence of placements the queue can make,
+  like perft in chess engines. The search code's bitboard move
+  generator is timed, and the same tree can be walked with PlayField
+  moves as a reference so the two implementations check each other.
+*/
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+const char kPieceLetters[] = "IJLOSTZ";
+
+struct PerftOptions
+{
+  std::vector<TetroType> queue;
+  bool hold;
+};
+
+// The piece to play next: from the queue, the held piece, or the one after it when holding into an empty slot
+struct PieceChoice
+{
+  TetroType piece;
+  GLint next_index;
+  TetroType held;
+};
+
+GLint PieceChoices(const PerftOptions& options, GLint index, TetroType held, PieceChoice choices[2])
+{
+  const std::vector<TetroType>& queue = options.queue;
+  GLint size = queue.size();
+  GLint count = 0;
+  if (index >= size)
+    return 0;
+  
+  PieceChoice play = { queue[index], index + 1, held };
+  choices[count++] = play;
+  if (!options.hold)
+    return count;
+  // holding a piece of the same type changes nothing
+  if (held != kNone && held != queue[index])
+    {
+      PieceChoice swap = { held, index + 1, queue[index] };
+      choices[count++] = swap;
+    }
+  if (held == kNone && index + 1 < size && queue[index + 1] != queue[index])
+    {
+      PieceChoice swap = { queue[index + 1], index + 2, queue[index] };
+      choices[count++] = swap;
+    }
+  return count;
+}
+
+uint64_t PerftBitBoard(const PerftOptions& options, const BitBoard& board, GLint index, TetroType held, GLint depth, std::vector< std::vector<Placement> >& buffers)
+{
+  if (depth == 0)
+    return 1;
+
+  uint64_t nodes = 0;
+  PieceChoice choices[2];
+  GLint nchoices = PieceChoices(options, index, held, choices);
+  for (GLint i = 0; i < nchoices; ++i)
+    {
+      std::vector<Placement>& placements = buffers[depth];
+      GeneratePlacements(board, choices[i].piece, &placements);
+      for (const Placement& placement : placements)
+	{
+	  BitBoard child(board);
+	  child.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+	  nodes += PerftBitBoard(options, child, choices[i].next_index, choices[i].held, depth - 1, buffers);
+	}
+    }
+  return nodes;
+}
+
+std::vector< std::pair<GLint, GLint> > FallingCells(const PlayField& playfield)
+{
+  std::vector< std::pair<GLint, GLint> > cells;
+  const Tetromino& tetro = playfield.FallingTetro();
+  GLint side = tetro.TemplateSideLength();
+  for (GLint row = 0; row < side; ++row)
+    {
+      for (GLint col = 0; col < side; ++col)
+	{
+	  if (tetro.Shape()[row * side + col] != kEmpty)
+	    cells.push_back(std::make_pair(playfield.FallingTetroRow() - row, playfield.FallingTetroCol() + col));
+	}
+    }
+  std::sort(cells.begin(), cells.end());
+  return cells;
+}
+
+// Same moves as GeneratePlacements, made one at a time through PlayField
+void PlayFieldPlacements(const PlayField& playfield, TetroType type, std::vector<PlayField>* children)
+{
+  children->clear();
+  PlayField spawned(playfield);
+  if (!spawned.SpawnTetro(type))
+    return;
+  
+  const Rotation turns[4][2] = { { kRight, kRight }, { kRight, kRight }, { kRight, kRight }, { kLeft, kLeft } };
+  const GLint nturns[4] = { 0, 1, 2, 1 };
+  std::vector< std::vector< std::pair<GLint, GLint> > > seen;
+  
+  for (GLint rotation = 0; rotation < 4; ++rotation)
+    {
+      PlayField rotated(spawned);
+      bool in_place = true;
+      for (GLint turn = 0; turn < nturns[rotation] && in_place; ++turn)
+	{
+	  // the generator never kicks
+	  in_place = rotated.RotateFallingTetro(turns[rotation][turn]) &&
+	    rotated.FallingTetroRow() == spawned.FallingTetroRow() &&
+	    rotated.FallingTetroCol() == spawned.FallingTetroCol();
+	}
+      if (!in_place)
+	continue;
+
+      for (GLint direction = -1; direction <= 1; direction += 2)
+	{
+	  PlayField moving(rotated);
+	  if (direction > 0 && !moving.MoveFallingTetroHorizontal(direction))
+	    continue;
+	  do
+	    {
+	      PlayField dropped(moving);
+	      dropped.MoveFallingTetroVertical(dropped.GhostRow() - dropped.FallingTetroRow());
+	      std::vector< std::pair<GLint, GLint> > cells = FallingCells(dropped);
+	      if (std::find(seen.begin(), seen.end(), cells) != seen.end())
+		continue;
+	      seen.push_back(cells);
+	      
+	      dropped.LockFallingTetro();
+	      dropped.ClearLines();
+	      children->push_back(dropped);
+	    }
+	  while (moving.MoveFallingTetroHorizontal(direction));
+	}
+    }
+}
+
+uint64_t PerftPlayField(const PerftOptions& options, const PlayField& playfield, GLint index, TetroType held, GLint depth)
+{
+  if (depth == 0)
+    return 1;
+
+  uint64_t nodes = 0;
+  PieceChoice choices[2];
+  GLint nchoices = PieceChoices(options, index, held, choices);
+  std::vector<PlayField> children;
+  for (GLint i = 0; i < nchoices; ++i)
+    {
+      PlayFieldPlacements(playfield, choices[i].piece, &children);
+      for (const PlayField& child : children)
+	nodes += PerftPlayField(options, child, choices[i].next_index, choices[i].held, depth - 1);
+    }
+  return nodes;
+}
+
+void Usage()
+{
+  std::cerr << "usage: perft <queue> <depth> [--hold] [--reference] [--board <rows>]" << std::endl;
+  std::cerr << "  queue    pieces in order, e.g. TIOLJSZ" << std::endl;
+  std::cerr << "  --board  stack rows from the bottom separated by '/', '#' for filled, e.g. ####.#####/##...#####" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+
+  PerftOptions options;
+  options.hold = false;
+  for (const char* letter = argv[1]; *letter; ++letter)
+    {
+      const char* found = std::strchr(kPieceLetters, *letter);
+      if (!found)
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+      options.queue.push_back(static_cast<TetroType>(found - kPieceLetters));
+    }
+  GLint max_depth = atoi(argv[2]);
+  bool reference = false;
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+
+  for (GLint arg = 3; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (flag == "--hold")
+	{
+	  options.hold = true;
+	}
+      else if (flag == "--reference")
+	{
+	  reference = true;
+	}
+      else if (flag == "--board" && arg + 1 < argc)
+	{
+	  std::string rows = argv[++arg];
+	  GLint row = 0, col = 0;
+	  for (char c : rows)
+	    {
+	      if (c == '/')
+		{
+		  ++row;
+		  col = 0;
+		  continue;
+		}
+	      if (row < kPlayFieldNumRows && col < kPlayFieldNumCols && c == '#')
+		playfield.SetTile(kCyan, row, col);
+	      ++col;
+	    }
+	}
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+
+  BitBoard board = BitBoard::FromPlayField(playfield);
+  std::vector< std::vector<Placement> > buffers(max_depth + 1);
+  bool matched = true;
+  for (GLint depth = 1; depth <= max_depth; ++depth)
+    {
+      auto start = std::chrono::steady_clock::now();
+      uint64_t nodes = PerftBitBoard(options, board, 0, kNone, depth, buffers);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << "depth " << depth << ": " << nodes << " sequences, " << seconds << "s, "
+		<< static_cast<uint64_t>(nodes / std::max(seconds, 1e-9)) << " leaves/s";
+
+      if (reference)
+	{
+	  start = std::chrono::steady_clock::now();
+	  uint64_t reference_nodes = PerftPlayField(options, playfield, 0, kNone, depth);
+	  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	  std::cout << ", playfield " << reference_nodes << " in " << seconds << "s";
+	  if (reference_nodes != nodes)
+	    {
+	      std::cout << " MISMATCH";
+	      matched = false;
+	    }
+	}
+      std::cout << std::endl;
+    }
+  return matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,22 +1,27 @@
 #include "playfield.h"
 
+#include <algorithm>
+
 const GLint PlayField::kHiddenLines_ = 2;
 
 PlayField::PlayField(GLuint nrows, GLuint ncols) : nrows_(nrows),
 						   ncols_(ncols),
 						   tile_colors_((nrows + kHiddenLines_) * ncols, kEmpty),
 						   falling_tetro_(kNone),
-						   falling_tetro_row_(21),
-						   falling_tetro_col_(5),
-						   ghost_row_(21),
-						   ghost_col_(5)
+						   falling_tetro_row_(nrows - 1),
+						   falling_tetro_col_(ncols / 2),
+						   ghost_row_(nrows - 1),
+						   ghost_col_(ncols / 2)
 { }
 
 bool PlayField::SpawnTetro(const TetroType type)
 {
   falling_tetro_ = Tetromino(type);
-  falling_tetro_row_ = 21;
-  falling_tetro_col_ = (ncols_ - falling_tetro_.TemplateSideLength()) / 2;
+  falling_tetro_row_ = nrows_ - 1;
+  falling_tetro_col_ = std::max(0, (ncols_ - static_cast<GLint>(falling_tetro_.TemplateSideLength())) / 2);
+  // wells narrower than the piece only have room for it standing up
+  if (static_cast<GLint>(falling_tetro_.TemplateSideLength()) > ncols_)
+    falling_tetro_.Rotate(kRight);
 
   if (!IsPositionOpen(falling_tetro_row_, falling_tetro_col_, falling_tetro_))
     return false;
@@ -39,7 +44,7 @@ bool PlayField::SpawnTetro(const TetroType type)
 bool PlayField::LockFallingTetro()
 { 
   GLint template_side_length = falling_tetro_.TemplateSideLength();
-  const std::vector<TileColor>& shape = falling_tetro_.Shape();
+  const TileColor* shape = falling_tetro_.Shape();
   bool top_out = true;
   GLint shape_index = 0;
   
@@ -69,6 +74,8 @@ void PlayField::SetTile(TileColor color, GLint row, GLint col)
 void PlayField::Clear()
 {
   std::fill(tile_colors_.begin(), tile_colors_.end(), kEmpty);
+  lines_to_clear_.clear();
+  falling_tetro_ = Tetromino(kNone);
 }
 
 TileColor PlayField::GetTileColor(GLint row, GLint col) const
@@ -78,7 +85,7 @@ TileColor PlayField::GetTileColor(GLint row, GLint col) const
 
 bool PlayField::IsTileOpen(GLint row, GLint col) const
 {
-  return row >= 0 && row < 22 && col >= 0 && col < 10 && GetTileColor(row, col) == kEmpty;
+  return row >= 0 && row < nrows_ && col >= 0 && col < ncols_ && GetTileColor(row, col) == kEmpty;
 }
 
 bool PlayField::IsPositionOpen(GLint row, GLint col, const Tetromino& tetro) const
@@ -86,7 +93,7 @@ bool PlayField::IsPositionOpen(GLint row, GLint col, const Tetromino& tetro) con
   if (tetro.Type() == kNone)
     return false;
   
-  const std::vector<TileColor>& shape = tetro.Shape();
+  const TileColor* shape = tetro.Shape();
   GLuint template_side_length = tetro.TemplateSideLength();
 
   GLuint template_index = 0;
@@ -158,6 +165,21 @@ bool PlayField::RotateFallingTetro(Rotation rotation)
   return false;
 }
 
+bool PlayField::PlaceFallingTetro(RotationState rotation, GLint row, GLint col)
+{
+  Tetromino test(falling_tetro_);
+  while (test.RotationState() != rotation)
+    test.Rotate(kRight);
+  if (!IsPositionOpen(row, col, test))
+    return false;
+
+  falling_tetro_ = test;
+  falling_tetro_row_ = row;
+  falling_tetro_col_ = col;
+  UpdateGhost();
+  return true;
+}
+
 void PlayField::UpdateGhost()
 {
   // Cannot use binary search with tetris' naive gravity
@@ -172,6 +194,25 @@ bool PlayField::IsGrounded() const
   return !IsPositionOpen(falling_tetro_row_ - 1, falling_tetro_col_, falling_tetro_);
 }
 
+bool PlayField::InsertGarbage(GLint lines, GLint hole, TileColor color)
+{
+  lines = std::min(lines, NumTileRows());
+  if (lines <= 0)
+    return true;
+  GLint shifted = lines * ncols_;
+  bool fits = std::all_of(tile_colors_.end() - shifted, tile_colors_.end(),
+			  [](TileColor tile) { return tile == kEmpty; });
+  // rows are stored one after another, so the stack moves up as one block
+  std::copy_backward(tile_colors_.begin(), tile_colors_.end() - shifted, tile_colors_.end());
+  std::fill(tile_colors_.begin(), tile_colors_.begin() + shifted, color);
+  for (GLint row = 0; row < lines; ++row)
+    tile_colors_[(row * ncols_) + hole] = kEmpty;
+  
+  if (falling_tetro_.Type() != kNone)
+    UpdateGhost();
+  return fits;
+}
+
 void PlayField::UpdateLineClears()
 {
   tile_colors_after_clear_ = tile_colors_;
@@ -225,6 +266,42 @@ void PlayField::ClearLines()
   tile_colors_ = tile_colors_after_clear_;
 }
 
+void PlayField::Save(PlayFieldSnapshot* snapshot) const
+{
+  snapshot->tiles.resize(tile_colors_.size());
+  for (size_t i = 0; i < tile_colors_.size(); ++i)
+    snapshot->tiles[i] = tile_colors_[i] + 1;
+  snapshot->falling = falling_tetro_.Type();
+  snapshot->rotation = falling_tetro_.RotationState();
+  snapshot->row = falling_tetro_row_;
+  snapshot->col = falling_tetro_col_;
+  snapshot->ghost_row = ghost_row_;
+  snapshot->ghost_col = ghost_col_;
+  snapshot->bclearing = !lines_to_clear_.empty();
+}
+
+void PlayField::Restore(const PlayFieldSnapshot& snapshot)
+{
+  for (size_t i = 0; i < tile_colors_.size(); ++i)
+    tile_colors_[i] = static_cast<TileColor>(snapshot.tiles[i] - 1);
+  // rebuilding the piece means turning it round again, so keep the one we have when it's the same
+  if (falling_tetro_.Type() != snapshot.falling || falling_tetro_.RotationState() != snapshot.rotation)
+    {
+      falling_tetro_ = Tetromino(snapshot.falling);
+      while (falling_tetro_.RotationState() != snapshot.rotation)
+	falling_tetro_.Rotate(kRight);
+    }
+  falling_tetro_row_ = snapshot.row;
+  falling_tetro_col_ = snapshot.col;
+  ghost_row_ = snapshot.ghost_row;
+  ghost_col_ = snapshot.ghost_col;
+
+  // the full rows are still on the board until the clear finishes, so they can be found again
+  lines_to_clear_.clear();
+  if (snapshot.bclearing)
+    UpdateLineClears();
+}
+
 PlayField::~PlayField()
 {
   
@@ -5,12 +5,29 @@
 
 #include <vector>
 #include <GL/glew.h>
-#include <map>
+#include <cstdint>
+
+// Everything a PlayField needs to go back to a frame, without its tables
+struct PlayFieldSnapshot
+{
+  // tile colour + 1, so empty is 0
+  std::vector<uint8_t> tiles;
+  TetroType falling;
+  RotationState rotation;
+  GLint row, col;
+  GLint ghost_row, ghost_col;
+  bool bclearing;
+};
 
 class PlayField
 {
 public:
   PlayField(GLuint nrows, GLuint ncols);
+
+  GLint NumRows() const { return nrows_; }
+  GLint NumCols() const { return ncols_; }
+  // Rows in Tiles(), the hidden ones above the field included
+  GLint NumTileRows() const { return nrows_ + kHiddenLines_; }
   
   bool SpawnTetro(const TetroType type);
   bool LockFallingTetro();
@@ -24,14 +41,21 @@ public:
   GLint GhostCol() const { return ghost_col_; }
   
   void SetTile(TileColor color, GLint row, GLint col);
+  // Empties the stack and takes away the falling piece
   void Clear();
   
   TileColor GetTileColor(GLint row, GLint col) const;
+  // Row major from the bottom row, for callers reading the whole field
+  const TileColor* Tiles() const { return tile_colors_.data(); }
   
   bool IsTileOpen(GLint row, GLint col) const;
   bool IsPositionOpen(GLint row, GLint col, const Tetromino& tetro) const;
   bool IsGrounded() const;
   
+  // Pushes the stack up and fills the bottom with rows open at one column.
+  // Returns false if filled tiles were pushed off the top.
+  bool InsertGarbage(GLint lines, GLint hole, TileColor color);
+
   void UpdateLineClears();
   void ClearLines();
   GLint NumLinesCleared() const { return lines_to_clear_.size(); }
@@ -40,9 +64,14 @@ public:
   GLint MoveFallingTetroHorizontal(GLint delta_right);
   GLint MoveFallingTetroVertical(GLint delta_up);
   bool RotateFallingTetro(Rotation rotation);
+  // Puts the falling piece straight at a position and rotation, without kicks
+  bool PlaceFallingTetro(RotationState rotation, GLint row, GLint col);
 
   void UpdateGhost();
 
+  void Save(PlayFieldSnapshot* snapshot) const;
+  void Restore(const PlayFieldSnapshot& snapshot);
+
   virtual ~PlayField();
 private:
   Tetromino falling_tetro_;
@@ -58,7 +87,6 @@ private:
   std::vector<TileColor> tile_colors_;
   std::vector<TileColor> tile_colors_after_clear_;
   std::vector<int> lines_to_clear_;
-  const std::map< std::pair<RotationState, RotationState>, std::vector< std::pair<GLint, GLint> > > kicks_jlstz_, kicks_i_;
 };
 
 
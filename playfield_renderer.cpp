@@ -1,4 +1,5 @@
 #include "playfield_renderer.h"
+#include "metrics.h"
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -7,6 +8,8 @@ glm::vec3 PlayFieldRenderer::kPlayfieldFill_(0,0,0);
 glm::vec3 PlayFieldRenderer::kPlayfieldLines_(30/255.f,30/255.f,30/255.f);
 const GLint PlayFieldRenderer::kHiddenRows_ = 2;
 
+static MetricCounter& draw_calls = Metrics().GetCounter("tetris_draw_calls_total", "OpenGL draw calls.");
+
 PlayFieldRenderer::PlayFieldRenderer(const std::string& shaders_prefix, glm::mat4& projection, GLfloat x, GLfloat y, GLint nrows, GLint ncols, GLfloat tile_size, const TextureRenderer& texture_renderer, const std::vector<Texture>& ttiles) : x_(x), y_(y), nrows_(nrows), ncols_(ncols), shader_(shaders_prefix), tile_size_(tile_size), texture_renderer_(texture_renderer), tile_textures_(ttiles)
 {
   GLfloat width = ncols * tile_size;
@@ -64,9 +67,11 @@ void PlayFieldRenderer::RenderGrid() const
   shader_.Bind();
   glBindVertexArray(vao_);
   shader_.Set3f("in_color", kPlayfieldFill_);
+  draw_calls.Add();
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
   shader_.Set3f("in_color", kPlayfieldLines_);
+  draw_calls.Add();
   glDrawArrays(GL_LINES, 4, 2 * (ncols_ + nrows_ - kHiddenRows_ + 2));
 }
 
@@ -0,0 +1,118 @@
+#include "plugin_host.h"
+
+#include <ctime>
+#include <dlfcn.h>
+
+BotPlugin::BotPlugin() : library_(nullptr),
+			 plugin_(nullptr),
+			 bot_(nullptr),
+			 start_time_(0),
+			 cpu_budget_(0),
+			 last_cpu_time_(0),
+			 banswered_(false)
+{ }
+
+bool BotPlugin::Load(const std::string& filename)
+{
+  Unload();
+  library_ = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (!library_)
+    {
+      error_ = dlerror();
+      return false;
+    }
+  TetrisBotEntryPoint entry = reinterpret_cast<TetrisBotEntryPoint>(dlsym(library_, TETRIS_BOT_ENTRY_POINT));
+  const TetrisBotPlugin* plugin = entry ? entry() : nullptr;
+  if (!plugin || plugin->abi_version != TETRIS_BOT_ABI_VERSION || !plugin->create || !plugin->destroy || !plugin->suggest)
+    {
+      error_ = entry ? "incompatible plugin" : "no " TETRIS_BOT_ENTRY_POINT " entry point";
+      Unload();
+      return false;
+    }
+  plugin_ = plugin;
+  bot_ = plugin_->create();
+  if (!bot_)
+    {
+      error_ = "bot failed to start";
+      Unload();
+      return false;
+    }
+  return true;
+}
+
+void BotPlugin::Unload()
+{
+  if (bot_)
+    plugin_->destroy(bot_);
+  if (library_)
+    dlclose(library_);
+  bot_ = nullptr;
+  plugin_ = nullptr;
+  library_ = nullptr;
+}
+
+PluginMoveResult BotPlugin::Suggest(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held, bool can_hold,
+				    double cpu_budget, Placement* placement)
+{
+  if (!bot_)
+    return kPluginNoMove;
+  queue_.assign(queue.begin(), queue.end());
+
+  // the bot reads the board's own rows, nothing is copied
+  TetrisBotState state;
+  state.rows = board.NumRows();
+  state.columns = board.NumCols();
+  state.board = board.Rows();
+  state.queue = queue_.data();
+  state.queue_length = queue_.size();
+  state.held = held;
+  state.can_hold = can_hold;
+  state.cpu_budget = cpu_budget;
+
+  TetrisBotHost host;
+  host.context = this;
+  host.answer = &BotPlugin::Answer;
+  host.should_stop = &BotPlugin::ShouldStop;
+
+  banswered_ = false;
+  cpu_budget_ = cpu_budget;
+  start_time_ = CpuTime();
+  plugin_->suggest(bot_, &state, &host);
+  last_cpu_time_ = CpuTime() - start_time_;
+
+  if (!banswered_)
+    return last_cpu_time_ > cpu_budget_ ? kPluginOverBudget : kPluginNoMove;
+  placement->type = static_cast<TetroType>(answer_.piece);
+  placement->rotation = static_cast<RotationState>(answer_.rotation & 3);
+  placement->row = answer_.row;
+  placement->col = answer_.column;
+  placement->hold = answer_.hold != 0;
+  return kPluginMove;
+}
+
+void BotPlugin::Answer(void* context, const TetrisBotPlacement* placement)
+{
+  BotPlugin* host = static_cast<BotPlugin*>(context);
+  if (host->CpuTime() - host->start_time_ > host->cpu_budget_ || placement->piece < kTetroI || placement->piece > kTetroZ)
+    return;
+  host->answer_ = *placement;
+  host->banswered_ = true;
+}
+
+int32_t BotPlugin::ShouldStop(void* context)
+{
+  const BotPlugin* host = static_cast<const BotPlugin*>(context);
+  return host->CpuTime() - host->start_time_ > host->cpu_budget_;
+}
+
+double BotPlugin::CpuTime() const
+{
+  timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+BotPlugin::~BotPlugin()
+{
+  Unload();
+}
@@ -0,0 +1,64 @@
+#ifndef PLUGIN_HOST_H
+#define PLUGIN_HOST_H
+
+#include "bitboard.h"
+#include "bot_plugin.h"
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+enum PluginMoveResult
+  {
+    kPluginMove,
+    kPluginNoMove,
+    // the bot ran past its budget without answering in time
+    kPluginOverBudget
+  };
+
+/*
+  Loads a bot plugin and asks it for moves.
+  Time is kept with the calling thread's CPU clock, read when the
+  plugin checks in or answers, so a slow plugin can't be helped or
+  hurt by whatever else the machine is doing.
+*/
+
+class BotPlugin
+{
+public:
+  BotPlugin();
+
+  bool Load(const std::string& filename);
+  void Unload();
+  const std::string& Error() const { return error_; }
+  const char* Name() const { return plugin_ ? plugin_->name : ""; }
+
+  PluginMoveResult Suggest(const BitBoard& board, const std::vector<TetroType>& queue, TetroType held, bool can_hold,
+			   double cpu_budget, Placement* placement);
+  // CPU seconds the last call to Suggest used
+  double LastCpuTime() const { return last_cpu_time_; }
+
+  virtual ~BotPlugin();
+private:
+  BotPlugin(const BotPlugin&);
+  void operator=(const BotPlugin&);
+
+  static void Answer(void* context, const TetrisBotPlacement* placement);
+  static int32_t ShouldStop(void* context);
+  double CpuTime() const;
+
+  void* library_;
+  const TetrisBotPlugin* plugin_;
+  void* bot_;
+  std::string error_;
+
+  std::vector<int8_t> queue_;
+  double start_time_;
+  double cpu_budget_;
+  double last_cpu_time_;
+  bool banswered_;
+  TetrisBotPlacement answer_;
+};
+
+
+#endif // PLUGIN_HOST_H
@@ -0,0 +1,36 @@
+#include "randomizer.h"
+
+#include <ctime>
+
+const GLint Randomizer::kNumTetroTypes_ = 7;
+
+Randomizer::Randomizer() : rng_(time(0)),
+			   distribution_(0, kNumTetroTypes_ - 1)
+{ }
+
+Randomizer::Randomizer(unsigned int seed) : rng_(seed),
+					    distribution_(0, kNumTetroTypes_ - 1)
+{ }
+
+void Randomizer::Seed(unsigned int seed)
+{
+  rng_.seed(seed);
+  distribution_.reset();
+}
+
+TetroType Randomizer::Next()
+{
+  return static_cast<TetroType>(distribution_(rng_));
+}
+
+double Randomizer::Probability(TetroType type) const
+{
+  if (type == kNone)
+    return 0;
+  return 1.0 / kNumTetroTypes_;
+}
+
+Randomizer::~Randomizer()
+{
+  
+}
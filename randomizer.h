@@ -0,0 +1,35 @@
+#ifndef RANDOMIZER_H
+#define RANDOMIZER_H
+
+#include "tetromino.h"
+
+#include <random>
+
+/*
+  Piece generator for a single game.
+  Each game owns its own randomizer so that games seeded
+  with the same value see the same piece sequence.
+*/
+
+class Randomizer
+{
+public:
+  Randomizer();
+  explicit Randomizer(unsigned int seed);
+
+  void Seed(unsigned int seed);
+  TetroType Next();
+
+  // Chance that the next unseen piece is of the given type
+  double Probability(TetroType type) const;
+
+  virtual ~Randomizer();
+private:
+  std::default_random_engine rng_;
+  std::uniform_int_distribution<int> distribution_;
+
+  static const GLint kNumTetroTypes_;
+};
+
+
+#endif // RANDOMIZER_H
@@ -0,0 +1,140 @@
+#include "rollback.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+LoopbackLink::LoopbackLink(double delay_ms, double jitter_ms, uint32_t seed) : delay_ms_(delay_ms),
+									       jitter_ms_(jitter_ms),
+									       rng_(seed)
+{ }
+
+void LoopbackLink::Send(const RollbackPacket& packet, double now_ms)
+{
+  std::uniform_real_distribution<double> jitter(0, jitter_ms_);
+  InFlight sent = { now_ms + delay_ms_ + jitter(rng_), packet };
+  in_flight_.push(sent);
+}
+
+bool LoopbackLink::Receive(double now_ms, RollbackPacket* packet)
+{
+  if (in_flight_.empty() || in_flight_.top().arrival_ms > now_ms)
+    return false;
+  *packet = in_flight_.top().packet;
+  in_flight_.pop();
+  return true;
+}
+
+LoopbackLink::~LoopbackLink()
+{
+}
+
+RollbackSession::RollbackSession(GLint local_player, unsigned int seed, GLint max_rollback) : local_player_(local_player),
+											      max_rollback_(std::max(1, max_rollback)),
+											      match_(seed),
+											      inputs_(2 * max_rollback_ + 2),
+											      snapshots_(max_rollback_ + 1),
+											      frame_(0),
+											      confirmed_(0),
+											      rollback_frame_(std::numeric_limits<uint32_t>::max()),
+											      rollbacks_(0),
+											      frames_resimulated_(0),
+											      longest_rollback_(0),
+											      resimulation_seconds_(0)
+{
+  for (InputRecord& record : inputs_)
+    record.frame = std::numeric_limits<uint32_t>::max();
+}
+
+void RollbackSession::AddLocalInput(GLuint inputs)
+{
+  InputRecord& record = Record(frame_);
+  if (record.frame != frame_)
+    {
+      record.frame = frame_;
+      record.bremote_known = false;
+    }
+  record.local = inputs;
+}
+
+void RollbackSession::AddRemoteInput(uint32_t frame, GLuint inputs)
+{
+  if (frame < confirmed_ || frame >= frame_ + max_rollback_ + 1)
+    return;
+  InputRecord& record = Record(frame);
+  if (record.frame != frame)
+    {
+      record.frame = frame;
+      record.local = 0;
+    }
+  else if (record.bremote_known)
+    return;
+  record.remote = inputs;
+  record.bremote_known = true;
+
+  // played already as if nothing was pressed
+  if (frame < frame_ && inputs != 0)
+    rollback_frame_ = std::min(rollback_frame_, frame);
+  while (confirmed_ < frame_ + max_rollback_ && Record(confirmed_).frame == confirmed_ && Record(confirmed_).bremote_known)
+    ++confirmed_;
+}
+
+void RollbackSession::Save(uint32_t frame)
+{
+  // frames whose inputs are all in can never be gone back to
+  if (frame < confirmed_)
+    return;
+  match_.Save(&snapshots_[frame % snapshots_.size()]);
+}
+
+void RollbackSession::Simulate(uint32_t frame)
+{
+  const InputRecord& record = Record(frame);
+  GLuint inputs[2];
+  inputs[local_player_] = record.local;
+  inputs[1 - local_player_] = record.bremote_known ? record.remote : 0;
+  match_.Update(inputs[0], inputs[1]);
+}
+
+void RollbackSession::CorrectPredictions()
+{
+  if (rollback_frame_ >= frame_)
+    {
+      rollback_frame_ = std::numeric_limits<uint32_t>::max();
+      return;
+    }
+
+  auto start = std::chrono::steady_clock::now();
+  match_.Restore(snapshots_[rollback_frame_ % snapshots_.size()]);
+  for (uint32_t frame = rollback_frame_; frame < frame_; ++frame)
+    {
+      if (frame != rollback_frame_)
+	Save(frame);
+      Simulate(frame);
+    }
+
+  ++rollbacks_;
+  frames_resimulated_ += frame_ - rollback_frame_;
+  longest_rollback_ = std::max<GLint>(longest_rollback_, frame_ - rollback_frame_);
+  resimulation_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  rollback_frame_ = std::numeric_limits<uint32_t>::max();
+}
+
+void RollbackSession::Advance()
+{
+  CorrectPredictions();
+  InputRecord& record = Record(frame_);
+  if (record.frame != frame_)
+    {
+      record.frame = frame_;
+      record.local = 0;
+      record.bremote_known = false;
+    }
+  Save(frame_);
+  Simulate(frame_);
+  ++frame_;
+}
+
+RollbackSession::~RollbackSession()
+{
+}
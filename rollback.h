@@ -0,0 +1,125 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include "game.h"
+#include "playfield.h"
+#include "versus.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <queue>
+#include <random>
+#include <vector>
+
+// One player's inputs for one frame
+struct RollbackPacket
+{
+  uint32_t frame;
+  uint8_t inputs;
+};
+
+/*
+  One direction of a fake network link for testing, which holds each
+  packet for the delay plus a random part of the jitter. Packets can
+  overtake each other when the jitter is larger than the frame time.
+*/
+
+class LoopbackLink
+{
+public:
+  LoopbackLink(double delay_ms, double jitter_ms, uint32_t seed);
+
+  void Send(const RollbackPacket& packet, double now_ms);
+  // Takes the next packet whose time has come
+  bool Receive(double now_ms, RollbackPacket* packet);
+  bool IsEmpty() const { return in_flight_.empty(); }
+
+  virtual ~LoopbackLink();
+private:
+  struct InFlight
+  {
+    double arrival_ms;
+    RollbackPacket packet;
+    bool operator<(const InFlight& other) const { return arrival_ms > other.arrival_ms; }
+  };
+  
+  double delay_ms_;
+  double jitter_ms_;
+  std::mt19937 rng_;
+  std::priority_queue<InFlight> in_flight_;
+};
+
+/*
+  Head to head play where each machine runs both games of a VersusMatch.
+  The remote player's inputs for frames they haven't reached us yet
+  are predicted to be nothing, since inputs are presses rather than
+  keys held down. Every frame that could still be mispredicted gets
+  a snapshot of both games, and when the real input turns out to
+  differ, both games go back to the frame it was for and play forward
+  again in the same step. A machine stops advancing while the remote
+  player is as many frames behind as it can roll back.
+*/
+
+class RollbackSession
+{
+public:
+  RollbackSession(GLint local_player, unsigned int seed, GLint max_rollback = 10);
+
+  // True unless waiting for the remote player to catch up
+  bool CanAdvance() const { return frame_ < confirmed_ + max_rollback_; }
+  // Inputs for the frame about to be played, to be sent to the remote player as well
+  void AddLocalInput(GLuint inputs);
+  void AddRemoteInput(uint32_t frame, GLuint inputs);
+  // Corrects any misprediction, then plays one frame
+  void Advance();
+  // Replays from the earliest frame a remote input was mispredicted for
+  void CorrectPredictions();
+
+  const VersusMatch& GetMatch() const { return match_; }
+  const Game& GetGame(GLint player) const { return match_.GetGame(player); }
+  const PlayField& GetPlayField(GLint player) const { return match_.GetPlayField(player); }
+  uint32_t Frame() const { return frame_; }
+  // Frames for which both players' inputs are known
+  uint32_t ConfirmedFrame() const { return confirmed_; }
+
+  GLuint Rollbacks() const { return rollbacks_; }
+  GLuint FramesResimulated() const { return frames_resimulated_; }
+  GLint LongestRollback() const { return longest_rollback_; }
+  double ResimulationSeconds() const { return resimulation_seconds_; }
+  
+  virtual ~RollbackSession();
+private:
+  RollbackSession(const RollbackSession&);
+  void operator=(const RollbackSession&);
+
+  struct InputRecord
+  {
+    uint32_t frame;
+    GLuint local;
+    GLuint remote;
+    bool bremote_known;
+  };
+
+  InputRecord& Record(uint32_t frame) { return inputs_[frame % inputs_.size()]; }
+  void Save(uint32_t frame);
+  void Simulate(uint32_t frame);
+  
+  GLint local_player_;
+  GLint max_rollback_;
+  VersusMatch match_;
+  // the remote player can be up to max_rollback_ frames ahead of us as well as behind
+  std::vector<InputRecord> inputs_;
+  std::vector<VersusSnapshot> snapshots_;
+  
+  uint32_t frame_;
+  uint32_t confirmed_;
+  uint32_t rollback_frame_;
+  
+  GLuint rollbacks_;
+  GLuint frames_resimulated_;
+  GLint longest_rollback_;
+  double resimulation_seconds_;
+};
+
+
+#endif // ROLLBACK_H
@@ -0,0 +1,127 @@
+#include "game.h"
+#include "playfield.h"
+#include "rollback.h"
+#include "versus.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+/*
+  Plays two rollback peers against each other over a loopback link
+  with scripted inputs, then checks that both peers ended up with the
+  same games as a run with no network at all.
+*/
+
+const double kFrameMs = 1000.0 / 60.0;
+
+void Usage()
+{
+  std::cerr << "usage: rollback [--frames <n>] [--delay <ms>] [--jitter <ms>] [--window <frames>] [--seed <n>]" << std::endl;
+}
+
+// About one press every ten frames, the same on every machine
+GLuint ScriptedInput(uint32_t seed, GLint player, uint32_t frame)
+{
+  uint32_t hash = seed * 0x9e3779b9u ^ (player + 1) * 0x85ebca6bu ^ frame * 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  hash *= 0x7feb352du;
+  hash ^= hash >> 15;
+  if (hash % 10 != 0)
+    return 0;
+  return 1 << ((hash >> 8) % 7);
+}
+
+bool SameGame(const Game& a, const PlayField& pa, const Game& b, const PlayField& pb)
+{
+  return a.Score() == b.Score() && a.Lines() == b.Lines() && a.PiecesSpawned() == b.PiecesSpawned() &&
+    a.PendingGarbage() == b.PendingGarbage() &&
+    a.IsGameOver() == b.IsGameOver() && pa.FallingTetroType() == pb.FallingTetroType() &&
+    pa.FallingTetroRow() == pb.FallingTetroRow() && pa.FallingTetroCol() == pb.FallingTetroCol() &&
+    std::equal(pa.Tiles(), pa.Tiles() + pa.NumCols() * pa.NumTileRows(), pb.Tiles());
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t frames = 3600, seed = 1;
+  double delay_ms = 50, jitter_ms = 20;
+  GLint window = 10;
+  for (GLint arg = 1; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (arg + 1 >= argc)
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+      const char* value = argv[++arg];
+      if (flag == "--frames")
+	frames = strtoul(value, nullptr, 10);
+      else if (flag == "--delay")
+	delay_ms = atof(value);
+      else if (flag == "--jitter")
+	jitter_ms = atof(value);
+      else if (flag == "--window")
+	window = atoi(value);
+      else if (flag == "--seed")
+	seed = strtoul(value, nullptr, 10);
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+
+  RollbackSession first(0, seed, window), second(1, seed, window);
+  RollbackSession* peers[2] = { &first, &second };
+  LoopbackLink links[2] = { LoopbackLink(delay_ms, jitter_ms, seed), LoopbackLink(delay_ms, jitter_ms, seed + 1) };
+  GLuint stalls = 0;
+  double now_ms = 0;
+  while (peers[0]->ConfirmedFrame() < frames || peers[1]->ConfirmedFrame() < frames)
+    {
+      for (GLint i = 0; i < 2; ++i)
+	{
+	  RollbackSession& peer = *peers[i];
+	  RollbackPacket packet;
+	  while (links[1 - i].Receive(now_ms, &packet))
+	    peer.AddRemoteInput(packet.frame, packet.inputs);
+	  if (peer.Frame() >= frames)
+	    continue;
+	  if (!peer.CanAdvance())
+	    {
+	      ++stalls;
+	      continue;
+	    }
+	  packet.frame = peer.Frame();
+	  packet.inputs = ScriptedInput(seed, i, packet.frame);
+	  peer.AddLocalInput(packet.inputs);
+	  links[i].Send(packet, now_ms);
+	  peer.Advance();
+	}
+      now_ms += kFrameMs;
+    }
+
+  // the same inputs with nothing in between
+  VersusMatch match(seed);
+  for (uint32_t frame = 0; frame < frames; ++frame)
+    match.Update(ScriptedInput(seed, 0, frame), ScriptedInput(seed, 1, frame));
+
+  bool bmatched = true;
+  for (RollbackSession* peer_pointer : peers)
+    {
+      RollbackSession& peer = *peer_pointer;
+      peer.CorrectPredictions();
+      for (GLint i = 0; i < 2; ++i)
+	bmatched = bmatched && SameGame(peer.GetGame(i), peer.GetPlayField(i), match.GetGame(i), match.GetPlayField(i)) &&
+	  peer.GetMatch().LinesSent(i) == match.LinesSent(i);
+      std::cout << peer.Rollbacks() << " rollbacks, " << peer.FramesResimulated() << " frames played again, longest "
+		<< peer.LongestRollback() << ", " << peer.ResimulationSeconds() * 1e6 / std::max(1u, peer.FramesResimulated())
+		<< " us per frame played again" << std::endl;
+    }
+  std::cout << match.LinesSent(0) << " and " << match.LinesSent(1) << " garbage lines sent" << std::endl;
+  std::cout << stalls << " frames stalled waiting for input, "
+	    << (bmatched ? "both peers match" : "MISMATCH") << std::endl;
+  return bmatched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
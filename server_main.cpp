@@ -0,0 +1,263 @@
+#include "leaderboard.h"
+#include "match_server.h"
+#include "metrics.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+  Runs the match server until interrupted, printing its counters every
+  few seconds. "bench" connects the given number of clients that start
+  games and press random keys, to load a server from the same box.
+*/
+
+volatile sig_atomic_t bstop = 0;
+
+void OnSignal(int)
+{
+  bstop = 1;
+}
+
+void Usage()
+{
+  std::cerr << "usage: server [--port <n>] [--unix <path>] [--workers <n>] [--leaderboard <log>] [--metrics <port>]" << std::endl;
+  std::cerr << "       server bench (--port <n> | --unix <path>) <sessions> <seconds>" << std::endl;
+}
+
+// Every session needs a descriptor, so take as many as we're allowed
+void RaiseFileLimit()
+{
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+      limit.rlim_cur = limit.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int Connect(GLint port, const std::string& path)
+{
+  if (!path.empty())
+    {
+      sockaddr_un address;
+      std::memset(&address, 0, sizeof(address));
+      address.sun_family = AF_UNIX;
+      std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+      int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+      if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+	  close(fd);
+	  return -1;
+	}
+      return fd;
+    }
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+      close(fd);
+      return -1;
+    }
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+void Send(int fd, const std::string& message)
+{
+  ssize_t nwritten = write(fd, message.data(), message.size());
+  (void)nwritten;
+}
+
+int RunBench(GLint port, const std::string& path, GLint nsessions, double seconds)
+{
+  struct Client
+  {
+    int fd;
+    std::string input;
+  };
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Client> clients(nsessions);
+  for (GLint i = 0; i < nsessions; ++i)
+    {
+      clients[i].fd = Connect(port, path);
+      if (clients[i].fd < 0)
+	{
+	  std::cerr << "Connected only " << i << " sessions: " << strerror(errno) << std::endl;
+	  return EXIT_FAILURE;
+	}
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u32 = i;
+      epoll_ctl(epoll_fd, EPOLL_CTL_ADD, clients[i].fd, &event);
+      Send(clients[i].fd, "start " + std::to_string(i) + "\n");
+    }
+
+  typedef std::chrono::steady_clock Clock;
+  std::mt19937 random(1);
+  const char kKeys[] = "LRXZDHC";
+  uint64_t pieces = 0, games = 0, keys_sent = 0;
+  Clock::time_point start = Clock::now(), next_keys = start;
+  std::vector<epoll_event> events(1024);
+  char buffer[4096];
+  while (Clock::now() - start < std::chrono::duration<double>(seconds))
+    {
+      if (Clock::now() >= next_keys)
+	{
+	  // roughly one key every eight frames per player
+	  for (GLint i = 0; i < nsessions; ++i)
+	    if (random() % 8 == 0)
+	      {
+		Send(clients[i].fd, std::string("keys ") + kKeys[random() % 7] + "\n");
+		++keys_sent;
+	      }
+	  next_keys += std::chrono::milliseconds(16);
+	}
+
+      GLint nevents = epoll_wait(epoll_fd, events.data(), events.size(), 1);
+      for (GLint e = 0; e < nevents; ++e)
+	{
+	  Client& client = clients[events[e].data.u32];
+	  ssize_t nread = read(client.fd, buffer, sizeof(buffer));
+	  if (nread <= 0)
+	    {
+	      std::cerr << "Server closed a session" << std::endl;
+	      return EXIT_FAILURE;
+	    }
+	  client.input.append(buffer, nread);
+	  size_t line_start = 0, end;
+	  while ((end = client.input.find('\n', line_start)) != std::string::npos)
+	    {
+	      if (client.input.compare(line_start, 6, "piece ") == 0)
+		++pieces;
+	      else if (client.input.compare(line_start, 5, "over ") == 0)
+		{
+		  ++games;
+		  Send(client.fd, "start " + std::to_string(random()) + "\n");
+		}
+	      line_start = end + 1;
+	    }
+	  client.input.erase(0, line_start);
+	}
+    }
+
+  double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cout << nsessions << " sessions: " << static_cast<uint64_t>(pieces / elapsed) << " pieces/s, "
+	    << games << " games finished, " << static_cast<uint64_t>(keys_sent / elapsed) << " key messages/s" << std::endl;
+  for (Client& client : clients)
+    close(client.fd);
+  close(epoll_fd);
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+  GLint port = -1, nworkers = 0, metrics_port = -1;
+  std::string path, leaderboard_path;
+  std::vector<std::string> positional;
+  bool bbench = argc >= 2 && std::string(argv[1]) == "bench";
+
+  for (GLint arg = bbench ? 2 : 1; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (flag == "--port" && arg + 1 < argc)
+	port = atoi(argv[++arg]);
+      else if (flag == "--unix" && arg + 1 < argc)
+	path = argv[++arg];
+      else if (flag == "--workers" && arg + 1 < argc)
+	nworkers = atoi(argv[++arg]);
+      else if (flag == "--leaderboard" && arg + 1 < argc)
+	leaderboard_path = argv[++arg];
+      else if (flag == "--metrics" && arg + 1 < argc)
+	metrics_port = atoi(argv[++arg]);
+      else if (flag.compare(0, 2, "--") != 0)
+	positional.push_back(flag);
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+  RaiseFileLimit();
+
+  if (bbench)
+    {
+      if (positional.size() != 2 || (port < 0 && path.empty()))
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+      return RunBench(port, path, atoi(positional[0].c_str()), atof(positional[1].c_str()));
+    }
+
+  if (!positional.empty())
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+  if (port < 0 && path.empty())
+    port = 7420;
+
+  Leaderboard leaderboard;
+  if (!leaderboard_path.empty() && !leaderboard.Open(leaderboard_path))
+    {
+      std::cerr << leaderboard.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+  MetricsServer metrics_server;
+  if (metrics_port >= 0 && !metrics_server.Start(metrics_port))
+    {
+      std::cerr << metrics_server.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+  MatchServer server(nworkers);
+  if (leaderboard.IsOpen())
+    server.SetLeaderboard(&leaderboard);
+  if ((port >= 0 && !server.ListenTcp(port)) || (!path.empty() && !server.ListenUnix(path)))
+    {
+      std::cerr << server.Error() << std::endl;
+      return EXIT_FAILURE;
+    }
+  signal(SIGINT, OnSignal);
+  signal(SIGTERM, OnSignal);
+  signal(SIGPIPE, SIG_IGN);
+  server.Start();
+
+  auto last = std::chrono::steady_clock::now();
+  while (!bstop)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      auto now = std::chrono::steady_clock::now();
+      double seconds = std::chrono::duration<double>(now - last).count();
+      if (seconds < 5)
+	continue;
+      last = now;
+      MatchServerStats stats = server.Stats();
+      std::cout << stats.sessions << " sessions, " << static_cast<uint64_t>(stats.frames / seconds) << " frames/s in "
+		<< static_cast<uint64_t>(stats.updates / seconds) << " updates/s, "
+		<< static_cast<uint64_t>(stats.messages / seconds) << " messages/s, slowest tick "
+		<< stats.slowest_tick * 1000 << " ms" << std::endl;
+    }
+  server.Stop();
+  return EXIT_SUCCESS;
+}
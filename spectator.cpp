@@ -0,0 +1,363 @@
+#include "spectator.h"
+
+#include <algorithm>
+
+namespace
+{
+  enum MessageFlag
+    {
+      kKeyframe = 1 << 0,
+      kPiece = 1 << 1,
+      kCells = 1 << 2,
+      kClear = 1 << 3,
+      kCollapse = 1 << 4,
+      kHud = 1 << 5,
+      kQueue = 1 << 6,
+      kExtended = 1 << 7
+    };
+
+  enum ExtendedFlag
+    {
+      kGameOver = 1 << 0,
+      kFrames = 1 << 1
+    };
+
+  // set in the first piece byte when a new piece comes with its full position
+  const uint8_t kNewPiece = 0x80;
+
+  void PutVarint(uint32_t value, std::vector<uint8_t>* out)
+  {
+    while (value >= 0x80)
+      {
+	out->push_back(value | 0x80);
+	value >>= 7;
+      }
+    out->push_back(value);
+  }
+
+  void PutSigned(int32_t value, std::vector<uint8_t>* out)
+  {
+    PutVarint((static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31), out);
+  }
+
+  // Reads the bytes of one message, remembering if it ran off the end
+  struct Reader
+  {
+    const uint8_t* data;
+    const uint8_t* end;
+    bool bfailed;
+
+    uint8_t Byte()
+    {
+      if (data == end)
+	{
+	  bfailed = true;
+	  return 0;
+	}
+      return *data++;
+    }
+    
+    uint32_t Varint()
+    {
+      uint32_t value = 0;
+      for (GLint shift = 0; shift < 35; shift += 7)
+	{
+	  uint8_t byte = Byte();
+	  value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+	  if (!(byte & 0x80))
+	    return value;
+	}
+      bfailed = true;
+      return 0;
+    }
+
+    int32_t Signed()
+    {
+      uint32_t value = Varint();
+      return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+    }
+  };
+
+  TetroType PieceFromByte(GLint value)
+  {
+    return value >= 1 && value <= 7 ? static_cast<TetroType>(value - 1) : kNone;
+  }
+}
+
+SpectatorBoard::SpectatorBoard()
+{
+  Reset(0, 0);
+}
+
+void SpectatorBoard::Reset(GLint rows, GLint cols)
+{
+  nrows = rows;
+  ncols = cols;
+  tiles.assign(rows * cols, kEmpty);
+  piece = kNone;
+  rotation = kRsZero;
+  row = 0;
+  col = 0;
+  next = kNone;
+  held = kNone;
+  score = 0;
+  lines = 0;
+  level = 0;
+  clearing = 0;
+  bgame_over = false;
+}
+
+void SpectatorBoard::Collapse()
+{
+  GLint to = 0;
+  for (GLint from = 0; from < nrows; ++from)
+    {
+      if (clearing & (1u << from))
+	continue;
+      if (to != from)
+	std::copy(tiles.begin() + from * ncols, tiles.begin() + (from + 1) * ncols, tiles.begin() + to * ncols);
+      ++to;
+    }
+  std::fill(tiles.begin() + to * ncols, tiles.end(), kEmpty);
+  clearing = 0;
+}
+
+SpectatorEncoder::SpectatorEncoder(GLint keyframe_interval) : keyframe_interval_(keyframe_interval),
+							      frames_since_keyframe_(0),
+							      bkeyframe_requested_(true)
+{ }
+
+void SpectatorEncoder::Encode(const Game& game, const PlayField& playfield, std::vector<uint8_t>* out, GLint frames)
+{
+  const GLint nrows = playfield.NumTileRows();
+  const GLint ncols = playfield.NumCols();
+  uint8_t flags = 0, extended = 0;
+  frames_since_keyframe_ += frames;
+  if (bkeyframe_requested_ || frames_since_keyframe_ >= keyframe_interval_ || sent_.nrows != nrows || sent_.ncols != ncols)
+    {
+      flags |= kKeyframe;
+      sent_.Reset(nrows, ncols);
+      frames_since_keyframe_ = 0;
+      bkeyframe_requested_ = false;
+    }
+  if (game.IsGameOver() != sent_.bgame_over)
+    extended |= kGameOver;
+  if (frames != 1)
+    extended |= kFrames;
+  if (extended)
+    flags |= kExtended;
+
+  size_t header = out->size();
+  out->push_back(0);
+  if (extended)
+    out->push_back(extended);
+  if (flags & kKeyframe)
+    {
+      out->push_back(nrows);
+      out->push_back(ncols);
+    }
+  if (extended & kFrames)
+    PutVarint(frames, out);
+
+  uint32_t clearing = 0;
+  for (int row : playfield.LinesToClear())
+    clearing |= 1u << row;
+  if (sent_.clearing && !clearing)
+    {
+      flags |= kCollapse;
+      sent_.Collapse();
+    }
+  if (clearing != sent_.clearing)
+    {
+      flags |= kClear;
+      PutVarint(clearing, out);
+      sent_.clearing = clearing;
+    }
+
+  const Tetromino& falling = playfield.FallingTetro();
+  if (falling.Type() != sent_.piece)
+    {
+      flags |= kPiece;
+      out->push_back(kNewPiece | (falling.Type() + 1) << 2 | falling.RotationState());
+      PutSigned(playfield.FallingTetroRow(), out);
+      PutSigned(playfield.FallingTetroCol(), out);
+    }
+  else if (falling.RotationState() != sent_.rotation || playfield.FallingTetroRow() != sent_.row || playfield.FallingTetroCol() != sent_.col)
+    {
+      flags |= kPiece;
+      out->push_back(falling.RotationState());
+      PutSigned(playfield.FallingTetroRow() - sent_.row, out);
+      PutSigned(playfield.FallingTetroCol() - sent_.col, out);
+    }
+  sent_.piece = falling.Type();
+  sent_.rotation = falling.RotationState();
+  sent_.row = playfield.FallingTetroRow();
+  sent_.col = playfield.FallingTetroCol();
+
+  // masks are 16 bits, which is as wide as boards go
+  uint16_t changed[32];
+  GLint nchanged = 0;
+  const TileColor* tiles = playfield.Tiles();
+  for (GLint row = 0; row < nrows && row < 32; ++row)
+    {
+      uint16_t mask = 0;
+      for (GLint col = 0; col < ncols; ++col)
+	if (tiles[row * ncols + col] != sent_.tiles[row * ncols + col])
+	  mask |= 1 << col;
+      changed[row] = mask;
+      nchanged += mask != 0;
+    }
+  if (nchanged)
+    {
+      flags |= kCells;
+      PutVarint(nchanged, out);
+      for (GLint row = 0; row < nrows && row < 32; ++row)
+	{
+	  if (!changed[row])
+	    continue;
+	  out->push_back(row);
+	  out->push_back(changed[row] & 0xff);
+	  out->push_back(changed[row] >> 8);
+	  // colours two to a byte, 0 for empty
+	  GLint ncolors = 0;
+	  for (GLint col = 0; col < ncols; ++col)
+	    {
+	      if (!(changed[row] & (1 << col)))
+		continue;
+	      TileColor color = tiles[row * ncols + col];
+	      sent_.tiles[row * ncols + col] = color;
+	      if (ncolors++ % 2 == 0)
+		out->push_back(color + 1);
+	      else
+		out->back() |= (color + 1) << 4;
+	    }
+	}
+    }
+
+  if (game.Score() != sent_.score || game.Lines() != sent_.lines || game.Level() != sent_.level)
+    {
+      flags |= kHud;
+      PutSigned(game.Score() - sent_.score, out);
+      PutSigned(game.Lines() - sent_.lines, out);
+      PutSigned(game.Level() - sent_.level, out);
+      sent_.score = game.Score();
+      sent_.lines = game.Lines();
+      sent_.level = game.Level();
+    }
+
+  if (game.Next() != sent_.next || game.Held() != sent_.held)
+    {
+      flags |= kQueue;
+      out->push_back((game.Next() + 1) | (game.Held() + 1) << 4);
+      sent_.next = game.Next();
+      sent_.held = game.Held();
+    }
+  sent_.bgame_over = game.IsGameOver();
+
+  (*out)[header] = flags;
+}
+
+SpectatorEncoder::~SpectatorEncoder()
+{
+}
+
+SpectatorDecoder::SpectatorDecoder() : bsynced_(false),
+				       frame_(0)
+{ }
+
+size_t SpectatorDecoder::Decode(const uint8_t* data, size_t size)
+{
+  Reader reader = { data, data + size, false };
+  uint8_t flags = reader.Byte();
+  uint8_t extended = flags & kExtended ? reader.Byte() : 0;
+  
+  // a message is read through whether or not we're synced, to find where the next one starts
+  SpectatorBoard& board = scratch_;
+  board = board_;
+  if (flags & kKeyframe)
+    {
+      GLint nrows = reader.Byte();
+      GLint ncols = reader.Byte();
+      if (nrows > 32 || ncols > 16)
+	return 0;
+      board.Reset(nrows, ncols);
+    }
+  uint32_t frames = extended & kFrames ? reader.Varint() : 1;
+
+  if (flags & kCollapse)
+    board.Collapse();
+  if (flags & kClear)
+    board.clearing = reader.Varint();
+
+  if (flags & kPiece)
+    {
+      uint8_t byte = reader.Byte();
+      board.rotation = static_cast<RotationState>(byte & 3);
+      if (byte & kNewPiece)
+	{
+	  board.piece = PieceFromByte((byte >> 2) & 0xf);
+	  board.row = reader.Signed();
+	  board.col = reader.Signed();
+	}
+      else
+	{
+	  board.row += reader.Signed();
+	  board.col += reader.Signed();
+	}
+    }
+
+  if (flags & kCells)
+    {
+      uint32_t nrows = reader.Varint();
+      for (uint32_t i = 0; i < nrows && !reader.bfailed; ++i)
+	{
+	  GLint row = reader.Byte();
+	  uint16_t mask = reader.Byte();
+	  mask |= reader.Byte() << 8;
+	  bool bvalid = row < board.nrows && mask >> board.ncols == 0;
+	  GLint ncolors = 0;
+	  uint8_t byte = 0;
+	  for (GLint col = 0; col < 16; ++col)
+	    {
+	      if (!(mask & (1 << col)))
+		continue;
+	      if (ncolors++ % 2 == 0)
+		byte = reader.Byte();
+	      else
+		byte >>= 4;
+	      if (bvalid)
+		board.tiles[row * board.ncols + col] = static_cast<TileColor>((byte & 0xf) - 1);
+	    }
+	}
+    }
+
+  if (flags & kHud)
+    {
+      board.score += reader.Signed();
+      board.lines += reader.Signed();
+      board.level += reader.Signed();
+    }
+  if (flags & kQueue)
+    {
+      uint8_t byte = reader.Byte();
+      board.next = PieceFromByte(byte & 0xf);
+      board.held = PieceFromByte(byte >> 4);
+    }
+  if (extended & kGameOver)
+    board.bgame_over = !board.bgame_over;
+
+  if (reader.bfailed)
+    return 0;
+  if (flags & kKeyframe)
+    bsynced_ = true;
+  if (bsynced_)
+    {
+      std::swap(board_, scratch_);
+      frame_ += frames;
+    }
+  return reader.data - data;
+}
+
+SpectatorDecoder::~SpectatorDecoder()
+{
+}
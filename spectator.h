@@ -0,0 +1,90 @@
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include "game.h"
+#include "playfield.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+// What a spectator sees of one board
+struct SpectatorBoard
+{
+  SpectatorBoard();
+  void Reset(GLint nrows, GLint ncols);
+  // Takes out the rows waiting to be cleared and drops the ones above
+  void Collapse();
+  
+  GLint nrows, ncols;
+  // row major from the bottom, hidden rows included, like PlayField::Tiles
+  std::vector<TileColor> tiles;
+  TetroType piece;
+  RotationState rotation;
+  GLint row, col;
+  TetroType next, held;
+  GLuint score, lines, level;
+  // rows waiting to be cleared, bit per row
+  uint32_t clearing;
+  bool bgame_over;
+};
+
+/*
+  Turns a board into a stream of small per-frame messages for
+  spectators. Each message starts with a byte of flags saying which
+  parts follow, so a frame where nothing happened costs one byte:
+    keyframe    board size; everything else is relative to an empty board
+    piece       a new piece with its position, or how the current one moved
+    cells       for each changed row, a mask of changed cells and their colours
+    clear       the rows that filled up, while the clear animation plays
+    collapse    those rows are removed and everything above drops
+    hud         score, lines and level differences
+    queue       next and held pieces
+    extended    another flags byte: game over, frames since the last message
+  The encoder keeps its own copy of what the spectator has, applies
+  the same collapse the spectator will, and only sends what still
+  differs, so a line clear never resends the rows that fell.
+  Keyframes go out every so often so late joiners can pick up.
+*/
+
+class SpectatorEncoder
+{
+public:
+  explicit SpectatorEncoder(GLint keyframe_interval = 120);
+
+  // Makes the next message a keyframe
+  void RequestKeyframe() { bkeyframe_requested_ = true; }
+  // Appends one message with the changes since the last, covering the given number of frames
+  void Encode(const Game& game, const PlayField& playfield, std::vector<uint8_t>* out, GLint frames = 1);
+
+  virtual ~SpectatorEncoder();
+private:
+  GLint keyframe_interval_;
+  GLint frames_since_keyframe_;
+  bool bkeyframe_requested_;
+  SpectatorBoard sent_;
+};
+
+class SpectatorDecoder
+{
+public:
+  SpectatorDecoder();
+
+  // Applies the message at the start of data, returning its length, or 0 if it's cut short or malformed.
+  // Messages before the first keyframe are skipped over.
+  size_t Decode(const uint8_t* data, size_t size);
+  bool IsSynced() const { return bsynced_; }
+  const SpectatorBoard& Board() const { return board_; }
+  uint64_t Frame() const { return frame_; }
+
+  virtual ~SpectatorDecoder();
+private:
+  SpectatorBoard board_;
+  // the message is applied here first, so a bad one leaves the board alone
+  SpectatorBoard scratch_;
+  bool bsynced_;
+  uint64_t frame_;
+};
+
+
+#endif // SPECTATOR_H
@@ -0,0 +1,142 @@
+#include "game.h"
+#include "playfield.h"
+#include "spectator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Streams scripted games through the spectator encoder and checks
+  that a decoder watching from the start, and one joining late, both
+  see exactly the real board every frame. Prints what the stream
+  costs per frame.
+*/
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+
+void Usage()
+{
+  std::cerr << "usage: spectator [--frames <n>] [--keyframe <frames>] [--seed <n>]" << std::endl;
+}
+
+// Moves and rotations every few frames, with the odd soft or hard drop
+GLuint ScriptedInput(uint32_t seed, uint32_t frame)
+{
+  uint32_t hash = seed * 0x9e3779b9u ^ frame * 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  hash *= 0x7feb352du;
+  hash ^= hash >> 15;
+  if (hash % 6 != 0)
+    return 0;
+  const GLuint kInputs[] = { kInputLeft, kInputRight, kInputLeft, kInputRight, kInputRotateRight, kInputRotateLeft,
+			     kInputSoftDrop, kInputSoftDrop, kInputSoftDrop, kInputHardDrop, kInputHold };
+  return kInputs[(hash >> 8) % (sizeof(kInputs) / sizeof(kInputs[0]))];
+}
+
+bool Matches(const SpectatorBoard& board, const Game& game, const PlayField& playfield)
+{
+  uint32_t clearing = 0;
+  for (int row : playfield.LinesToClear())
+    clearing |= 1u << row;
+  return board.piece == playfield.FallingTetroType() && board.rotation == playfield.FallingTetro().RotationState() &&
+    board.row == playfield.FallingTetroRow() && board.col == playfield.FallingTetroCol() &&
+    board.next == game.Next() && board.held == game.Held() && board.score == game.Score() &&
+    board.lines == game.Lines() && board.level == game.Level() && board.clearing == clearing &&
+    board.bgame_over == game.IsGameOver() &&
+    std::equal(board.tiles.begin(), board.tiles.end(), playfield.Tiles()) &&
+    static_cast<GLint>(board.tiles.size()) == playfield.NumTileRows() * playfield.NumCols();
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t frames = 100000, seed = 1;
+  GLint keyframe_interval = 120;
+  for (GLint arg = 1; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (arg + 1 >= argc)
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+      const char* value = argv[++arg];
+      if (flag == "--frames")
+	frames = strtoul(value, nullptr, 10);
+      else if (flag == "--keyframe")
+	keyframe_interval = atoi(value);
+      else if (flag == "--seed")
+	seed = strtoul(value, nullptr, 10);
+      else
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+    }
+
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+  Game game(&playfield);
+  game.Seed(seed);
+  game.Restart();
+  game.BeginPlay();
+
+  SpectatorEncoder encoder(keyframe_interval);
+  SpectatorDecoder watcher, late_joiner;
+  const uint32_t join_frame = frames / 3;
+  std::vector<uint8_t> message;
+  uint64_t bytes = 0, keyframe_bytes = 0, idle_frames = 0;
+  GLuint keyframes = 0, games = 1, mismatches = 0;
+  size_t largest = 0;
+  double encode_seconds = 0;
+  for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+      if (game.IsGameOver())
+	{
+	  game.Restart();
+	  game.BeginPlay();
+	  ++games;
+	}
+      else
+	{
+	  game.Press(ScriptedInput(seed, frame));
+	  game.Update();
+	}
+
+      message.clear();
+      auto start = std::chrono::steady_clock::now();
+      encoder.Encode(game, playfield, &message);
+      encode_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      bytes += message.size();
+      largest = std::max(largest, message.size());
+      idle_frames += message.size() == 1;
+      if (message[0] & 1)
+	{
+	  ++keyframes;
+	  keyframe_bytes += message.size();
+	}
+
+      if (watcher.Decode(message.data(), message.size()) != message.size() || !Matches(watcher.Board(), game, playfield))
+	++mismatches;
+      if (frame >= join_frame)
+	{
+	  if (late_joiner.Decode(message.data(), message.size()) != message.size())
+	    ++mismatches;
+	  else if (late_joiner.IsSynced() && !Matches(late_joiner.Board(), game, playfield))
+	    ++mismatches;
+	}
+    }
+
+  GLint raw_bytes = playfield.NumTileRows() * playfield.NumCols();
+  std::cout << frames << " frames over " << games << " games: " << static_cast<double>(bytes) / frames << " bytes/frame, "
+	    << static_cast<double>(bytes - keyframe_bytes) / std::max(1u, frames - keyframes) << " between keyframes, "
+	    << 100.0 * idle_frames / frames << "% one byte" << std::endl;
+  std::cout << keyframes << " keyframes of " << static_cast<double>(keyframe_bytes) / std::max(1u, keyframes)
+	    << " bytes, largest message " << largest << ", a board a byte per cell is " << raw_bytes << std::endl;
+  std::cout << encode_seconds * 1e9 / frames << " ns to encode a frame, late joiner "
+	    << (late_joiner.IsSynced() ? "synced" : "NOT SYNCED") << ", " << mismatches << " mismatches" << std::endl;
+  return mismatches == 0 && late_joiner.IsSynced() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
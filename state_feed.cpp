@@ -0,0 +1,261 @@
+#include "state_feed.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t kStateFeedMagic = 0x54464544; // "TFED"
+const uint32_t kStateFeedVersion = 1;
+
+struct StateFeedHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nslots;
+  uint32_t slot_size;
+  std::atomic<uint64_t> published;
+};
+
+// cache line aligned so the writer in one slot doesn't disturb readers of the one before
+struct alignas(64) StateFeedSlot
+{
+  std::atomic<uint64_t> sequence;
+  StateFeedFrame frame;
+};
+
+namespace
+{
+  size_t SlotsOffset()
+  {
+    return (sizeof(StateFeedHeader) + alignof(StateFeedSlot) - 1) / alignof(StateFeedSlot) * alignof(StateFeedSlot);
+  }
+}
+
+StateFeedWriter::StateFeedWriter() : memory_(nullptr),
+				     size_(0),
+				     header_(nullptr),
+				     slots_(nullptr),
+				     published_(0)
+{ }
+
+bool StateFeedWriter::Open(const std::string& name, GLint nslots)
+{
+  Close();
+  size_ = SlotsOffset() + nslots * sizeof(StateFeedSlot);
+  // an old feed left behind goes, but readers still mapping it keep
+  // their pages; truncating it in place would SIGBUS them instead
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    {
+      error_ = name + ": " + strerror(errno);
+      return false;
+    }
+  // a new object reads as zeroes
+  if (ftruncate(fd, size_) != 0)
+    {
+      error_ = name + ": " + strerror(errno);
+      close(fd);
+      shm_unlink(name.c_str());
+      return false;
+    }
+  memory_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory_ == MAP_FAILED)
+    {
+      error_ = name + ": " + strerror(errno);
+      memory_ = nullptr;
+      shm_unlink(name.c_str());
+      return false;
+    }
+
+  name_ = name;
+  header_ = static_cast<StateFeedHeader*>(memory_);
+  slots_ = reinterpret_cast<StateFeedSlot*>(static_cast<char*>(memory_) + SlotsOffset());
+  header_->nslots = nslots;
+  header_->slot_size = sizeof(StateFeedSlot);
+  header_->version = kStateFeedVersion;
+  header_->published.store(0, std::memory_order_relaxed);
+  // readers check the magic last, once everything else is in place
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic = kStateFeedMagic;
+  published_ = 0;
+  return true;
+}
+
+void StateFeedWriter::Close()
+{
+  if (!memory_)
+    return;
+  munmap(memory_, size_);
+  shm_unlink(name_.c_str());
+  memory_ = nullptr;
+  header_ = nullptr;
+  slots_ = nullptr;
+}
+
+void StateFeedWriter::Publish(const Game& game, const PlayField& playfield)
+{
+  if (!header_)
+    return;
+  StateFeedSlot& slot = slots_[published_ % header_->nslots];
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  StateFeedFrame& frame = slot.frame;
+  frame.number = published_;
+  frame.nrows = playfield.NumTileRows();
+  frame.ncols = playfield.NumCols();
+  const GLint ncells = std::min(frame.nrows * frame.ncols, kStateFeedMaxCells);
+  const TileColor* tiles = playfield.Tiles();
+  for (GLint i = 0; i < ncells; ++i)
+    frame.tiles[i] = tiles[i] + 1;
+  frame.falling = playfield.FallingTetroType();
+  frame.rotation = playfield.FallingTetro().RotationState();
+  frame.row = playfield.FallingTetroRow();
+  frame.col = playfield.FallingTetroCol();
+  frame.ghost_row = playfield.GhostRow();
+  frame.ghost_col = playfield.GhostCol();
+  frame.next = game.Next();
+  frame.held = game.Held();
+  frame.score = game.Score();
+  frame.lines = game.Lines();
+  frame.level = game.Level();
+  frame.bpaused_for_line_clear = game.IsPausedForLineClear();
+  frame.bgame_over = game.IsGameOver();
+
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  header_->published.store(++published_, std::memory_order_release);
+}
+
+StateFeedWriter::~StateFeedWriter()
+{
+  Close();
+}
+
+// a live writer is out of a slot in well under a microsecond, so running
+// out of these means it stopped halfway through a Publish
+const GLint StateFeedReader::kMaxAttempts_ = 1000;
+
+StateFeedReader::StateFeedReader() : memory_(nullptr),
+				     size_(0),
+				     header_(nullptr),
+				     slots_(nullptr),
+				     retries_(0)
+{ }
+
+bool StateFeedReader::Open(const std::string& name)
+{
+  Close();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    {
+      error_ = name + ": " + strerror(errno);
+      return false;
+    }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SlotsOffset())
+    {
+      error_ = name + ": not a state feed";
+      close(fd);
+      return false;
+    }
+  size_ = info.st_size;
+  memory_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory_ == MAP_FAILED)
+    {
+      error_ = name + ": " + strerror(errno);
+      memory_ = nullptr;
+      return false;
+    }
+
+  const StateFeedHeader* header = static_cast<const StateFeedHeader*>(memory_);
+  bool bvalid = header->magic == kStateFeedMagic;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  bvalid = bvalid && header->version == kStateFeedVersion && header->slot_size == sizeof(StateFeedSlot) &&
+    header->nslots > 0 && SlotsOffset() + header->nslots * sizeof(StateFeedSlot) <= size_;
+  if (!bvalid)
+    {
+      error_ = name + ": not a state feed this version can read";
+      Close();
+      return false;
+    }
+  header_ = header;
+  slots_ = reinterpret_cast<const StateFeedSlot*>(static_cast<const char*>(memory_) + SlotsOffset());
+  return true;
+}
+
+void StateFeedReader::Close()
+{
+  if (!memory_)
+    return;
+  munmap(memory_, size_);
+  memory_ = nullptr;
+  header_ = nullptr;
+  slots_ = nullptr;
+}
+
+uint64_t StateFeedReader::Published() const
+{
+  return header_ ? header_->published.load(std::memory_order_acquire) : 0;
+}
+
+bool StateFeedReader::Copy(const StateFeedSlot& slot, StateFeedFrame* frame) const
+{
+  uint64_t before = slot.sequence.load(std::memory_order_acquire);
+  if (before & 1)
+    {
+      ++retries_;
+      return false;
+    }
+  std::memcpy(frame, &slot.frame, sizeof(StateFeedFrame));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot.sequence.load(std::memory_order_relaxed) != before)
+    {
+      ++retries_;
+      return false;
+    }
+  return true;
+}
+
+bool StateFeedReader::ReadLatest(StateFeedFrame* frame) const
+{
+  if (!header_)
+    return false;
+  for (GLint attempt = 0; attempt < kMaxAttempts_; ++attempt)
+    {
+      uint64_t published = Published();
+      if (published == 0)
+	return false;
+      // the writer may have lapped us onto a newer frame, which is just as good
+      if (Copy(slots_[(published - 1) % header_->nslots], frame))
+	return true;
+    }
+  return false;
+}
+
+bool StateFeedReader::Read(uint64_t number, StateFeedFrame* frame) const
+{
+  if (!header_)
+    return false;
+  for (GLint attempt = 0; attempt < kMaxAttempts_; ++attempt)
+    {
+      uint64_t published = Published();
+      if (number >= published || published - number > header_->nslots)
+	return false;
+      if (Copy(slots_[number % header_->nslots], frame))
+	return frame->number == number;
+    }
+  return false;
+}
+
+StateFeedReader::~StateFeedReader()
+{
+  Close();
+}
@@ -0,0 +1,107 @@
+#ifndef STATE_FEED_H
+#define STATE_FEED_H
+
+#include "game.h"
+#include "playfield.h"
+
+#include <GL/glew.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+const GLint kStateFeedMaxCells = 32 * 16;
+
+// One published frame, laid out the same in every process
+struct StateFeedFrame
+{
+  uint64_t number;
+  int32_t nrows, ncols;
+  // tile colour + 1, row major from the bottom, hidden rows included
+  uint8_t tiles[kStateFeedMaxCells];
+  int8_t falling, rotation;
+  int8_t next, held;
+  int16_t row, col;
+  int16_t ghost_row, ghost_col;
+  uint32_t score, lines, level;
+  uint8_t bpaused_for_line_clear;
+  uint8_t bgame_over;
+};
+
+/*
+  Live game state in POSIX shared memory for other processes on the
+  host, such as stream overlays. Frames go round a ring of slots,
+  each guarded by a sequence number that is odd while the slot is
+  being written. A reader copies a slot and keeps the copy only if
+  the sequence was even and unchanged across it, so readers never
+  block the game or make a system call, and the game never waits for
+  them. Old frames stay readable until the ring comes round again.
+*/
+
+struct StateFeedHeader;
+struct StateFeedSlot;
+
+class StateFeedWriter
+{
+public:
+  StateFeedWriter();
+
+  bool Open(const std::string& name, GLint nslots = 64);
+  void Close();
+  bool IsOpen() const { return header_ != nullptr; }
+  const std::string& Error() const { return error_; }
+
+  void Publish(const Game& game, const PlayField& playfield);
+
+  virtual ~StateFeedWriter();
+private:
+  StateFeedWriter(const StateFeedWriter&);
+  void operator=(const StateFeedWriter&);
+
+  std::string name_;
+  std::string error_;
+  void* memory_;
+  size_t size_;
+  StateFeedHeader* header_;
+  StateFeedSlot* slots_;
+  uint64_t published_;
+};
+
+class StateFeedReader
+{
+public:
+  StateFeedReader();
+
+  bool Open(const std::string& name);
+  void Close();
+  const std::string& Error() const { return error_; }
+
+  // Number of frames published so far
+  uint64_t Published() const;
+  // Copies the newest frame, false if there is none yet or the
+  // writer never finishes with its slot, as when it died mid-Publish
+  bool ReadLatest(StateFeedFrame* frame) const;
+  // Copies a given frame, false once the ring has moved past it or
+  // the slot stays mid-write
+  bool Read(uint64_t number, StateFeedFrame* frame) const;
+  // Copies that went wrong because the writer was in the slot
+  uint64_t Retries() const { return retries_; }
+  
+  virtual ~StateFeedReader();
+private:
+  StateFeedReader(const StateFeedReader&);
+  void operator=(const StateFeedReader&);
+
+  bool Copy(const StateFeedSlot& slot, StateFeedFrame* frame) const;
+
+  static const GLint kMaxAttempts_;
+  
+  std::string error_;
+  void* memory_;
+  size_t size_;
+  const StateFeedHeader* header_;
+  const StateFeedSlot* slots_;
+  mutable uint64_t retries_;
+};
+
+
+#endif // STATE_FEED_H
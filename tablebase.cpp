@@ -0,0 +1,440 @@
+#include "tablebase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kTablebaseMagic[8] = { 'T', 'E', 'T', 'R', 'I', 'S', 'T', 'B' };
+static const uint32_t kTablebaseVersion = 2;
+// full rows never stay on the board, so no stack packs to all ones
+static const uint32_t kEmptySlot = ~0u;
+static const GLint kMaxPackedCells = 32;
+static const GLint kKeysPerBucket = 4;
+// small enough that even a modest well splits across every thread
+static const uint64_t kKeysPerPartition = 1 << 14;
+// a bucket with no free slots after this many tries means a broken hash, not bad luck
+static const uint32_t kMaxDisplacement = 1 << 20;
+
+// Row r of the well lives in bits [r * ncols, (r + 1) * ncols)
+static uint32_t PackBoard(const BitBoard& board, GLint nrows)
+{
+  uint32_t key = 0;
+  for (GLint row = nrows - 1; row >= 0; --row)
+    key = (key << board.NumCols()) | board.Row(row);
+  return key;
+}
+
+static BitBoard UnpackBoard(uint32_t key, GLint ncols, GLint nrows)
+{
+  BitBoard board(nrows, ncols);
+  for (GLint row = 0; row < nrows; ++row, key >>= ncols)
+    board.SetRow(row, key & ((1u << ncols) - 1));
+  return board;
+}
+
+static uint32_t CanonicalKey(uint32_t key, GLint ncols, GLint nrows)
+{
+  uint32_t mirrored = 0;
+  for (GLint row = 0; row < nrows; ++row)
+    {
+      uint32_t mask = (key >> (row * ncols)) & ((1u << ncols) - 1);
+      uint32_t reversed = 0;
+      for (GLint col = 0; col < ncols; ++col)
+	reversed |= ((mask >> col) & 1) << (ncols - 1 - col);
+      mirrored |= reversed << (row * ncols);
+    }
+  return std::min(key, mirrored);
+}
+
+static uint64_t Mix(uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+static uint64_t Bucket(uint32_t key, uint64_t nbuckets)
+{
+  return Mix(key) % nbuckets;
+}
+
+static uint64_t Slot(uint32_t key, uint32_t displacement, uint64_t nslots)
+{
+  return Mix(key ^ (static_cast<uint64_t>(displacement + 1) << 32)) % nslots;
+}
+
+static uint64_t Partition(uint32_t key, uint64_t npartitions)
+{
+  // the high half of the hash, which the bucket doesn't lean on
+  return (Mix(key) >> 32) * npartitions >> 32;
+}
+
+// A stack's slot, through its partition's buckets and slots
+static uint64_t IndexSlot(uint32_t key, uint64_t npartitions, const uint64_t* partition_buckets, const uint64_t* partition_slots,
+			  const uint32_t* displacements)
+{
+  const uint64_t partition = Partition(key, npartitions);
+  const uint64_t first_bucket = partition_buckets[partition], first_slot = partition_slots[partition];
+  const uint32_t displacement = displacements[first_bucket + Bucket(key, partition_buckets[partition + 1] - first_bucket)];
+  return first_slot + Slot(key, displacement, partition_slots[partition + 1] - first_slot);
+}
+
+TablebaseGenerator::TablebaseGenerator(GLint ncols, GLint nrows, ThreadPool* pool) : ncols_(ncols),
+										      nrows_(nrows),
+										      pool_(pool),
+										      horizon_(1000),
+										      tolerance_(1e-4),
+										      nstates_(0),
+										      iterations_(0),
+										      max_change_(0)
+{ }
+
+bool TablebaseGenerator::Generate()
+{
+  if (ncols_ * nrows_ > kMaxPackedCells)
+    {
+      error_ = "wells have at most 32 cells";
+      return false;
+    }
+  
+  std::vector<uint32_t> keys;
+  FindReachable(&keys);
+  nstates_ = keys.size();
+  if (!BuildIndex(keys))
+    return false;
+  Solve();
+  return true;
+}
+
+void TablebaseGenerator::FindReachable(std::vector<uint32_t>* keys)
+{
+  const uint64_t nkeys = 1ULL << (ncols_ * nrows_);
+  std::vector< std::atomic<uint64_t> > seen((nkeys + 63) / 64);
+  for (std::atomic<uint64_t>& word : seen)
+    word = 0;
+
+  // breadth first from the empty well, one piece per level
+  std::vector<uint32_t> frontier(1, 0);
+  seen[0] = 1;
+  const GLint nchunks = pool_->NumThreads() * 4;
+  std::vector< std::vector<uint32_t> > found(nchunks);
+  while (!frontier.empty())
+    {
+      pool_->ParallelFor(nchunks, [&](GLint chunk)
+			 {
+			   std::vector<Placement> placements;
+			   std::vector<uint32_t>& next = found[chunk];
+			   next.clear();
+			   for (size_t i = chunk; i < frontier.size(); i += nchunks)
+			     {
+			       BitBoard board = UnpackBoard(frontier[i], ncols_, nrows_);
+			       for (GLint type = kTetroI; type <= kTetroZ; ++type)
+				 {
+				   GenerateDropPlacements(board, static_cast<TetroType>(type), &placements);
+				   for (const Placement& placement : placements)
+				     {
+				       BitBoard child(board);
+				       child.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+				       uint32_t key = CanonicalKey(PackBoard(child, nrows_), ncols_, nrows_);
+				       uint64_t bit = 1ULL << (key & 63);
+				       if (!(seen[key >> 6].fetch_or(bit) & bit))
+					 next.push_back(key);
+				     }
+				 }
+			     }
+			 });
+      frontier.clear();
+      for (const std::vector<uint32_t>& next : found)
+	frontier.insert(frontier.end(), next.begin(), next.end());
+    }
+
+  keys->clear();
+  for (uint64_t word = 0; word < seen.size(); ++word)
+    {
+      for (uint64_t bits = seen[word]; bits; bits &= bits - 1)
+	keys->push_back(word * 64 + __builtin_ctzll(bits));
+    }
+}
+
+bool TablebaseGenerator::BuildIndex(const std::vector<uint32_t>& keys)
+{
+  const uint64_t npartitions = std::max<uint64_t>(1, (keys.size() + kKeysPerPartition - 1) / kKeysPerPartition);
+  const GLint nchunks = pool_->NumThreads() * 4;
+
+  // each chunk counts its keys per partition, so they can be spread out in parallel and keep their order
+  std::vector<uint64_t> counts(nchunks * npartitions, 0);
+  pool_->ParallelFor(nchunks, [&](GLint chunk)
+		     {
+		       uint64_t* chunk_counts = &counts[chunk * npartitions];
+		       for (uint64_t i = keys.size() * chunk / nchunks, end = keys.size() * (chunk + 1) / nchunks; i < end; ++i)
+			 ++chunk_counts[Partition(keys[i], npartitions)];
+		     });
+
+  std::vector<uint64_t> partition_keys(npartitions + 1, 0);
+  std::vector<uint64_t> offsets(nchunks * npartitions);
+  partition_buckets_.assign(npartitions + 1, 0);
+  partition_slots_.assign(npartitions + 1, 0);
+  for (uint64_t partition = 0; partition < npartitions; ++partition)
+    {
+      uint64_t nkeys = 0;
+      for (GLint chunk = 0; chunk < nchunks; ++chunk)
+	{
+	  offsets[chunk * npartitions + partition] = partition_keys[partition] + nkeys;
+	  nkeys += counts[chunk * npartitions + partition];
+	}
+      partition_keys[partition + 1] = partition_keys[partition] + nkeys;
+      partition_buckets_[partition + 1] = partition_buckets_[partition] + std::max<uint64_t>(1, nkeys / kKeysPerBucket);
+      partition_slots_[partition + 1] = partition_slots_[partition] + nkeys + nkeys / 50 + 1;
+    }
+  std::vector<uint32_t> partitioned(keys.size());
+  pool_->ParallelFor(nchunks, [&](GLint chunk)
+		     {
+		       uint64_t* chunk_offsets = &offsets[chunk * npartitions];
+		       for (uint64_t i = keys.size() * chunk / nchunks, end = keys.size() * (chunk + 1) / nchunks; i < end; ++i)
+			 partitioned[chunk_offsets[Partition(keys[i], npartitions)]++] = keys[i];
+		     });
+
+  displacements_.assign(partition_buckets_.back(), 0);
+  slot_keys_.assign(partition_slots_.back(), kEmptySlot);
+  std::atomic<bool> bfailed(false);
+  pool_->ParallelFor(npartitions, [&](GLint partition)
+		     {
+		       if (!bfailed && !PlacePartition(partition, partitioned.data() + partition_keys[partition],
+							partition_keys[partition + 1] - partition_keys[partition]))
+			 bfailed = true;
+		     });
+  if (bfailed)
+    {
+      error_ = "a hash bucket found no free slots in " + std::to_string(kMaxDisplacement) + " tries";
+      return false;
+    }
+  return true;
+}
+
+bool TablebaseGenerator::PlacePartition(uint64_t partition, const uint32_t* keys, uint64_t nkeys)
+{
+  const uint64_t first_bucket = partition_buckets_[partition], nbuckets = partition_buckets_[partition + 1] - first_bucket;
+  const uint64_t first_slot = partition_slots_[partition], nslots = partition_slots_[partition + 1] - first_slot;
+  uint32_t* slot_keys = &slot_keys_[first_slot];
+
+  std::vector<uint64_t> bucket_start(nbuckets + 1, 0);
+  for (uint64_t i = 0; i < nkeys; ++i)
+    ++bucket_start[Bucket(keys[i], nbuckets) + 1];
+  for (uint64_t bucket = 0; bucket < nbuckets; ++bucket)
+    bucket_start[bucket + 1] += bucket_start[bucket];
+  std::vector<uint32_t> bucket_keys(nkeys);
+  std::vector<uint64_t> fill(bucket_start.begin(), bucket_start.end() - 1);
+  for (uint64_t i = 0; i < nkeys; ++i)
+    bucket_keys[fill[Bucket(keys[i], nbuckets)]++] = keys[i];
+
+  // place the crowded buckets while the table is still empty
+  std::vector<uint64_t> order(nbuckets);
+  for (uint64_t bucket = 0; bucket < nbuckets; ++bucket)
+    order[bucket] = bucket;
+  std::stable_sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b)
+		   {
+		     return bucket_start[a + 1] - bucket_start[a] > bucket_start[b + 1] - bucket_start[b];
+		   });
+
+  for (uint64_t bucket : order)
+    {
+      const uint64_t begin = bucket_start[bucket], end = bucket_start[bucket + 1];
+      if (begin == end)
+	continue;
+      uint32_t displacement = 0;
+      for ( ; displacement < kMaxDisplacement; ++displacement)
+	{
+	  // claim slots as they're found, so two keys of the bucket can't land on one
+	  uint64_t i = begin;
+	  for ( ; i < end; ++i)
+	    {
+	      uint64_t slot = Slot(bucket_keys[i], displacement, nslots);
+	      if (slot_keys[slot] != kEmptySlot)
+		break;
+	      slot_keys[slot] = bucket_keys[i];
+	    }
+	  if (i == end)
+	    break;
+	  while (i-- > begin)
+	    slot_keys[Slot(bucket_keys[i], displacement, nslots)] = kEmptySlot;
+	}
+      if (displacement == kMaxDisplacement)
+	return false;
+      displacements_[first_bucket + bucket] = displacement;
+    }
+  return true;
+}
+
+void TablebaseGenerator::Solve()
+{
+  const uint64_t nslots = slot_keys_.size();
+  values_.assign(nslots, 0);
+  std::vector<float> next(nslots, 0);
+  const GLint nchunks = pool_->NumThreads() * 4;
+  std::vector<double> chunk_change(nchunks);
+
+  // V_k(stack) = mean over pieces of the best (lines + V_{k-1}(child)), starting from V_0 = 0
+  for (iterations_ = 0; iterations_ < horizon_; )
+    {
+      pool_->ParallelFor(nchunks, [&](GLint chunk)
+			 {
+			   std::vector<Placement> placements;
+			   double change = 0;
+			   uint64_t begin = nslots * chunk / nchunks, end = nslots * (chunk + 1) / nchunks;
+			   for (uint64_t slot = begin; slot < end; ++slot)
+			     {
+			       if (slot_keys_[slot] == kEmptySlot)
+				 continue;
+			       next[slot] = Backup(slot_keys_[slot], values_, &placements);
+			       change = std::max(change, static_cast<double>(std::fabs(next[slot] - values_[slot])));
+			     }
+			   chunk_change[chunk] = change;
+			 });
+      values_.swap(next);
+      ++iterations_;
+      max_change_ = *std::max_element(chunk_change.begin(), chunk_change.end());
+      if (max_change_ < tolerance_)
+	break;
+    }
+}
+
+float TablebaseGenerator::Backup(uint32_t key, const std::vector<float>& values, std::vector<Placement>* scratch) const
+{
+  BitBoard board = UnpackBoard(key, ncols_, nrows_);
+  double total = 0;
+  for (GLint type = kTetroI; type <= kTetroZ; ++type)
+    {
+      GenerateDropPlacements(board, static_cast<TetroType>(type), scratch);
+      // a piece with nowhere to go ends the game and clears nothing more
+      double best = 0;
+      for (const Placement& placement : *scratch)
+	{
+	  BitBoard child(board);
+	  GLint lines = child.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+	  uint32_t child_key = CanonicalKey(PackBoard(child, nrows_), ncols_, nrows_);
+	  uint64_t slot = IndexSlot(child_key, partition_buckets_.size() - 1, partition_buckets_.data(), partition_slots_.data(), displacements_.data());
+	  best = std::max(best, lines + static_cast<double>(values[slot]));
+	}
+      total += best;
+    }
+  return total / 7;
+}
+
+bool TablebaseGenerator::Save(const std::string& filename) const
+{
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (!file)
+    return false;
+  
+  TablebaseHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kTablebaseMagic, sizeof(header.magic));
+  header.version = kTablebaseVersion;
+  header.ncols = ncols_;
+  header.nrows = nrows_;
+  header.horizon = iterations_;
+  header.nstates = nstates_;
+  header.nbuckets = displacements_.size();
+  header.nslots = slot_keys_.size();
+  header.npartitions = partition_buckets_.size() - 1;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(partition_buckets_.data(), sizeof(uint64_t), partition_buckets_.size(), file) == partition_buckets_.size() &&
+    fwrite(partition_slots_.data(), sizeof(uint64_t), partition_slots_.size(), file) == partition_slots_.size() &&
+    fwrite(displacements_.data(), sizeof(uint32_t), displacements_.size(), file) == displacements_.size() &&
+    fwrite(slot_keys_.data(), sizeof(uint32_t), slot_keys_.size(), file) == slot_keys_.size() &&
+    fwrite(values_.data(), sizeof(float), values_.size(), file) == values_.size();
+  return fclose(file) == 0 && ok;
+}
+
+TablebaseGenerator::~TablebaseGenerator()
+{
+  
+}
+
+Tablebase::Tablebase() : map_(nullptr),
+			 map_size_(0),
+			 header_(nullptr),
+			 partition_buckets_(nullptr),
+			 partition_slots_(nullptr),
+			 displacements_(nullptr),
+			 slot_keys_(nullptr),
+			 values_(nullptr)
+{ }
+
+bool Tablebase::Open(const std::string& filename)
+{
+  Close();
+  
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(TablebaseHeader)))
+    {
+      close(fd);
+      return false;
+    }
+  void* map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const TablebaseHeader* header = static_cast<const TablebaseHeader*>(map);
+  size_t expected = sizeof(TablebaseHeader) + 2 * sizeof(uint64_t) * (header->npartitions + 1) +
+    sizeof(uint32_t) * (header->nbuckets + header->nslots) + sizeof(float) * header->nslots;
+  if (std::memcmp(header->magic, kTablebaseMagic, sizeof(header->magic)) != 0 ||
+      header->version != kTablebaseVersion || header->nbuckets == 0 || header->npartitions == 0 ||
+      static_cast<size_t>(info.st_size) != expected)
+    {
+      munmap(map, info.st_size);
+      return false;
+    }
+
+  map_ = map;
+  map_size_ = info.st_size;
+  header_ = header;
+  partition_buckets_ = reinterpret_cast<const uint64_t*>(header + 1);
+  partition_slots_ = partition_buckets_ + header->npartitions + 1;
+  displacements_ = reinterpret_cast<const uint32_t*>(partition_slots_ + header->npartitions + 1);
+  slot_keys_ = displacements_ + header->nbuckets;
+  values_ = reinterpret_cast<const float*>(slot_keys_ + header->nslots);
+  return true;
+}
+
+void Tablebase::Close()
+{
+  if (map_)
+    munmap(map_, map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+  header_ = nullptr;
+}
+
+bool Tablebase::Lookup(const BitBoard& board, float* value) const
+{
+  if (!header_ || board.NumCols() != static_cast<GLint>(header_->ncols) ||
+      board.Height() > static_cast<GLint>(header_->nrows))
+    return false;
+  
+  uint32_t key = CanonicalKey(PackBoard(board, header_->nrows), header_->ncols, header_->nrows);
+  uint64_t slot = IndexSlot(key, header_->npartitions, partition_buckets_, partition_slots_, displacements_);
+  if (slot_keys_[slot] != key)
+    return false;
+  *value = values_[slot];
+  return true;
+}
+
+Tablebase::~Tablebase()
+{
+  Close();
+}
@@ -0,0 +1,117 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include "bitboard.h"
+#include "thread_pool.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+  Exhaustive tables for narrow wells of bounded height.
+  For every stack reachable from an empty well the table holds the
+  expected number of lines a perfect player clears before a piece no
+  longer fits, with every piece equally likely. Mirrored stacks have
+  the same value (J and L, S and Z swap places), so only the smaller
+  of each mirrored pair is stored. Values are found by backing up one
+  piece at a time from a horizon of zero until they stop changing.
+
+  On disk the table is a header, a hash-and-displace perfect hash
+  over the stacks, and one value per hash slot, laid out so a reader
+  can map the file and look up any stack in constant time. The hash
+  is split into partitions of a fixed number of stacks, each with its
+  own buckets and slots, so they are built on separate threads and the
+  file comes out the same whatever the thread count.
+*/
+
+struct TablebaseHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t ncols;
+  uint32_t nrows;
+  uint32_t horizon;
+  uint64_t nstates;
+  uint64_t nbuckets;
+  uint64_t nslots;
+  uint64_t npartitions;
+};
+
+class TablebaseGenerator
+{
+public:
+  TablebaseGenerator(GLint ncols, GLint nrows, ThreadPool* pool);
+
+  // Most pieces of lookahead to back up, and the change at which values count as settled
+  void SetHorizon(GLint pieces) { horizon_ = pieces; }
+  void SetTolerance(double tolerance) { tolerance_ = tolerance; }
+
+  bool Generate();
+  bool Save(const std::string& filename) const;
+  const std::string& Error() const { return error_; }
+
+  uint64_t NumStates() const { return nstates_; }
+  GLint Iterations() const { return iterations_; }
+  double MaxChange() const { return max_change_; }
+
+  virtual ~TablebaseGenerator();
+private:
+  void FindReachable(std::vector<uint32_t>* keys);
+  bool BuildIndex(const std::vector<uint32_t>& keys);
+  // Places one partition's keys, which are all its own, in its own slots
+  bool PlacePartition(uint64_t partition, const uint32_t* keys, uint64_t nkeys);
+  void Solve();
+  float Backup(uint32_t key, const std::vector<float>& values, std::vector<Placement>* scratch) const;
+
+  const GLint ncols_, nrows_;
+  ThreadPool* pool_;
+  GLint horizon_;
+  double tolerance_;
+
+  uint64_t nstates_;
+  GLint iterations_;
+  double max_change_;
+  std::string error_;
+  // where each partition's buckets and slots start, with the totals at the end
+  std::vector<uint64_t> partition_buckets_;
+  std::vector<uint64_t> partition_slots_;
+  std::vector<uint32_t> displacements_;
+  std::vector<uint32_t> slot_keys_;
+  std::vector<float> values_;
+};
+
+class Tablebase
+{
+public:
+  Tablebase();
+
+  bool Open(const std::string& filename);
+  void Close();
+  bool IsOpen() const { return header_ != nullptr; }
+
+  GLint NumCols() const { return header_->ncols; }
+  GLint NumRows() const { return header_->nrows; }
+  uint64_t NumStates() const { return header_->nstates; }
+
+  // False if the stack does not fit the table or was never reached
+  bool Lookup(const BitBoard& board, float* value) const;
+
+  virtual ~Tablebase();
+private:
+  Tablebase(const Tablebase&);
+  void operator=(const Tablebase&);
+
+  void* map_;
+  size_t map_size_;
+  const TablebaseHeader* header_;
+  const uint64_t* partition_buckets_;
+  const uint64_t* partition_slots_;
+  const uint32_t* displacements_;
+  const uint32_t* slot_keys_;
+  const float* values_;
+};
+
+
+#endif // TABLEBASE_H
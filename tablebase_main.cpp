@@ -0,0 +1,73 @@
+#include "tablebase.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+void Usage()
+{
+  std::cerr << "usage: tablebase generate <columns> <rows> <file> [horizon] [threads]" << std::endl;
+  std::cerr << "       tablebase probe <file>" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+  std::string command = argv[1];
+
+  if (command == "generate" && argc >= 5)
+    {
+      GLint ncols = atoi(argv[2]);
+      GLint nrows = atoi(argv[3]);
+      if (ncols < 3 || ncols > 4 || nrows < 1 || ncols * nrows > 32)
+	{
+	  std::cerr << "Wells are 3 or 4 columns wide with at most 32 cells." << std::endl;
+	  return EXIT_FAILURE;
+	}
+      ThreadPool pool(argc >= 7 ? atoi(argv[6]) : 0);
+      TablebaseGenerator generator(ncols, nrows, &pool);
+      if (argc >= 6)
+	generator.SetHorizon(atoi(argv[5]));
+
+      auto start = std::chrono::steady_clock::now();
+      if (!generator.Generate())
+	{
+	  std::cerr << "Failed to build the table: " << generator.Error() << std::endl;
+	  return EXIT_FAILURE;
+	}
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << generator.NumStates() << " states, " << generator.Iterations() << " pieces backed up, last change "
+		<< generator.MaxChange() << ", " << seconds << "s on " << pool.NumThreads() << " threads" << std::endl;
+      
+      if (!generator.Save(argv[4]))
+	{
+	  std::cerr << "Failed to write " << argv[4] << std::endl;
+	  return EXIT_FAILURE;
+	}
+      return EXIT_SUCCESS;
+    }
+
+  if (command == "probe")
+    {
+      Tablebase tablebase;
+      if (!tablebase.Open(argv[2]))
+	{
+	  std::cerr << "Failed to open " << argv[2] << std::endl;
+	  return EXIT_FAILURE;
+	}
+      float value = 0;
+      tablebase.Lookup(BitBoard(tablebase.NumRows(), tablebase.NumCols()), &value);
+      std::cout << tablebase.NumCols() << "x" << tablebase.NumRows() << " well, " << tablebase.NumStates()
+		<< " states, empty well is worth " << value << " lines" << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+  Usage();
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,393 @@
+#include "tetris_env.h"
+#include "bitboard.h"
+#include "game.h"
+#include "playfield.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+  const GLint kNumFrameActions = 1 << 7;
+  const uint32_t kEpisodeSeedStride = 0x9e3779b9u;
+
+  struct Environment
+  {
+    Environment(GLint nrows, GLint ncols) : playfield(nrows, ncols),
+					    game(&playfield),
+					    seed(0),
+					    episode(0)
+    { }
+
+    PlayField playfield;
+    Game game;
+    uint32_t seed;
+    uint32_t episode;
+    std::vector<Placement> placements;
+  };
+
+  void StartEpisode(Environment& env)
+  {
+    env.game.Seed(env.seed + env.episode * kEpisodeSeedStride);
+    env.game.SetLevel(1);
+    env.game.Restart();
+    env.game.BeginPlay();
+  }
+
+  void StepFrame(Environment& env, GLint action)
+  {
+    Game& game = env.game;
+    if (action & TETRIS_ENV_LEFT)
+      game.MoveLeft();
+    if (action & TETRIS_ENV_RIGHT)
+      game.MoveRight();
+    if (action & TETRIS_ENV_ROTATE_RIGHT)
+      game.RotateRight();
+    if (action & TETRIS_ENV_ROTATE_LEFT)
+      game.RotateLeft();
+    if (action & TETRIS_ENV_SOFT_DROP)
+      game.SoftDrop();
+    if (action & TETRIS_ENV_HARD_DROP)
+      game.HardDrop();
+    if (action & TETRIS_ENV_HOLD)
+      game.Hold();
+    game.Update();
+  }
+
+  void StepPlacement(Environment& env, GLint ncols, GLint action)
+  {
+    Game& game = env.game;
+    const PlayField& playfield = env.playfield;
+    const TetroType falling = playfield.FallingTetroType();
+    if (game.IsGameOver() || falling == kNone)
+      return;
+
+    if (action >= 0)
+      {
+	const bool hold = action >= 4 * ncols;
+	const GLint rotation = (action / ncols) % 4;
+	const GLint column = action % ncols;
+	const TetroType type = !hold ? falling : game.Held() != kNone ? game.Held() : game.Next();
+	if (type != kNone && (!hold || game.CanHold()))
+	  {
+	    GeneratePlacements(BitBoard::FromPlayField(playfield), type, &env.placements);
+	    for (Placement& placement : env.placements)
+	      {
+		if (placement.rotation == rotation && placement.col + GetPieceMask(type, placement.rotation).min_col == column)
+		  {
+		    placement.hold = hold;
+		    game.Place(placement);
+		    return;
+		  }
+	      }
+	  }
+      }
+    
+    // anything else drops the piece straight down from where it spawned
+    Placement drop;
+    drop.type = falling;
+    drop.rotation = playfield.FallingTetro().RotationState();
+    drop.row = playfield.GhostRow();
+    drop.col = playfield.GhostCol();
+    drop.hold = false;
+    game.Place(drop);
+  }
+
+  void WriteObservation(const Environment& env, uint8_t* observation)
+  {
+    const PlayField& playfield = env.playfield;
+    const GLint nrows = playfield.NumRows(), ncols = playfield.NumCols();
+    const TileColor* tiles = playfield.Tiles();
+    for (GLint cell = 0; cell < nrows * ncols; ++cell)
+      observation[cell] = tiles[cell] != kEmpty;
+
+    const Tetromino& falling = playfield.FallingTetro();
+    if (falling.Type() != kNone)
+      {
+	const TileColor* shape = falling.Shape();
+	const GLint side = falling.TemplateSideLength();
+	for (GLint r = 0; r < side; ++r)
+	  {
+	    for (GLint c = 0; c < side; ++c)
+	      {
+		GLint row = playfield.FallingTetroRow() - r, col = playfield.FallingTetroCol() + c;
+		if (shape[r * side + c] != kEmpty && row >= 0 && row < nrows && col >= 0 && col < ncols)
+		  observation[row * ncols + col] = 2;
+	      }
+	  }
+      }
+
+    uint8_t* pieces = observation + nrows * ncols;
+    pieces[0] = falling.Type() + 1;
+    pieces[1] = env.game.Next() + 1;
+    pieces[2] = env.game.Held() + 1;
+    pieces[3] = env.game.CanHold();
+  }
+
+  struct TensorBinding
+  {
+    char* data;
+    GLint dtype;
+    int64_t strides[4];
+  };
+
+  template <typename T>
+  T& At(char* base, const int64_t* strides, GLint i, GLint j, GLint k)
+  {
+    return *reinterpret_cast<T*>(base + i * strides[1] + j * strides[2] + k * strides[3]);
+  }
+
+  // Writes one environment's slice of a bound tensor straight from the engine's state
+  template <typename T>
+  void FillTensor(GLint tensor, char* base, const int64_t* strides, const Environment& env)
+  {
+    const PlayField& playfield = env.playfield;
+    const GLint nrows = playfield.NumRows(), ncols = playfield.NumCols();
+    const TileColor* tiles = playfield.Tiles();
+    switch (tensor)
+      {
+      case TETRIS_ENV_OCCUPANCY:
+	{
+	  for (GLint row = 0; row < nrows; ++row)
+	    {
+	      for (GLint col = 0; col < ncols; ++col)
+		{
+		  At<T>(base, strides, 0, row, col) = tiles[row * ncols + col] != kEmpty;
+		  At<T>(base, strides, 1, row, col) = 0;
+		}
+	    }
+	  const Tetromino& falling = playfield.FallingTetro();
+	  if (falling.Type() == kNone)
+	    break;
+	  const TileColor* shape = falling.Shape();
+	  const GLint side = falling.TemplateSideLength();
+	  for (GLint r = 0; r < side; ++r)
+	    {
+	      for (GLint c = 0; c < side; ++c)
+		{
+		  GLint row = playfield.FallingTetroRow() - r, col = playfield.FallingTetroCol() + c;
+		  if (shape[r * side + c] != kEmpty && row >= 0 && row < nrows && col >= 0 && col < ncols)
+		    At<T>(base, strides, 1, row, col) = 1;
+		}
+	    }
+	  break;
+	}
+      case TETRIS_ENV_COLORS:
+	for (GLint row = 0; row < nrows; ++row)
+	  {
+	    for (GLint col = 0; col < ncols; ++col)
+	      {
+		TileColor color = tiles[row * ncols + col];
+		for (GLint plane = kCyan; plane <= kRed; ++plane)
+		  At<T>(base, strides, plane, row, col) = color == plane;
+	      }
+	  }
+	break;
+      case TETRIS_ENV_QUEUE:
+	{
+	  const TetroType queue[3] = { playfield.FallingTetroType(), env.game.Next(), env.game.Held() };
+	  for (GLint slot = 0; slot < 3; ++slot)
+	    {
+	      for (GLint type = kTetroI; type <= kTetroZ; ++type)
+		At<T>(base, strides, slot, type, 0) = queue[slot] == type;
+	    }
+	  break;
+	}
+      case TETRIS_ENV_HEIGHTS:
+	for (GLint col = 0; col < ncols; ++col)
+	  {
+	    GLint height = nrows;
+	    while (height > 0 && tiles[(height - 1) * ncols + col] == kEmpty)
+	      --height;
+	    At<T>(base, strides, col, 0, 0) = height;
+	  }
+	break;
+      }
+  }
+
+  void WriteTensors(const TensorBinding* tensors, GLint index, const Environment& env)
+  {
+    for (GLint tensor = 0; tensor < TETRIS_ENV_NUM_TENSORS; ++tensor)
+      {
+	const TensorBinding& binding = tensors[tensor];
+	if (!binding.data)
+	  continue;
+	char* base = binding.data + index * binding.strides[0];
+	if (binding.dtype == TETRIS_ENV_UINT8)
+	  FillTensor<uint8_t>(tensor, base, binding.strides, env);
+	else
+	  FillTensor<float>(tensor, base, binding.strides, env);
+      }
+  }
+
+  void WriteActionMask(Environment& env, GLint ncols, uint8_t* mask)
+  {
+    std::memset(mask, 0, 8 * ncols);
+    const TetroType falling = env.playfield.FallingTetroType();
+    if (env.game.IsGameOver() || falling == kNone)
+      return;
+
+    BitBoard board = BitBoard::FromPlayField(env.playfield);
+    GeneratePlacements(board, falling, &env.placements);
+    for (const Placement& placement : env.placements)
+      mask[placement.rotation * ncols + placement.col + GetPieceMask(placement.type, placement.rotation).min_col] = 1;
+
+    if (!env.game.CanHold())
+      return;
+    const TetroType held = env.game.Held() != kNone ? env.game.Held() : env.game.Next();
+    GeneratePlacements(board, held, &env.placements);
+    for (const Placement& placement : env.placements)
+      mask[(4 + placement.rotation) * ncols + placement.col + GetPieceMask(placement.type, placement.rotation).min_col] = 1;
+  }
+}
+
+struct TetrisEnv
+{
+  TetrisEnv(GLint nthreads) : pool(nthreads)
+  {
+    for (TensorBinding& tensor : tensors)
+      tensor.data = nullptr;
+  }
+
+  GLint nrows;
+  GLint ncols;
+  GLint action_mode;
+  ThreadPool pool;
+  std::vector< std::unique_ptr<Environment> > envs;
+  TensorBinding tensors[TETRIS_ENV_NUM_TENSORS];
+
+  // Runs task over contiguous runs of environments, a few runs per thread to even out the load
+  template <typename Task>
+  void ForEach(const Task& task)
+  {
+    const GLint count = envs.size();
+    const GLint nchunks = std::min(count, 4 * pool.NumThreads());
+    const GLint chunk = (count + nchunks - 1) / nchunks;
+    pool.ParallelFor(nchunks, [&](GLint i)
+		     {
+		       const GLint end = std::min(count, (i + 1) * chunk);
+		       for (GLint index = i * chunk; index < end; ++index)
+			 task(index);
+		     });
+  }
+};
+
+TetrisEnv* tetris_env_create(int32_t nenvs, int32_t rows, int32_t columns, int32_t action_mode, int32_t nthreads)
+{
+  if (nenvs <= 0 || rows < 4 || rows > BitBoard::kMaxRows || columns < 3 || columns > BitBoard::kMaxCols
+      || (action_mode != TETRIS_ENV_FRAME_ACTIONS && action_mode != TETRIS_ENV_PLACEMENT_ACTIONS))
+    return nullptr;
+
+  TetrisEnv* env = new TetrisEnv(nthreads);
+  env->nrows = rows;
+  env->ncols = columns;
+  env->action_mode = action_mode;
+  env->envs.reserve(nenvs);
+  for (GLint i = 0; i < nenvs; ++i)
+    env->envs.push_back(std::unique_ptr<Environment>(new Environment(rows, columns)));
+  return env;
+}
+
+void tetris_env_destroy(TetrisEnv* env)
+{
+  delete env;
+}
+
+int32_t tetris_env_num_envs(const TetrisEnv* env)
+{
+  return env->envs.size();
+}
+
+int32_t tetris_env_observation_size(const TetrisEnv* env)
+{
+  return env->nrows * env->ncols + 4;
+}
+
+int32_t tetris_env_num_actions(const TetrisEnv* env)
+{
+  return env->action_mode == TETRIS_ENV_FRAME_ACTIONS ? kNumFrameActions : 8 * env->ncols;
+}
+
+void tetris_env_reset(TetrisEnv* env, const uint32_t* seeds, uint8_t* observations)
+{
+  const GLint observation_size = tetris_env_observation_size(env);
+  env->ForEach([&](GLint i)
+	       {
+		 Environment& environment = *env->envs[i];
+		 environment.seed = seeds[i];
+		 environment.episode = 0;
+		 StartEpisode(environment);
+		 if (observations)
+		   WriteObservation(environment, observations + i * observation_size);
+		 WriteTensors(env->tensors, i, environment);
+	       });
+}
+
+void tetris_env_step(TetrisEnv* env, const int32_t* actions, float* rewards, uint8_t* dones, uint8_t* observations)
+{
+  const GLint observation_size = tetris_env_observation_size(env);
+  const GLint num_actions = tetris_env_num_actions(env);
+  env->ForEach([&](GLint i)
+	       {
+		 Environment& environment = *env->envs[i];
+		 const GLuint lines = environment.game.Lines();
+		 // out of range actions press nothing, or drop the piece where it spawned
+		 const bool valid = actions[i] >= 0 && actions[i] < num_actions;
+		 if (env->action_mode == TETRIS_ENV_FRAME_ACTIONS)
+		   StepFrame(environment, valid ? actions[i] : 0);
+		 else
+		   StepPlacement(environment, env->ncols, valid ? actions[i] : -1);
+
+		 const bool done = environment.game.IsGameOver();
+		 if (rewards)
+		   rewards[i] = static_cast<float>(environment.game.Lines() - lines);
+		 if (dones)
+		   dones[i] = done;
+		 if (done)
+		   {
+		     ++environment.episode;
+		     StartEpisode(environment);
+		   }
+		 if (observations)
+		   WriteObservation(environment, observations + i * observation_size);
+		 WriteTensors(env->tensors, i, environment);
+	       });
+}
+
+void tetris_env_action_masks(TetrisEnv* env, uint8_t* masks)
+{
+  const GLint num_actions = tetris_env_num_actions(env);
+  env->ForEach([&](GLint i)
+	       {
+		 uint8_t* mask = masks + i * num_actions;
+		 if (env->action_mode == TETRIS_ENV_FRAME_ACTIONS)
+		   std::memset(mask, 1, num_actions);
+		 else
+		   WriteActionMask(*env->envs[i], env->ncols, mask);
+	       });
+}
+
+int32_t tetris_env_bind_tensor(TetrisEnv* env, int32_t tensor, void* data, int32_t dtype, const int64_t* strides)
+{
+  if (tensor < 0 || tensor >= TETRIS_ENV_NUM_TENSORS)
+    return -1;
+  TensorBinding& binding = env->tensors[tensor];
+  if (!data)
+    {
+      binding.data = nullptr;
+      return 0;
+    }
+  if ((dtype != TETRIS_ENV_UINT8 && dtype != TETRIS_ENV_FLOAT32) || !strides)
+    return -1;
+
+  binding.data = static_cast<char*>(data);
+  binding.dtype = dtype;
+  std::copy(strides, strides + 4, binding.strides);
+  // dimensions the tensor doesn't have are only ever indexed at 0
+  static const GLint kDimensions[TETRIS_ENV_NUM_TENSORS] = { 3, 3, 2, 1 };
+  std::fill(binding.strides + 1 + kDimensions[tensor], binding.strides + 4, 0);
+  return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef TETRIS_ENV_H
+#define TETRIS_ENV_H
+
+#include <stdint.h>
+
+/*
+  C interface to a batch of headless games for training agents.
+  Every environment is a Game driven through its public input calls,
+  so agents play by exactly the rules the GUI does. A step advances every
+  environment at once on a thread pool. An environment that finishes
+  starts its next episode straight away with the next seed in its
+  sequence, so the observation returned alongside a done flag is the
+  first one of the new episode.
+
+  Frame actions are a bitmask of the inputs held for one frame.
+  Placement actions pick where the current piece lands:
+  action = (hold * 4 + rotation) * columns + column, where column is
+  the leftmost column the piece covers. A placement is one call to
+  Game::Place, which skips gravity and the lock and line clear
+  timers. The action mask offers the placements the move generator
+  finds; any other action drops the piece straight down from where it
+  spawned. Holding into an empty slot plays the next piece, as in the
+  guideline.
+
+  Observations are rows * columns bytes, bottom row first (0 empty,
+  1 locked, 2 falling piece), followed by the falling, next and held
+  piece types (0 for none, otherwise 1 to 7) and whether hold is
+  available. Rewards are lines cleared during the step.
+
+  Tensors in other layouts can be bound once and are then filled in
+  place on every reset and step. Each has up to three dimensions
+  after the environment, with byte strides chosen by the caller so
+  they can point straight into a framework's tensor:
+    occupancy  [2][rows][columns]  locked cells, falling piece cells
+    colors     [7][rows][columns]  locked cells by colour, one-hot
+    queue      [3][7]              falling, next and held piece, one-hot
+    heights    [columns]           height of each column's top cell
+  Rows run from the bottom, as in the byte observations.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct TetrisEnv TetrisEnv;
+
+enum TetrisEnvTensor
+  {
+    TETRIS_ENV_OCCUPANCY,
+    TETRIS_ENV_COLORS,
+    TETRIS_ENV_QUEUE,
+    TETRIS_ENV_HEIGHTS,
+    TETRIS_ENV_NUM_TENSORS
+  };
+
+enum TetrisEnvDtype
+  {
+    TETRIS_ENV_UINT8,
+    TETRIS_ENV_FLOAT32
+  };
+
+enum TetrisEnvActionMode
+  {
+    TETRIS_ENV_FRAME_ACTIONS,
+    TETRIS_ENV_PLACEMENT_ACTIONS
+  };
+
+enum TetrisEnvInput
+  {
+    TETRIS_ENV_LEFT = 1 << 0,
+    TETRIS_ENV_RIGHT = 1 << 1,
+    TETRIS_ENV_ROTATE_RIGHT = 1 << 2,
+    TETRIS_ENV_ROTATE_LEFT = 1 << 3,
+    TETRIS_ENV_SOFT_DROP = 1 << 4,
+    TETRIS_ENV_HARD_DROP = 1 << 5,
+    TETRIS_ENV_HOLD = 1 << 6
+  };
+
+/* nthreads 0 uses every hardware thread. Returns NULL on bad arguments. */
+TetrisEnv* tetris_env_create(int32_t nenvs, int32_t rows, int32_t columns, int32_t action_mode, int32_t nthreads);
+void tetris_env_destroy(TetrisEnv* env);
+
+int32_t tetris_env_num_envs(const TetrisEnv* env);
+int32_t tetris_env_observation_size(const TetrisEnv* env);
+int32_t tetris_env_num_actions(const TetrisEnv* env);
+
+/* Starts every environment from seeds[i] and writes the first observations */
+void tetris_env_reset(TetrisEnv* env, const uint32_t* seeds, uint8_t* observations);
+/* Applies actions[i] to environment i. Any output pointer may be NULL. */
+void tetris_env_step(TetrisEnv* env, const int32_t* actions, float* rewards, uint8_t* dones, uint8_t* observations);
+/* One byte per action per environment, 1 where a placement action is legal */
+void tetris_env_action_masks(TetrisEnv* env, uint8_t* masks);
+
+/*
+  Fills data on every later reset and step. strides[0] steps between
+  environments and strides[1..3] between entries of the tensor's own
+  dimensions, all in bytes; strides past the tensor's dimensions are
+  ignored. Passing NULL data unbinds. Returns 0, or -1 on bad arguments.
+*/
+int32_t tetris_env_bind_tensor(TetrisEnv* env, int32_t tensor, void* data, int32_t dtype, const int64_t* strides);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* TETRIS_ENV_H */
@@ -43,19 +43,27 @@ enum Rotation
     kLeft
   };
 
+// Wall kicks for each turn, as (rows up, columns right) offsets tried in order
+typedef std::map< std::pair<enum RotationState, enum RotationState>, std::vector< std::pair<GLint, GLint> > > KickTable;
+
+/*
+  A piece and its rotation. The shape lives in the piece itself and
+  the kicks are shared tables, so pieces copy without allocating.
+*/
+
 class Tetromino
 {
 public:
   explicit Tetromino(TetroType type);
   Tetromino(const Tetromino& other) = default;
   Tetromino& operator=(const Tetromino& other) = default;
-  Tetromino& operator=(Tetromino&& tetro);
   TetroType Type() const { return type_; }
   TileColor Color() const { return color_; }
-  const std::vector< std::pair<GLint, GLint> >& Kicks(RotationState beginning, RotationState end) const { return kicks_.at(std::make_pair(beginning, end)); }
+  const std::vector< std::pair<GLint, GLint> >& Kicks(RotationState beginning, RotationState end) const { return kicks_->at(std::make_pair(beginning, end)); }
   RotationState RotationState() const { return rotation_state_; }
   
-  const std::vector<TileColor>& Shape() const { return shape_; }
+  // TemplateSideLength() squared tiles, row major from the top
+  const TileColor* Shape() const { return shape_; }
   GLuint TemplateSideLength() const { return template_side_length_; }
   void Rotate(Rotation rotation);
   
@@ -66,8 +74,8 @@ private:
   TetroType type_;
   TileColor color_;
   GLuint template_side_length_;
-  std::vector<TileColor> shape_;
-  std::map< std::pair<enum RotationState, enum RotationState>, std::vector< std::pair<GLint, GLint> > > kicks_;
+  TileColor shape_[16];
+  const KickTable* kicks_;
 };
 
 
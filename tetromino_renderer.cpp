@@ -9,7 +9,7 @@ void TetrominoRenderer::Render(GLfloat x, GLfloat y, TetroType type) const
 {
   Tetromino tetro(type);
   TileColor color = tetro.Color();
-  const std::vector<TileColor>& shape = tetro.Shape();
+  const TileColor* shape = tetro.Shape();
   GLuint template_side_length = tetro.TemplateSideLength();
   
   for (GLuint template_row = 0; template_row < template_side_length; ++template_row)
@@ -34,7 +34,7 @@ void TetrominoRenderer::RenderCentered(GLfloat x, GLfloat y, GLfloat w, GLfloat
 void TetrominoRenderer::RenderOnPlayfield(GLint row, GLint col, const Tetromino& tetro) const
 {
   TileColor color = tetro.Color();
-  const std::vector<TileColor>& shape = tetro.Shape();
+  const TileColor* shape = tetro.Shape();
   GLuint template_side_length = tetro.TemplateSideLength();
   GLfloat x = col * tile_size_ + playfield_x_origin_;
   GLfloat y = row * tile_size_ + playfield_y_origin_;
@@ -2,6 +2,9 @@
 #include <glm/ext.hpp>
 
 #include "text_renderer.h"
+#include "metrics.h"
+
+static MetricCounter& draw_calls = Metrics().GetCounter("tetris_draw_calls_total", "OpenGL draw calls.");
 
 TextRenderer::TextRenderer(const std::string& font_filename, unsigned int fontsize, const glm::mat4& projection, const std::string& shaders_prefix) : projection_(projection), shader_(shaders_prefix)
 {
@@ -96,6 +99,7 @@ void TextRenderer::Render(std::string text, GLfloat x, GLfloat y, GLfloat scale,
       glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
       glBindBuffer(GL_ARRAY_BUFFER, 0);
       // Render quad
+      draw_calls.Add();
       glDrawArrays(GL_TRIANGLES, 0, 6);
       // Now advance cursors for next glyph (note that advance is number of 1/64 pixels)
       x += (ch.advance >> 6) * scale; // Bitshift by 6 to get value in pixels (2^6 = 64)
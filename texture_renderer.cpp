@@ -2,6 +2,9 @@
 #include <glm/ext.hpp>
 
 #include "texture_renderer.h"
+#include "metrics.h"
+
+static MetricCounter& draw_calls = Metrics().GetCounter("tetris_draw_calls_total", "OpenGL draw calls.");
 
 TextureRenderer::TextureRenderer(const std::string& texture_shaders_prefix,
 				 const std::string& color_shaders_prefix,
@@ -43,6 +46,7 @@ void TextureRenderer::Render(const Texture& texture, GLfloat x, GLfloat y, GLflo
   texture_shader_.SetFloat("mix_ratio", 0);
   texture.Bind(0);
   glBindVertexArray(vao_);
+  draw_calls.Add();
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glBindVertexArray(0);
 }
@@ -59,6 +63,7 @@ void TextureRenderer::TransparentRender(const Texture& texture, GLfloat x, GLflo
   texture_shader_.Set3f("mix_color", mix_color);
   texture.Bind(0);
   glBindVertexArray(vao_);
+  draw_calls.Add();
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glBindVertexArray(0);
 }
@@ -73,6 +78,7 @@ void TextureRenderer::ColorRender(const glm::vec3& color, GLfloat x, GLfloat y,
   color_shader_.SetTransform("transform", transform);
   color_shader_.Set4f("in_color", glm::vec4(color,1));
   glBindVertexArray(vao_);
+  draw_calls.Add();
   glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   glBindVertexArray(0);
 }
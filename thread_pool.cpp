@@ -0,0 +1,75 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(GLint nthreads) : task_(nullptr),
+					 count_(0),
+					 next_index_(0),
+					 active_workers_(0),
+					 generation_(0),
+					 bstop_(false)
+{
+  if (nthreads <= 0)
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  for (GLint i = 1; i < nthreads; ++i)
+    workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+void ThreadPool::ParallelFor(GLint count, const std::function<void(GLint)>& task)
+{
+  std::lock_guard<std::mutex> job_lock(job_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    count_ = count;
+    next_index_ = 0;
+    active_workers_ = workers_.size();
+    ++generation_;
+  }
+  work_ready_.notify_all();
+
+  RunTasks();
+
+  // every worker checks in so none of them can miss the next job
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_done_.wait(lock, [this] { return active_workers_ == 0; });
+  task_ = nullptr;
+}
+
+void ThreadPool::RunTasks()
+{
+  for (GLint i = next_index_++; i < count_; i = next_index_++)
+    (*task_)(i);
+}
+
+void ThreadPool::WorkerLoop()
+{
+  GLuint seen_generation = 0;
+  while (true)
+    {
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	work_ready_.wait(lock, [&] { return bstop_ || generation_ != seen_generation; });
+	if (bstop_)
+	  return;
+	seen_generation = generation_;
+      }
+
+      RunTasks();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--active_workers_ == 0)
+	work_done_.notify_one();
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bstop_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::thread& worker : workers_)
+    worker.join();
+}
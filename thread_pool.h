@@ -0,0 +1,52 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Fixed set of worker threads for data parallel jobs.
+  The calling thread works on the job too, so a pool of one
+  thread runs everything inline.
+*/
+
+class ThreadPool
+{
+public:
+  // 0 uses one thread per hardware thread
+  explicit ThreadPool(GLint nthreads = 0);
+
+  GLint NumThreads() const { return workers_.size() + 1; }
+
+  // Calls task(i) for every i in [0, count) and waits for all of them
+  void ParallelFor(GLint count, const std::function<void(GLint)>& task);
+  
+  virtual ~ThreadPool();
+private:
+  ThreadPool(const ThreadPool&);
+  void operator=(const ThreadPool&);
+  
+  void WorkerLoop();
+  void RunTasks();
+  
+  std::vector<std::thread> workers_;
+  std::mutex job_mutex_;
+  std::mutex mutex_;
+  std::condition_variable work_ready_;
+  std::condition_variable work_done_;
+  
+  const std::function<void(GLint)>* task_;
+  GLint count_;
+  std::atomic<GLint> next_index_;
+  GLint active_workers_;
+  GLuint generation_;
+  bool bstop_;
+};
+
+
+#endif // THREAD_POOL_H
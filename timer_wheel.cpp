@@ -0,0 +1,88 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel() : now_(0)
+{
+  for (GLint level = 0; level < kLevels_; ++level)
+    for (GLint slot = 0; slot < kSlots_; ++slot)
+      {
+	TimerNode& head = slots_[level][slot];
+	head.prev = &head;
+	head.next = &head;
+      }
+}
+
+void TimerWheel::Schedule(TimerNode* node, uint64_t deadline)
+{
+  Cancel(node);
+  const uint64_t kRange = uint64_t(1) << (kLevels_ * kSlotBits_);
+  node->deadline = std::min(std::max(deadline, now_ + 1), now_ + kRange - 1);
+  Insert(node);
+}
+
+void TimerWheel::Insert(TimerNode* node)
+{
+  // the level whose slots are as coarse as the wait, so the slot can't come round before the deadline
+  uint64_t delta = node->deadline - now_;
+  GLint level = 0;
+  while (level + 1 < kLevels_ && delta >= uint64_t(1) << ((level + 1) * kSlotBits_))
+    ++level;
+  TimerNode& head = slots_[level][(node->deadline >> (level * kSlotBits_)) & (kSlots_ - 1)];
+  node->prev = head.prev;
+  node->next = &head;
+  head.prev->next = node;
+  head.prev = node;
+}
+
+void TimerWheel::Cancel(TimerNode* node)
+{
+  if (!node->IsScheduled())
+    return;
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->prev = nullptr;
+  node->next = nullptr;
+}
+
+void TimerWheel::Cascade(GLint level)
+{
+  TimerNode& head = slots_[level][(now_ >> (level * kSlotBits_)) & (kSlots_ - 1)];
+  TimerNode* node = head.next;
+  head.prev = &head;
+  head.next = &head;
+  while (node != &head)
+    {
+      TimerNode* next = node->next;
+      Insert(node);
+      node = next;
+    }
+}
+
+void TimerWheel::Tick(std::vector<TimerNode*>* expired)
+{
+  ++now_;
+  // higher levels go first since what they hand down can land in the lower slots due now
+  GLint top = 0;
+  while (top + 1 < kLevels_ && (now_ & ((uint64_t(1) << ((top + 1) * kSlotBits_)) - 1)) == 0)
+    ++top;
+  for (GLint level = top; level > 0; --level)
+    Cascade(level);
+
+  TimerNode& head = slots_[0][now_ & (kSlots_ - 1)];
+  TimerNode* node = head.next;
+  head.prev = &head;
+  head.next = &head;
+  while (node != &head)
+    {
+      TimerNode* next = node->next;
+      node->prev = nullptr;
+      node->next = nullptr;
+      expired->push_back(node);
+      node = next;
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+}
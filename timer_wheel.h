@@ -0,0 +1,60 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+// Embedded in whatever is being woken, so scheduling never allocates
+struct TimerNode
+{
+  TimerNode() : prev(nullptr), next(nullptr), deadline(0) { }
+
+  bool IsScheduled() const { return next != nullptr; }
+
+  TimerNode* prev;
+  TimerNode* next;
+  uint64_t deadline;
+};
+
+/*
+  Hierarchical timer wheel counting in ticks.
+  Level 0 has a slot for each of the next 64 ticks, level 1 a slot for
+  each of the next 64 runs of 64 ticks, and so on. Scheduling and
+  cancelling are a list insert or unlink. When a level comes round to
+  a slot again, the timers in it move down a level, so each timer is
+  touched at most once per level on its way to firing. Deadlines past
+  the top level are brought in to its far end.
+*/
+
+class TimerWheel
+{
+public:
+  TimerWheel();
+
+  uint64_t Now() const { return now_; }
+  // A deadline that has already passed fires on the next tick
+  void Schedule(TimerNode* node, uint64_t deadline);
+  void Cancel(TimerNode* node);
+  // Moves on one tick, appending the timers due then to *expired
+  void Tick(std::vector<TimerNode*>* expired);
+  
+  virtual ~TimerWheel();
+private:
+  TimerWheel(const TimerWheel&);
+  void operator=(const TimerWheel&);
+
+  void Insert(TimerNode* node);
+  void Cascade(GLint level);
+  
+  static const GLint kLevels_ = 4;
+  static const GLint kSlotBits_ = 6;
+  static const GLint kSlots_ = 1 << kSlotBits_;
+
+  uint64_t now_;
+  // list heads, each the sentinel of a circular list
+  TimerNode slots_[kLevels_][kSlots_];
+};
+
+
+#endif // TIMER_WHEEL_H
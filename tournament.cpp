@@ -0,0 +1,233 @@
+#include "tournament.h"
+#include "game.h"
+#include "playfield.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+const GLint kPlayFieldNumRows = 22;
+const GLint kPlayFieldNumCols = 10;
+
+const double Tournament::kInitialRating_ = 1500;
+const double Tournament::kInitialDeviation_ = 350;
+const double Tournament::kConfidence_ = 1.96;
+
+PluginGameResult PlayPluginGame(BotPlugin* plugin, unsigned int seed, GLint max_pieces, double cpu_budget)
+{
+  PlayField playfield(kPlayFieldNumRows, kPlayFieldNumCols);
+  Game game(&playfield);
+  game.Seed(seed);
+  game.Restart();
+  game.BeginPlay();
+
+  PluginGameResult result = { 0, 0, 0, false, false, false, 0 };
+  std::vector<TetroType> queue(2);
+  while (result.pieces < max_pieces && !game.IsGameOver())
+    {
+      queue[0] = playfield.FallingTetroType();
+      queue[1] = game.Next();
+      Placement placement;
+      PluginMoveResult move = plugin->Suggest(BitBoard::FromPlayField(playfield), queue, game.Held(), game.CanHold(), cpu_budget, &placement);
+      result.cpu_time += plugin->LastCpuTime();
+      if (move == kPluginOverBudget)
+	result.bover_budget = true;
+      if (move != kPluginMove)
+	break;
+
+      if (!game.Place(placement))
+	{
+	  result.billegal = true;
+	  break;
+	}
+      ++result.pieces;
+    }
+  result.bgame_over = game.IsGameOver();
+  result.lines = game.Lines();
+  result.score = game.Score();
+  return result;
+}
+
+Tournament::Tournament(ThreadPool* pool) :
+  pool_(pool),
+  format_(kRoundRobin),
+  max_pieces_(1000),
+  cpu_budget_(0.05),
+  seed_(1),
+  plugins_(pool->NumThreads()),
+  round_(0),
+  matches_played_(0)
+{
+}
+
+bool Tournament::AddPlayer(const std::string& library)
+{
+  for (auto& thread_plugins : plugins_)
+    {
+      std::unique_ptr<BotPlugin> plugin(new BotPlugin);
+      if (!plugin->Load(library))
+	{
+	  error_ = plugin->Error();
+	  for (auto& loaded : plugins_)
+	    if (loaded.size() > players_.size())
+	      loaded.pop_back();
+	  return false;
+	}
+      thread_plugins.push_back(std::move(plugin));
+    }
+
+  std::string name = library.substr(library.find_last_of('/') + 1);
+  TournamentPlayer player = { name, library, kInitialRating_, kInitialDeviation_, 0, 0, 0 };
+  players_.push_back(player);
+  return true;
+}
+
+void Tournament::Pair(std::vector<Match>* matches) const
+{
+  GLint nplayers = players_.size();
+  if (format_ == kRoundRobin)
+    {
+      for (GLint first = 0; first < nplayers; ++first)
+	for (GLint second = first + 1; second < nplayers; ++second)
+	  matches->push_back(Match{ first, second });
+      return;
+    }
+
+  std::vector<GLint> order(nplayers);
+  for (GLint i = 0; i < nplayers; ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [this](GLint a, GLint b)
+		   {
+		     return players_[a].rating > players_[b].rating;
+		   });
+  // shift the pairs by one every other round so the same neighbours don't meet forever,
+  // whoever is left over sits the round out
+  for (GLint i = round_ % 2; i + 1 < nplayers; i += 2)
+    matches->push_back(Match{ order[i], order[i + 1] });
+}
+
+double Tournament::Score(const PluginGameResult& result, const PluginGameResult& opponent)
+{
+  bool bforfeit = result.bover_budget || result.billegal;
+  bool bopponent_forfeit = opponent.bover_budget || opponent.billegal;
+  if (bforfeit != bopponent_forfeit)
+    return bforfeit ? 0 : 1;
+  if (result.lines != opponent.lines)
+    return result.lines > opponent.lines ? 1 : 0;
+  return 0.5;
+}
+
+void Tournament::PlayRound()
+{
+  std::vector<Match> matches;
+  Pair(&matches);
+  // everyone plays the round's seed once, however many pairings they are in
+  std::vector<bool> bplaying(players_.size(), false);
+  for (const Match& match : matches)
+    bplaying[match.first] = bplaying[match.second] = true;
+  std::vector<GLint> players;
+  for (size_t player = 0; player < players_.size(); ++player)
+    if (bplaying[player])
+      players.push_back(player);
+  uint32_t seed = seed_ * 1000003u + round_ * 7919u;
+
+  std::vector<PluginGameResult> results(players_.size());
+  std::atomic<GLint> next_game(0);
+  pool_->ParallelFor(pool_->NumThreads(), [&](GLint thread)
+		     {
+		       GLint game;
+		       while ((game = next_game.fetch_add(1)) < static_cast<GLint>(players.size()))
+			 {
+			   GLint player = players[game];
+			   results[player] = PlayPluginGame(plugins_[thread][player].get(), seed, max_pieces_, cpu_budget_);
+			 }
+		     });
+
+  UpdateRatings(matches, results);
+  matches_played_ += matches.size();
+  ++round_;
+}
+
+/*
+  Glicko with the round as the rating period. Deviations aren't grown
+  between rounds since the bots don't change while the tournament runs.
+  A player's pairings are weighted to add up to one game, because
+  their outcomes all hang on the same game of that player's.
+*/
+void Tournament::UpdateRatings(const std::vector<Match>& matches, const std::vector<PluginGameResult>& results)
+{
+  const double q = std::log(10.0) / 400;
+  const double pi = 3.14159265358979;
+  auto g = [=](double deviation)
+    {
+      return 1 / std::sqrt(1 + 3 * q * q * deviation * deviation / (pi * pi));
+    };
+
+  GLint nplayers = players_.size();
+  std::vector<GLint> pairings(nplayers, 0);
+  for (const Match& match : matches)
+    {
+      ++pairings[match.first];
+      ++pairings[match.second];
+    }
+  std::vector<double> information(nplayers, 0), gain(nplayers, 0);
+  for (const Match& match : matches)
+    {
+      GLint sides[2] = { match.first, match.second };
+      for (GLint side = 0; side < 2; ++side)
+	{
+	  TournamentPlayer& player = players_[sides[side]];
+	  const TournamentPlayer& opponent = players_[sides[1 - side]];
+	  double score = Score(results[sides[side]], results[sides[1 - side]]);
+	  double weight = g(opponent.deviation);
+	  double expected = 1 / (1 + std::pow(10.0, -weight * (player.rating - opponent.rating) / 400));
+	  double share = 1.0 / pairings[sides[side]];
+	  information[sides[side]] += share * q * q * weight * weight * expected * (1 - expected);
+	  gain[sides[side]] += share * weight * (score - expected);
+	  if (score == 1)
+	    ++player.wins;
+	  else if (score == 0)
+	    ++player.losses;
+	  else
+	    ++player.draws;
+	}
+    }
+
+  // the ratings above were read before any of them changed
+  for (GLint i = 0; i < nplayers; ++i)
+    {
+      if (information[i] == 0)
+	continue;
+      TournamentPlayer& player = players_[i];
+      double precision = 1 / (player.deviation * player.deviation) + information[i];
+      player.rating += q / precision * gain[i];
+      player.deviation = std::sqrt(1 / precision);
+    }
+}
+
+bool Tournament::IsSeparated() const
+{
+  std::vector<TournamentPlayer> standings = Standings();
+  for (size_t i = 1; i < standings.size(); ++i)
+    {
+      const TournamentPlayer& above = standings[i - 1];
+      const TournamentPlayer& below = standings[i];
+      if (above.rating - kConfidence_ * above.deviation <= below.rating + kConfidence_ * below.deviation)
+	return false;
+    }
+  return true;
+}
+
+std::vector<TournamentPlayer> Tournament::Standings() const
+{
+  std::vector<TournamentPlayer> standings(players_);
+  std::stable_sort(standings.begin(), standings.end(), [](const TournamentPlayer& a, const TournamentPlayer& b)
+		   {
+		     return a.rating > b.rating;
+		   });
+  return standings;
+}
+
+Tournament::~Tournament()
+{
+}
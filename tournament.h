@@ -0,0 +1,108 @@
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include "plugin_host.h"
+#include "thread_pool.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct PluginGameResult
+{
+  GLint pieces;
+  GLuint lines;
+  GLuint score;
+  bool bgame_over;
+  bool bover_budget;
+  bool billegal;
+  double cpu_time;
+};
+
+// Plays one headless game with the plugin choosing every move
+PluginGameResult PlayPluginGame(BotPlugin* plugin, unsigned int seed, GLint max_pieces, double cpu_budget);
+
+struct TournamentPlayer
+{
+  std::string name;
+  std::string library;
+  double rating;
+  double deviation;
+  GLint wins, losses, draws;
+};
+
+enum TournamentFormat
+  {
+    kRoundRobin,
+    kSwiss
+  };
+
+/*
+  Rates bot plugins against each other on the headless engine.
+  Each round pairs everyone once (round robin) or pairs neighbours in
+  the standings (Swiss). Every paired bot plays one game on the
+  round's seed, so they all see identical pieces, and the games run
+  in parallel. A pairing goes to whoever cleared more lines before
+  topping out or reaching the piece limit, and a bot that runs out of
+  CPU budget loses. A bot's pairings in a round all come from its one
+  game, so together they count as a single game in the Glicko update,
+  with the round as the rating period. The tournament can stop once
+  neighbouring players' 95% intervals no longer overlap.
+*/
+
+class Tournament
+{
+public:
+  Tournament(ThreadPool* pool);
+
+  void SetFormat(TournamentFormat format) { format_ = format; }
+  void SetMaxPieces(GLint pieces) { max_pieces_ = pieces; }
+  void SetCpuBudget(double seconds) { cpu_budget_ = seconds; }
+  void SetSeed(uint32_t seed) { seed_ = seed; }
+
+  bool AddPlayer(const std::string& library);
+  const std::string& Error() const { return error_; }
+
+  void PlayRound();
+  // True once every player's interval is clear of its neighbours' in the standings
+  bool IsSeparated() const;
+
+  GLint Round() const { return round_; }
+  GLint MatchesPlayed() const { return matches_played_; }
+  // Players sorted best first
+  std::vector<TournamentPlayer> Standings() const;
+
+  virtual ~Tournament();
+private:
+  struct Match
+  {
+    GLint first, second;
+  };
+
+  void Pair(std::vector<Match>* matches) const;
+  // results has each player's game this round
+  void UpdateRatings(const std::vector<Match>& matches, const std::vector<PluginGameResult>& results);
+  static double Score(const PluginGameResult& result, const PluginGameResult& opponent);
+
+  ThreadPool* pool_;
+  TournamentFormat format_;
+  GLint max_pieces_;
+  double cpu_budget_;
+  uint32_t seed_;
+
+  std::vector<TournamentPlayer> players_;
+  // one loaded copy of every bot per thread, so games never share a bot
+  std::vector< std::vector< std::unique_ptr<BotPlugin> > > plugins_;
+  std::string error_;
+  GLint round_;
+  GLint matches_played_;
+
+  static const double kInitialRating_;
+  static const double kInitialDeviation_;
+  static const double kConfidence_;
+};
+
+
+#endif // TOURNAMENT_H
@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+#include "tournament.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+  Runs bot plugins against each other until their ratings are told
+  apart or the round limit is reached, printing the standings after
+  every round.
+*/
+
+void Usage()
+{
+  std::cerr << "usage: tournament [--swiss] [--rounds <n>] [--pieces <n>] [--budget <ms>] [--threads <n>] [--seed <n>] <plugin>..." << std::endl;
+  std::cerr << "  --swiss   pair neighbours in the standings instead of everyone with everyone" << std::endl;
+  std::cerr << "  --rounds  stop after this many rounds even if ratings still overlap, default 50" << std::endl;
+}
+
+void PrintStandings(const Tournament& tournament)
+{
+  std::cout << "round " << tournament.Round() << ", " << tournament.MatchesPlayed() << " matches" << std::endl;
+  for (const TournamentPlayer& player : tournament.Standings())
+    std::cout << "  " << std::left << std::setw(24) << player.name << std::right << std::fixed << std::setprecision(0)
+	      << std::setw(6) << player.rating << " +/- " << std::setw(4) << 1.96 * player.deviation
+	      << "  " << player.wins << "-" << player.losses << "-" << player.draws << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  GLint max_rounds = 50, nthreads = 0;
+  TournamentFormat format = kRoundRobin;
+  GLint max_pieces = 1000;
+  double cpu_budget = 0.05;
+  uint32_t seed = 1;
+  std::vector<std::string> libraries;
+
+  for (GLint arg = 1; arg < argc; ++arg)
+    {
+      std::string flag = argv[arg];
+      if (flag == "--swiss")
+	{
+	  format = kSwiss;
+	}
+      else if (flag.compare(0, 2, "--") == 0 && arg + 1 < argc)
+	{
+	  const char* value = argv[++arg];
+	  if (flag == "--rounds")
+	    max_rounds = atoi(value);
+	  else if (flag == "--pieces")
+	    max_pieces = atoi(value);
+	  else if (flag == "--budget")
+	    cpu_budget = atof(value) / 1000;
+	  else if (flag == "--threads")
+	    nthreads = atoi(value);
+	  else if (flag == "--seed")
+	    seed = strtoul(value, nullptr, 10);
+	  else
+	    {
+	      Usage();
+	      return EXIT_FAILURE;
+	    }
+	}
+      else if (flag.compare(0, 2, "--") == 0)
+	{
+	  Usage();
+	  return EXIT_FAILURE;
+	}
+      else
+	{
+	  libraries.push_back(flag);
+	}
+    }
+  if (libraries.size() < 2)
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+
+  ThreadPool pool(nthreads);
+  Tournament tournament(&pool);
+  tournament.SetFormat(format);
+  tournament.SetMaxPieces(max_pieces);
+  tournament.SetCpuBudget(cpu_budget);
+  tournament.SetSeed(seed);
+  for (const std::string& library : libraries)
+    if (!tournament.AddPlayer(library))
+      {
+	std::cerr << "Failed to load " << library << ": " << tournament.Error() << std::endl;
+	return EXIT_FAILURE;
+      }
+
+  while (tournament.Round() < max_rounds)
+    {
+      tournament.PlayRound();
+      PrintStandings(tournament);
+      if (tournament.IsSeparated())
+	{
+	  std::cout << "ratings separated" << std::endl;
+	  break;
+	}
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,238 @@
+#include "tuner.h"
+#include "randomizer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+
+const double WeightTuner::kTournamentFraction_ = 0.1;
+const double WeightTuner::kReplaceFraction_ = 0.3;
+const double WeightTuner::kMutationRate_ = 0.05;
+const double WeightTuner::kMutationScale_ = 0.2;
+
+WeightTuner::WeightTuner(ThreadPool* pool) : pool_(pool),
+					     population_size_(100),
+					     games_(32),
+					     max_pieces_(5000),
+					     seed_(1),
+					     generation_(0),
+					     mean_fitness_(0),
+					     pieces_played_(0)
+{
+  best_.weights = EvalWeights::Default();
+  best_.fitness = 0;
+}
+
+void WeightTuner::Initialize(const EvalWeights& start)
+{
+  std::mt19937 rng(seed_);
+  std::uniform_real_distribution<double> spread(-0.5, 0.5);
+
+  generation_ = 0;
+  population_.resize(population_size_);
+  for (GLint i = 0; i < population_size_; ++i)
+    {
+      TunerCandidate& candidate = population_[i];
+      candidate.weights = start;
+      // keep one copy of the starting point so the tuner can't do worse than it
+      if (i > 0)
+	{
+	  for (GLint feature = 0; feature < kNumEvalFeatures; ++feature)
+	    candidate.weights.weights[feature] += spread(rng);
+	}
+      Normalize(&candidate.weights);
+      candidate.fitness = 0;
+    }
+  best_ = population_.front();
+}
+
+void WeightTuner::Step()
+{
+  Evaluate();
+  Breed();
+  ++generation_;
+}
+
+void WeightTuner::Evaluate()
+{
+  const GLint ncandidates = population_.size();
+  const GLint ngames = ncandidates * games_;
+  std::vector<GLint> lines(ngames, 0);
+  std::vector<Evaluator> evaluators;
+  evaluators.reserve(ncandidates);
+  for (const TunerCandidate& candidate : population_)
+    evaluators.push_back(Evaluator(candidate.weights));
+
+  std::vector< std::vector<Placement> > scratch(pool_->NumThreads());
+  std::atomic<GLint> next_game(0);
+  std::atomic<uint64_t> pieces(0);
+  // games are handed out one at a time since their lengths vary wildly
+  pool_->ParallelFor(pool_->NumThreads(), [&](GLint thread)
+		     {
+		       GLint game;
+		       uint64_t played = 0;
+		       while ((game = next_game.fetch_add(1)) < ngames)
+			 {
+			   // every candidate sees the same seeds, which change each generation
+			   uint32_t seed = seed_ * 1000003u + generation_ * 7919u + game % games_;
+			   GLint game_pieces = 0;
+			   lines[game] = PlayGame(evaluators[game / games_], seed, max_pieces_, &scratch[thread], &game_pieces);
+			   played += game_pieces;
+			 }
+		       pieces += played;
+		     });
+  pieces_played_ += pieces;
+
+  mean_fitness_ = 0;
+  for (GLint i = 0; i < ncandidates; ++i)
+    {
+      GLint total = 0;
+      for (GLint game = 0; game < games_; ++game)
+	total += lines[i * games_ + game];
+      population_[i].fitness = static_cast<double>(total) / games_;
+      mean_fitness_ += population_[i].fitness / ncandidates;
+    }
+  std::sort(population_.begin(), population_.end(), [](const TunerCandidate& a, const TunerCandidate& b)
+	    {
+	      return a.fitness > b.fitness;
+	    });
+  best_ = population_.front();
+}
+
+void WeightTuner::Breed()
+{
+  // seeded by generation so a resumed run breeds the same children
+  std::mt19937 rng(seed_ ^ (generation_ * 2654435761u));
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::uniform_int_distribution<GLint> pick_feature(0, kNumEvalFeatures - 1);
+
+  const GLint nchildren = std::max(1, static_cast<GLint>(population_.size() * kReplaceFraction_));
+  std::vector<TunerCandidate> children(nchildren);
+  for (TunerCandidate& child : children)
+    {
+      const TunerCandidate& a = Tournament(rng);
+      const TunerCandidate& b = Tournament(rng);
+      double total = a.fitness + b.fitness;
+      double share = total > 0 ? a.fitness / total : 0.5;
+      for (GLint feature = 0; feature < kNumEvalFeatures; ++feature)
+	child.weights.weights[feature] = share * a.weights.weights[feature] + (1 - share) * b.weights.weights[feature];
+      if (uniform(rng) < kMutationRate_)
+	child.weights.weights[pick_feature(rng)] += (2 * uniform(rng) - 1) * kMutationScale_;
+      Normalize(&child.weights);
+      child.fitness = 0;
+    }
+  // the population is sorted best first, so the children replace the tail
+  std::copy(children.begin(), children.end(), population_.end() - nchildren);
+}
+
+const TunerCandidate& WeightTuner::Tournament(std::mt19937& rng) const
+{
+  const GLint entrants = std::max(2, static_cast<GLint>(population_.size() * kTournamentFraction_));
+  std::uniform_int_distribution<GLint> pick(0, population_.size() - 1);
+  GLint winner = pick(rng);
+  for (GLint i = 1; i < entrants; ++i)
+    winner = std::min(winner, pick(rng));
+  return population_[winner];
+}
+
+GLint WeightTuner::PlayGame(const Evaluator& evaluator, uint32_t seed, GLint max_pieces, std::vector<Placement>* scratch, GLint* pieces)
+{
+  Randomizer randomizer(seed);
+  BitBoard board;
+  GLint lines = 0;
+  for (*pieces = 0; *pieces < max_pieces; ++*pieces)
+    {
+      GeneratePlacements(board, randomizer.Next(), scratch);
+      if (scratch->empty())
+	break;
+
+      const Placement* choice = &scratch->front();
+      double best_value = -std::numeric_limits<double>::infinity();
+      for (const Placement& placement : *scratch)
+	{
+	  BitBoard child(board);
+	  GLint cleared = child.Place(GetPieceMask(placement.type, placement.rotation), placement.row, placement.col);
+	  double value = evaluator.LineClearReward(cleared) + evaluator.Evaluate(child);
+	  if (value > best_value)
+	    {
+	      best_value = value;
+	      choice = &placement;
+	    }
+	}
+      lines += board.Place(GetPieceMask(choice->type, choice->rotation), choice->row, choice->col);
+    }
+  return lines;
+}
+
+void WeightTuner::Normalize(EvalWeights* weights)
+{
+  double length = 0;
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    length += weights->weights[i] * weights->weights[i];
+  length = std::sqrt(length);
+  if (length == 0)
+    return;
+  for (GLint i = 0; i < kNumEvalFeatures; ++i)
+    weights->weights[i] /= length;
+}
+
+bool WeightTuner::SaveCheckpoint(const std::string& filename) const
+{
+  // written beside the real file and renamed so a crash never leaves half a checkpoint
+  const std::string temporary = filename + ".tmp";
+  {
+    std::ofstream file(temporary);
+    file.precision(17);
+    file << "tuner 1\n" << seed_ << ' ' << generation_ << ' ' << population_.size() << ' ' << pieces_played_ << '\n';
+    for (const TunerCandidate& candidate : population_)
+      {
+	file << candidate.fitness;
+	for (GLint i = 0; i < kNumEvalFeatures; ++i)
+	  file << ' ' << candidate.weights.weights[i];
+	file << '\n';
+      }
+    if (!file)
+      return false;
+  }
+  return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+bool WeightTuner::LoadCheckpoint(const std::string& filename)
+{
+  std::ifstream file(filename);
+  std::string magic;
+  GLint version = 0, size = 0;
+  uint32_t seed = 0;
+  GLint generation = 0;
+  uint64_t pieces = 0;
+  if (!(file >> magic >> version >> seed >> generation >> size >> pieces) || magic != "tuner" || version != 1 || size <= 0)
+    return false;
+
+  std::vector<TunerCandidate> population(size);
+  for (TunerCandidate& candidate : population)
+    {
+      if (!(file >> candidate.fitness))
+	return false;
+      for (GLint i = 0; i < kNumEvalFeatures; ++i)
+	{
+	  if (!(file >> candidate.weights.weights[i]))
+	    return false;
+	}
+    }
+
+  seed_ = seed;
+  generation_ = generation;
+  pieces_played_ = pieces;
+  population_size_ = size;
+  population_.swap(population);
+  best_ = population_.front();
+  return true;
+}
+
+WeightTuner::~WeightTuner()
+{
+  
+}
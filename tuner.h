@@ -0,0 +1,85 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include "bitboard.h"
+#include "evaluator.h"
+#include "thread_pool.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+  Genetic tuner for evaluator weights.
+  Every generation each candidate plays the same seeded games (common
+  random numbers) with a greedy one-piece player on the compact board,
+  so differences in fitness come from the weights and not the pieces.
+  The games are spread over the thread pool. Parents are picked by
+  tournament, children are a fitness-weighted average of two parents
+  with an occasional mutation, and the weakest candidates are replaced.
+  Weight vectors are kept at unit length since only their direction
+  changes which placement is chosen.
+*/
+
+struct TunerCandidate
+{
+  EvalWeights weights;
+  double fitness;
+};
+
+class WeightTuner
+{
+public:
+  explicit WeightTuner(ThreadPool* pool);
+
+  void SetPopulation(GLint candidates) { population_size_ = candidates; }
+  void SetGamesPerCandidate(GLint games) { games_ = games; }
+  // Games are cut off here so a good candidate can't run forever
+  void SetMaxPieces(GLint pieces) { max_pieces_ = pieces; }
+  void SetSeed(uint32_t seed) { seed_ = seed; }
+
+  // Starts a fresh population scattered around the given weights
+  void Initialize(const EvalWeights& start);
+  // Scores the population and breeds the next generation
+  void Step();
+
+  bool SaveCheckpoint(const std::string& filename) const;
+  bool LoadCheckpoint(const std::string& filename);
+
+  GLint Generation() const { return generation_; }
+  const TunerCandidate& Best() const { return best_; }
+  double MeanFitness() const { return mean_fitness_; }
+  uint64_t PiecesPlayed() const { return pieces_played_; }
+
+  // Lines cleared by a greedy player before topping out or hitting the piece limit
+  static GLint PlayGame(const Evaluator& evaluator, uint32_t seed, GLint max_pieces, std::vector<Placement>* scratch, GLint* pieces);
+
+  virtual ~WeightTuner();
+private:
+  void Evaluate();
+  void Breed();
+  const TunerCandidate& Tournament(std::mt19937& rng) const;
+  static void Normalize(EvalWeights* weights);
+
+  ThreadPool* pool_;
+  GLint population_size_;
+  GLint games_;
+  GLint max_pieces_;
+  uint32_t seed_;
+
+  GLint generation_;
+  std::vector<TunerCandidate> population_;
+  TunerCandidate best_;
+  double mean_fitness_;
+  uint64_t pieces_played_;
+
+  static const double kTournamentFraction_;
+  static const double kReplaceFraction_;
+  static const double kMutationRate_;
+  static const double kMutationScale_;
+};
+
+
+#endif // TUNER_H
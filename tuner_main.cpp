@@ -0,0 +1,58 @@
+#include "tuner.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+void Usage()
+{
+  std::cerr << "usage: tuner <checkpoint> <generations> [games] [pieces] [threads]" << std::endl;
+  std::cerr << "       resumes from the checkpoint if it exists and writes the best weights to <checkpoint>.weights" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+    {
+      Usage();
+      return EXIT_FAILURE;
+    }
+  const std::string checkpoint = argv[1];
+  const GLint generations = atoi(argv[2]);
+  
+  ThreadPool pool(argc >= 6 ? atoi(argv[5]) : 0);
+  WeightTuner tuner(&pool);
+  if (argc >= 4)
+    tuner.SetGamesPerCandidate(atoi(argv[3]));
+  if (argc >= 5)
+    tuner.SetMaxPieces(atoi(argv[4]));
+  
+  if (tuner.LoadCheckpoint(checkpoint))
+    std::cout << "Resuming at generation " << tuner.Generation() << std::endl;
+  else
+    tuner.Initialize(EvalWeights::Default());
+
+  const uint64_t start_pieces = tuner.PiecesPlayed();
+  auto start = std::chrono::steady_clock::now();
+  for (GLint i = 0; i < generations; ++i)
+    {
+      tuner.Step();
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      
+      const TunerCandidate& best = tuner.Best();
+      std::cout << "generation " << tuner.Generation() << ": best " << best.fitness << " mean " << tuner.MeanFitness()
+		<< " lines, " << static_cast<uint64_t>((tuner.PiecesPlayed() - start_pieces) / seconds) << " pieces/s, weights";
+      for (GLint feature = 0; feature < kNumEvalFeatures; ++feature)
+	std::cout << ' ' << best.weights.weights[feature];
+      std::cout << std::endl;
+
+      if (!tuner.SaveCheckpoint(checkpoint) || !best.weights.Save(checkpoint + ".weights"))
+	{
+	  std::cerr << "Failed to write " << checkpoint << std::endl;
+	  return EXIT_FAILURE;
+	}
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+#include "versus.h"
+
+#include <algorithm>
+
+namespace
+{
+  // Guideline attack tables, by lines cleared
+  const GLint kClearAttack[] = { 0, 0, 1, 2, 4 };
+  const GLint kTSpinAttack[] = { 0, 2, 4, 6, 6 };
+  // by clears in a row, the first one earning nothing extra
+  const GLint kComboAttack[] = { 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 4, 5 };
+  const GLint kNumComboAttacks = sizeof(kComboAttack) / sizeof(kComboAttack[0]);
+}
+
+VersusMatch::VersusMatch(unsigned int seed, GLint nrows, GLint ncols)
+{
+  for (GLint i = 0; i < 2; ++i)
+    {
+      playfields_[i].reset(new PlayField(nrows, ncols));
+      games_[i].reset(new Game(playfields_[i].get()));
+      // both players get the same pieces
+      games_[i]->Seed(seed);
+      games_[i]->Restart();
+      games_[i]->BeginPlay();
+      pieces_locked_[i] = 0;
+      combo_[i] = 0;
+      lines_sent_[i] = 0;
+      bback_to_back_[i] = false;
+      // but not the same holes, and xorshift never leaves a zero state
+      hole_state_[i] = (seed * 0x9e3779b9u ^ (i + 1) * 0x85ebca6bu) | 1;
+    }
+}
+
+GLint VersusMatch::Attack(const LockResult& lock, GLint combo, bool bback_to_back)
+{
+  if (lock.lines <= 0)
+    return 0;
+  GLint lines = std::min<GLint>(lock.lines, 4);
+  GLint attack = lock.btspin ? kTSpinAttack[lines] : kClearAttack[lines];
+  if (bback_to_back)
+    ++attack;
+  return attack + kComboAttack[std::min(combo, kNumComboAttacks) - 1];
+}
+
+void VersusMatch::Update(GLuint inputs0, GLuint inputs1)
+{
+  if (IsOver())
+    return;
+  const GLuint inputs[2] = { inputs0, inputs1 };
+  GLint attack[2] = { 0, 0 };
+  for (GLint i = 0; i < 2; ++i)
+    {
+      Game& game = *games_[i];
+      game.Press(inputs[i]);
+      game.Update();
+      if (game.PiecesLocked() == pieces_locked_[i])
+	continue;
+      pieces_locked_[i] = game.PiecesLocked();
+
+      const LockResult& lock = game.LastLock();
+      if (lock.lines == 0)
+	{
+	  combo_[i] = 0;
+	  continue;
+	}
+      ++combo_[i];
+      bool bdifficult = lock.btspin || lock.lines >= 4;
+      attack[i] = Attack(lock, combo_[i], bdifficult && bback_to_back_[i]);
+      bback_to_back_[i] = bdifficult;
+    }
+
+  // cancel both sides before sending either, so neither player's update order matters
+  for (GLint i = 0; i < 2; ++i)
+    attack[i] = games_[i]->CancelGarbage(attack[i]);
+  for (GLint i = 0; i < 2; ++i)
+    {
+      if (attack[i] <= 0)
+	continue;
+      lines_sent_[i] += attack[i];
+      games_[1 - i]->QueueGarbage(attack[i], NextHole(1 - i));
+    }
+}
+
+GLint VersusMatch::Winner() const
+{
+  if (games_[0]->IsGameOver() == games_[1]->IsGameOver())
+    return -1;
+  return games_[0]->IsGameOver() ? 1 : 0;
+}
+
+GLint VersusMatch::NextHole(GLint player)
+{
+  uint32_t& state = hole_state_[player];
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state % playfields_[player]->NumCols();
+}
+
+void VersusMatch::Save(VersusSnapshot* snapshot) const
+{
+  for (GLint i = 0; i < 2; ++i)
+    {
+      games_[i]->Save(&snapshot->games[i]);
+      snapshot->pieces_locked[i] = pieces_locked_[i];
+      snapshot->combo[i] = combo_[i];
+      snapshot->lines_sent[i] = lines_sent_[i];
+      snapshot->hole_state[i] = hole_state_[i];
+      snapshot->bback_to_back[i] = bback_to_back_[i];
+    }
+}
+
+void VersusMatch::Restore(const VersusSnapshot& snapshot)
+{
+  for (GLint i = 0; i < 2; ++i)
+    {
+      games_[i]->Restore(snapshot.games[i]);
+      pieces_locked_[i] = snapshot.pieces_locked[i];
+      combo_[i] = snapshot.combo[i];
+      lines_sent_[i] = snapshot.lines_sent[i];
+      hole_state_[i] = snapshot.hole_state[i];
+      bback_to_back_[i] = snapshot.bback_to_back[i];
+    }
+}
+
+VersusMatch::~VersusMatch()
+{
+}
@@ -0,0 +1,75 @@
+#ifndef VERSUS_H
+#define VERSUS_H
+
+#include "game.h"
+#include "playfield.h"
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <memory>
+
+// Everything a VersusMatch needs to go back to a frame
+struct VersusSnapshot
+{
+  GameSnapshot games[2];
+  GLuint pieces_locked[2];
+  GLint combo[2];
+  GLuint lines_sent[2];
+  uint32_t hole_state[2];
+  bool bback_to_back[2];
+};
+
+/*
+  Two games played head to head under guideline attack rules.
+  Clears send garbage by the attack table, with a bonus for a combo
+  of clears in a row and for back to back tetrises or T-spins.
+  Garbage first cancels whatever the sender has waiting, and the rest
+  goes to the opponent as one batch sharing a hole, which rises the
+  next time they lock a piece without clearing. Holes come from a
+  generator per player seeded with the match, and both players' locks
+  in a frame are settled together after both games have updated, so
+  the same seed and inputs always play out the same match.
+*/
+
+class VersusMatch
+{
+public:
+  VersusMatch(unsigned int seed, GLint nrows = 22, GLint ncols = 10);
+
+  // Plays one frame, with one GameInput mask per player, until either tops out
+  void Update(GLuint inputs0, GLuint inputs1);
+  bool IsOver() const { return games_[0]->IsGameOver() || games_[1]->IsGameOver(); }
+  // The player still standing, or -1 while both are and when both topped out on the same frame
+  GLint Winner() const;
+
+  const Game& GetGame(GLint player) const { return *games_[player]; }
+  const PlayField& GetPlayField(GLint player) const { return *playfields_[player]; }
+  GLint Combo(GLint player) const { return combo_[player]; }
+  bool IsBackToBack(GLint player) const { return bback_to_back_[player]; }
+  // Lines that got past cancelling and went to the opponent
+  GLuint LinesSent(GLint player) const { return lines_sent_[player]; }
+
+  // Lines a lock sends before cancelling, given the combo and back to back it leaves behind
+  static GLint Attack(const LockResult& lock, GLint combo, bool bback_to_back);
+
+  void Save(VersusSnapshot* snapshot) const;
+  void Restore(const VersusSnapshot& snapshot);
+
+  virtual ~VersusMatch();
+private:
+  VersusMatch(const VersusMatch&);
+  void operator=(const VersusMatch&);
+
+  GLint NextHole(GLint player);
+
+  std::unique_ptr<PlayField> playfields_[2];
+  std::unique_ptr<Game> games_[2];
+  GLuint pieces_locked_[2];
+  GLint combo_[2];
+  GLuint lines_sent_[2];
+  uint32_t hole_state_[2];
+  bool bback_to_back_[2];
+};
+
+
+#endif // VERSUS_H